@@ -0,0 +1,92 @@
+// Times name completion on 1M synthetic contacts (see dataset.h): sorting
+// the names, completing prefixes of one to six bytes of random names the way
+// the CLI's Tab does (listing up to 1000 names, or finding the last match
+// when there are more), and keeping the order up to date through adds and
+// deletes.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "bench/dataset.h"
+#include "src/database.h"
+
+#define BENCH_DB_PATH "/tmp/contact_manager_bench_complete.db"
+#define BENCH_CONTACTS 1000000
+#define BENCH_SEED 42
+#define BENCH_COMPLETIONS 10000
+#define BENCH_CHANGES 10000
+// As NAME_COMPLETION_MAX in the CLI
+#define BENCH_LIST_MAX 1000
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// What one Tab reads from the index; returns the number of names offered
+static unsigned int complete(const SortedIndex* names, const char* prefix) {
+    SortedIndexIter iter;
+    unsigned int count = sorted_index_count_prefix(names, prefix, BENCH_LIST_MAX + 1, &iter);
+    if (count > BENCH_LIST_MAX) {
+        return sorted_index_last_prefix(names, prefix) != NULL;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        free(strdup(sorted_index_next(names, &iter)));
+    }
+    return count;
+}
+
+int main(void) {
+    unlink(BENCH_DB_PATH);
+    Database* db = database_new(BENCH_DB_PATH);
+    Dataset dataset;
+    dataset_init(&dataset, BENCH_SEED);
+    database_begin_batch(db);
+    for (int i = 0; i < BENCH_CONTACTS; i++) {
+        DatasetContact contact;
+        dataset_next(&dataset, &contact);
+        database_add_contact(db, contact.name, contact.phone, contact.email);
+    }
+    database_end_batch(db);
+
+    double start = now_seconds();
+    const SortedIndex* names = database_sorted_names(db);
+    printf("Sorted %u names in %.1f ms\n", names->count, (now_seconds() - start) * 1000);
+
+    srand(BENCH_SEED);
+    char prefix[8];
+    double* times = malloc(sizeof(double) * BENCH_COMPLETIONS);
+    unsigned long offered = 0;
+    for (int i = 0; i < BENCH_COMPLETIONS; i++) {
+        const char* name = db->contacts[rand() % db->count]->name;
+        snprintf(prefix, sizeof(prefix), "%.*s", 1 + rand() % 6, name);
+        start = now_seconds();
+        offered += complete(names, prefix);
+        times[i] = (now_seconds() - start) * 1000;
+    }
+    qsort(times, BENCH_COMPLETIONS, sizeof(double), compare_doubles);
+    printf("Completion: p50 %.4f ms, p99 %.4f ms, max %.4f ms (%lu names offered)\n", times[BENCH_COMPLETIONS / 2],
+           times[BENCH_COMPLETIONS * 99 / 100], times[BENCH_COMPLETIONS - 1], offered);
+    free(times);
+
+    // Each add goes into the sorted names, each delete comes out of them
+    char name[32];
+    start = now_seconds();
+    for (int i = 0; i < BENCH_CHANGES; i++) {
+        snprintf(name, sizeof(name), "Bench%06d", rand() % 1000000);
+        database_add_contact(db, name, "555-0100", "bench@example.com");
+        database_del_contact(db, db->contacts[rand() % db->count]->name);
+    }
+    printf("Add and delete: %.4f ms per pair\n", (now_seconds() - start) * 1000 / BENCH_CHANGES);
+
+    database_close(db);
+    unlink(BENCH_DB_PATH);
+    return 0;
+}
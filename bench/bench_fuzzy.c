@@ -0,0 +1,129 @@
+// Measures database_search_fuzzy on 1M synthetic contacts (see dataset.h)
+// against a linear scan that compares the query with every word of every
+// name and email, using the same edit distance. Then types a misspelled
+// name one key at a time, as into the search box, and reports the slowest
+// keystroke.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "bench/dataset.h"
+#include "src/database.h"
+#include "src/edit_distance.h"
+#include "src/text_fold.h"
+
+#define BENCH_DB_PATH "/tmp/contact_manager_bench_fuzzy.db"
+#define BENCH_CONTACTS 1000000
+#define BENCH_SEED 42
+#define BENCH_RUNS 5
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int is_word_byte(char c) {
+    unsigned char u = c;
+    return (u >= 'a' && u <= 'z') || u >= 0x80;
+}
+
+// The fewest edits from pattern to the start of any word of folded text, or max + 1
+static int closest_word(const EditPattern* pattern, const char* text, int max) {
+    int best = max + 1;
+    while (*text) {
+        while (*text && !is_word_byte(*text)) {
+            text++;
+        }
+        const char* word = text;
+        while (is_word_byte(*text)) {
+            text++;
+        }
+        if (text > word) {
+            int distance = edit_distance_prefix(pattern, word, text - word, max);
+            best = distance < best ? distance : best;
+        }
+    }
+    return best;
+}
+
+// Counts the contacts with every word of a query within the same number of edits that fuzzy_index allows
+static int linear_search(Database* db, const char* query) {
+    char folded[256], field[2 * DATASET_FIELD_SIZE];
+    text_fold(query, folded);
+    EditPattern patterns[8];
+    int max[8], words = 0;
+    for (char* word = strtok(folded, " .@"); word && words < 8; word = strtok(NULL, " .@")) {
+        size_t len = strlen(word);
+        edit_pattern_init(&patterns[words], word, len);
+        max[words++] = len >= 8 ? 2 : len >= 4 ? 1 : 0;
+    }
+    int found = 0;
+    for (int i = 0; i < db->count; i++) {
+        int matches = 1;
+        for (int w = 0; w < words && matches; w++) {
+            text_fold(db->contacts[i]->name, field);
+            int distance = closest_word(&patterns[w], field, max[w]);
+            text_fold(db->contacts[i]->email, field);
+            int email = closest_word(&patterns[w], field, max[w]);
+            matches = (distance < email ? distance : email) <= max[w];
+        }
+        found += matches;
+    }
+    return found;
+}
+
+int main(void) {
+    unlink(BENCH_DB_PATH);
+    Database* db = database_new(BENCH_DB_PATH);
+    Dataset dataset;
+    dataset_init(&dataset, BENCH_SEED);
+    database_begin_batch(db);
+    for (int i = 0; i < BENCH_CONTACTS; i++) {
+        DatasetContact contact;
+        dataset_next(&dataset, &contact);
+        database_add_contact(db, contact.name, contact.phone, contact.email);
+    }
+    database_end_batch(db);
+
+    double start = now_seconds();
+    database_build_search_index(db);
+    printf("Index built in %.1f ms, %u distinct words\n", (now_seconds() - start) * 1000,
+           db->search_index.fuzzy.words.count);
+
+    const char* queries[] = {"jhon", "smtih", "jnoes smith", "garcai", "muller", "mariaa gonzales", "gmial", "xqzv"};
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        double best = 0;
+        int count;
+        for (int run = 0; run < BENCH_RUNS; run++) {
+            start = now_seconds();
+            free(database_search_fuzzy(db, queries[q], &count));
+            double ms = (now_seconds() - start) * 1000;
+            best = run == 0 || ms < best ? ms : best;
+        }
+        start = now_seconds();
+        int expected = linear_search(db, queries[q]);
+        double linear_ms = (now_seconds() - start) * 1000;
+        printf("%-16s %7d matches: indexed %7.2f ms, linear %8.2f ms%s\n", queries[q], count, best, linear_ms,
+               count == expected ? "" : " MISMATCH");
+    }
+
+    // Every prefix of the query, as the search box sees it while typing
+    const char* typed = "jhon smtih";
+    double slowest = 0;
+    char prefix[32];
+    for (size_t len = 1; len <= strlen(typed); len++) {
+        snprintf(prefix, sizeof(prefix), "%.*s", (int)len, typed);
+        start = now_seconds();
+        int count;
+        free(database_search_fuzzy(db, prefix, &count));
+        double ms = (now_seconds() - start) * 1000;
+        slowest = ms > slowest ? ms : slowest;
+    }
+    printf("Typing \"%s\": slowest keystroke %.2f ms\n", typed, slowest);
+
+    database_close(db);
+    unlink(BENCH_DB_PATH);
+    return 0;
+}
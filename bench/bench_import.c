@@ -0,0 +1,74 @@
+// Measures vCard parse throughput with 1, 2, 4, ... parser threads on a
+// generated 1M-card file, then a full database_import with all CPUs, and
+// importing the same file again with each duplicate policy.
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "src/database.h"
+
+#define BENCH_VCF_PATH "/tmp/contact_manager_bench_import.vcf"
+#define BENCH_DB_PATH "/tmp/contact_manager_bench_import.db"
+#define BENCH_CARDS 1000000
+
+static void write_cards(int n) {
+    FILE* file = fopen(BENCH_VCF_PATH, "w");
+    for (int i = 0; i < n; i++) {
+        // Every other card uses parameters, folding or quoted-printable
+        if (i % 2 == 0) {
+            fprintf(file, "BEGIN:VCARD\r\nVERSION:3.0\r\nN:Contact;Number %07d;;;\r\nFN:Number %07d Contact\r\n"
+                          "TEL;TYPE=work,voice:+1-555-%04d\r\nEMAIL;TYPE=INTERNET:number%07d@exam\r\n ple.com\r\nEND:VCARD\r\n",
+                    i, i, i % 10000, i);
+        } else {
+            fprintf(file, "BEGIN:VCARD\r\nVERSION:2.1\r\nFN;ENCODING=QUOTED-PRINTABLE:Num=C3=A9ro %07d\r\n"
+                          "TEL;CELL;PREF:555%07d\r\nEMAIL:n%07d@example.com\r\nNOTE:imported\\, twice\r\nEND:VCARD\r\n",
+                    i, i, i);
+        }
+    }
+    fclose(file);
+}
+
+static int count_cards(const Contact* cards, size_t count, void* user_data) {
+    (void)cards;
+    *(size_t*)user_data += count;
+    return 1;
+}
+
+int main(void) {
+    write_cards(BENCH_CARDS);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int threads = 1; threads <= cpus; threads *= 2) {
+        int fd = open(BENCH_VCF_PATH, O_RDONLY);
+        size_t cards = 0;
+        VCardReadStats stats;
+        vcard_read(fd, threads, count_cards, &cards, &stats);
+        close(fd);
+        printf("%2d parser threads: %7.1f MB/s, %zu cards in %.3f s\n", threads,
+               stats.bytes / (1024.0 * 1024.0) / stats.seconds, cards, stats.seconds);
+    }
+
+    unlink(BENCH_DB_PATH);
+    Database* db = database_new(BENCH_DB_PATH);
+    VCardReadStats stats;
+    database_import(db, BENCH_VCF_PATH, DATABASE_IMPORT_APPEND, NULL, &stats);
+    printf("database_import:    %7.1f MB/s, %llu cards in %.3f s\n", stats.bytes / (1024.0 * 1024.0) / stats.seconds,
+           (unsigned long long)stats.cards, stats.seconds);
+
+    // Every card is now a duplicate, found through hash sets built once per import
+    const char* policies[] = {"skip", "overwrite", "merge"};
+    for (int i = 0; i < 3; i++) {
+        DatabaseImportPolicy policy;
+        DatabaseImportStats import_stats;
+        database_import_policy_parse(policies[i], &policy);
+        database_import(db, BENCH_VCF_PATH, policy, &import_stats, &stats);
+        printf("re-import %-9s %7.1f MB/s, %lu added, %lu skipped, %lu overwritten, %lu merged in %.3f s\n", policies[i],
+               stats.bytes / (1024.0 * 1024.0) / stats.seconds, import_stats.added, import_stats.skipped,
+               import_stats.overwritten, import_stats.merged, stats.seconds);
+    }
+    database_close(db);
+
+    unlink(BENCH_DB_PATH);
+    unlink(BENCH_VCF_PATH);
+    return 0;
+}
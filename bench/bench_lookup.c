@@ -0,0 +1,72 @@
+// Compares database_get_contact (hash index) with the linear strcmp scan it
+// replaced, at 10k, 100k and 1M contacts.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "src/database.h"
+
+#define BENCH_DB_PATH "/tmp/contact_manager_bench_lookup.db"
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static Contact* linear_get_contact(Database* db, const char* name) {
+    for (int i = 0; i < db->count; i++) {
+        if (strcmp(db->contacts[i]->name, name) == 0) {
+            return db->contacts[i];
+        }
+    }
+    return NULL;
+}
+
+static void bench_size(int n) {
+    unlink(BENCH_DB_PATH);
+    Database* db = database_new(BENCH_DB_PATH);
+
+    char name[32];
+    database_begin_batch(db);
+    for (int i = 0; i < n; i++) {
+        snprintf(name, sizeof(name), "contact%07d", i);
+        database_add_contact(db, name, "555-0100", "someone@example.com");
+    }
+    database_end_batch(db);
+
+    // The linear scan is O(n) per lookup, so it gets fewer iterations
+    int indexed_lookups = 1000000;
+    int linear_lookups = 200;
+    srand(42);
+
+    double start = now_seconds();
+    int found = 0;
+    for (int i = 0; i < indexed_lookups; i++) {
+        snprintf(name, sizeof(name), "contact%07d", rand() % n);
+        found += database_get_contact(db, name) != NULL;
+    }
+    double indexed_ns = (now_seconds() - start) * 1e9 / indexed_lookups;
+
+    start = now_seconds();
+    for (int i = 0; i < linear_lookups; i++) {
+        snprintf(name, sizeof(name), "contact%07d", rand() % n);
+        found += linear_get_contact(db, name) != NULL;
+    }
+    double linear_ns = (now_seconds() - start) * 1e9 / linear_lookups;
+
+    printf("%8d contacts: indexed %8.1f ns/lookup, linear %12.1f ns/lookup, speedup %8.1fx (%d found)\n",
+           n, indexed_ns, linear_ns, linear_ns / indexed_ns, found);
+
+    database_close(db);
+    unlink(BENCH_DB_PATH);
+}
+
+int main(void) {
+    int sizes[] = {10000, 100000, 1000000};
+    for (int i = 0; i < 3; i++) {
+        bench_size(sizes[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,113 @@
+// Measures database_search (trigram index) against a linear case-insensitive
+// scan of name, phone and email, for a few query shapes at 1M contacts. As in
+// database_search, a phone-number query also matches the numbers' digits.
+// Then times the queries that scan every contact on 1, 2, 4... threads, up
+// to one per online CPU.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include "src/database.h"
+
+#define BENCH_DB_PATH "/tmp/contact_manager_bench_search.db"
+#define BENCH_CONTACTS 1000000
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Copies the digits of text to out; returns 0 if text has anything but digits and phone punctuation.
+static int phone_digits(const char* text, char* out) {
+    for (; *text; text++) {
+        if (*text >= '0' && *text <= '9') {
+            *out++ = *text;
+        } else if (strchr(" +-()./", *text) == NULL) {
+            return 0;
+        }
+    }
+    *out = '\0';
+    return 1;
+}
+
+static int linear_search(Database* db, const char* query) {
+    char query_digits[64], digits[64];
+    int phone = phone_digits(query, query_digits) && strlen(query_digits) >= 3;
+    int found = 0;
+    for (int i = 0; i < db->count; i++) {
+        Contact* contact = db->contacts[i];
+        found += strcasestr(contact->name, query) || strcasestr(contact->phone, query) ||
+                 strcasestr(contact->email, query) ||
+                 (phone && phone_digits(contact->phone, digits) && strstr(digits, query_digits));
+    }
+    return found;
+}
+
+int main(void) {
+    unlink(BENCH_DB_PATH);
+    Database* db = database_new(BENCH_DB_PATH);
+    const char* first[] = {"Alice", "Bob", "Carol", "Dave", "Erin", "Frank", "Grace", "Heidi", "Ivan", "Judy"};
+    const char* last[] = {"Smith", "Jones", "Brown", "Taylor", "Wilson", "Davies", "Evans", "Thomas", "Roberts", "Walker"};
+    char name[64], phone[32], email[64];
+    srand(42);
+    database_begin_batch(db);
+    for (int i = 0; i < BENCH_CONTACTS; i++) {
+        snprintf(name, sizeof(name), "%s %s %d", first[rand() % 10], last[rand() % 10], i);
+        snprintf(phone, sizeof(phone), "+1-555-%07d", rand() % 10000000);
+        snprintf(email, sizeof(email), "user%d@example.com", i);
+        database_add_contact(db, name, phone, email);
+    }
+    database_end_batch(db);
+
+    double start = now_seconds();
+    database_build_search_index(db);
+    printf("Index built in %.1f ms\n", (now_seconds() - start) * 1000);
+
+    const char* queries[] = {"al", "alice", "smith 12345", "user99999@", "555-123", "(555) 12", "TAYLOR 9", "nomatch"};
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        start = now_seconds();
+        int count;
+        free(database_search(db, queries[q], &count, NULL));
+        double indexed_ms = (now_seconds() - start) * 1000;
+
+        start = now_seconds();
+        int expected = linear_search(db, queries[q]);
+        double linear_ms = (now_seconds() - start) * 1000;
+
+        printf("%-14s %7d matches: indexed %8.2f ms, linear %8.2f ms%s\n", queries[q], count, indexed_ms, linear_ms,
+               count == expected ? "" : " MISMATCH");
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const char* scans[] = {"al", "7", "555-123"};
+    for (size_t q = 0; q < sizeof(scans) / sizeof(scans[0]); q++) {
+        int expected = -1;
+        printf("%-14s full scan:", scans[q]);
+        for (long threads = 1; threads <= cpus; threads *= 2) {
+            database_set_search_threads(db, threads);
+            // The best of a few, since no result is cached between them
+            double best = 0;
+            int count;
+            for (int run = 0; run < 5; run++) {
+                start = now_seconds();
+                free(database_search_shared(db, scans[q], &count));
+                double ms = (now_seconds() - start) * 1000;
+                best = run == 0 || ms < best ? ms : best;
+            }
+            if (expected < 0) {
+                expected = count;
+            }
+            printf(" %ld thread%s %7.2f ms%s", threads, threads > 1 ? "s" : "", best,
+                   count == expected ? "" : " MISMATCH");
+        }
+        printf("\n");
+    }
+
+    database_close(db);
+    unlink(BENCH_DB_PATH);
+    return 0;
+}
@@ -0,0 +1,220 @@
+// Load generator for contact_manager_server. Writes a 100k-contact store,
+// starts ./contact_manager_server on it, and runs closed-loop clients (each
+// sends a request and waits for the answer) with 1, 4, 16 and 64
+// connections: 90% gets, 5% searches and 5% adds. Reports requests/s and the
+// p50/p99 request latency for each.
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DB_PATH "/tmp/contact_manager_bench_server.db"
+#define BENCH_LOG_PATH "/tmp/contact_manager_bench_server.log"
+#define BENCH_PORT "47123"
+#define BENCH_CONTACTS 100000
+#define BENCH_SECONDS 3
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+    int fd;
+    char buffer[64 * 1024];
+    size_t start;
+    size_t end;
+} Client;
+
+static int client_connect(Client* client) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(atoi(BENCH_PORT));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    client->fd = socket(AF_INET, SOCK_STREAM, 0);
+    client->start = client->end = 0;
+    if (connect(client->fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(client->fd);
+        return 0;
+    }
+    int one = 1;
+    setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return 1;
+}
+
+// Returns the next response line without its newline, or NULL if the server went away
+static char* client_line(Client* client) {
+    for (;;) {
+        char* newline = memchr(client->buffer + client->start, '\n', client->end - client->start);
+        if (newline) {
+            char* line = client->buffer + client->start;
+            *newline = '\0';
+            client->start = newline + 1 - client->buffer;
+            return line;
+        }
+        memmove(client->buffer, client->buffer + client->start, client->end - client->start);
+        client->end -= client->start;
+        client->start = 0;
+        ssize_t n = recv(client->fd, client->buffer + client->end, sizeof(client->buffer) - client->end, 0);
+        if (n <= 0) {
+            return NULL;
+        }
+        client->end += n;
+    }
+}
+
+// Sends one request and reads its whole response
+static int client_request(Client* client, const char* request, size_t length) {
+    if (send(client->fd, request, length, MSG_NOSIGNAL) != (ssize_t)length) {
+        return 0;
+    }
+    char* line = client_line(client);
+    if (line == NULL) {
+        return 0;
+    }
+    int rows = strncmp(line, "OK ", 3) == 0 ? atoi(line + 3) : 0;
+    for (int i = 0; i < rows; i++) {
+        if (client_line(client) == NULL) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+typedef struct {
+    int id;
+    double deadline;
+    double* latencies;
+    size_t count;
+    size_t capacity;
+} Worker;
+
+static void* worker_main(void* arg) {
+    Worker* worker = arg;
+    Client* client = malloc(sizeof(Client));
+    if (!client_connect(client)) {
+        free(client);
+        return NULL;
+    }
+    unsigned int seed = worker->id * 7919 + 1;
+    char request[128];
+    int added = 0;
+    while (now_seconds() < worker->deadline) {
+        int kind = rand_r(&seed) % 100;
+        int length;
+        if (kind < 90) {
+            length = snprintf(request, sizeof(request), "get user%d\n", rand_r(&seed) % BENCH_CONTACTS);
+        } else if (kind < 95) {
+            length = snprintf(request, sizeof(request), "search %04d\n", rand_r(&seed) % 10000);
+        } else {
+            length = snprintf(request, sizeof(request), "add new%d_%d +1-555-0000 new@example.com\n", worker->id, added++);
+        }
+        double start = now_seconds();
+        if (!client_request(client, request, length)) {
+            break;
+        }
+        if (worker->count == worker->capacity) {
+            worker->capacity = worker->capacity ? worker->capacity * 2 : 4096;
+            worker->latencies = realloc(worker->latencies, sizeof(double) * worker->capacity);
+        }
+        worker->latencies[worker->count++] = now_seconds() - start;
+    }
+    close(client->fd);
+    free(client);
+    return NULL;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void run_load(int connections) {
+    Worker* workers = calloc(connections, sizeof(Worker));
+    pthread_t* threads = malloc(sizeof(pthread_t) * connections);
+    double start = now_seconds();
+    for (int i = 0; i < connections; i++) {
+        workers[i].id = connections * 1000 + i;
+        workers[i].deadline = start + BENCH_SECONDS;
+        pthread_create(&threads[i], NULL, worker_main, &workers[i]);
+    }
+    size_t total = 0;
+    for (int i = 0; i < connections; i++) {
+        pthread_join(threads[i], NULL);
+        total += workers[i].count;
+    }
+    double elapsed = now_seconds() - start;
+
+    double* latencies = malloc(sizeof(double) * (total > 0 ? total : 1));
+    size_t n = 0;
+    for (int i = 0; i < connections; i++) {
+        memcpy(latencies + n, workers[i].latencies, sizeof(double) * workers[i].count);
+        n += workers[i].count;
+        free(workers[i].latencies);
+    }
+    qsort(latencies, n, sizeof(double), compare_doubles);
+    if (n > 0) {
+        printf("%2d connections: %9.0f requests/s, p50 %7.1f us, p99 %7.1f us\n", connections, n / elapsed,
+               latencies[n / 2] * 1e6, latencies[n * 99 / 100] * 1e6);
+    } else {
+        printf("%2d connections: no requests completed\n", connections);
+    }
+    free(latencies);
+    free(workers);
+    free(threads);
+}
+
+static void write_store(void) {
+    FILE* file = fopen(BENCH_DB_PATH, "w");
+    for (int i = 0; i < BENCH_CONTACTS; i++) {
+        fprintf(file, "user%d,+1-555-%07d,user%d@example.com\n", i, i, i);
+    }
+    fclose(file);
+}
+
+int main(void) {
+    write_store();
+    pid_t server = fork();
+    if (server == 0) {
+        execl("./contact_manager_server", "contact_manager_server", "--port", BENCH_PORT, "--db", BENCH_DB_PATH, "--log",
+              BENCH_LOG_PATH, (char*)NULL);
+        perror("./contact_manager_server");
+        _exit(1);
+    }
+
+    // Wait for the server to load the store and start listening
+    Client probe;
+    double give_up = now_seconds() + 30;
+    while (!client_connect(&probe)) {
+        if (now_seconds() > give_up || waitpid(server, NULL, WNOHANG) == server) {
+            fprintf(stderr, "contact_manager_server did not start\n");
+            return 1;
+        }
+        usleep(10000);
+    }
+    close(probe.fd);
+
+    const int connections[] = {1, 4, 16, 64};
+    for (size_t i = 0; i < sizeof(connections) / sizeof(connections[0]); i++) {
+        run_load(connections[i]);
+    }
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    unlink(BENCH_DB_PATH);
+    unlink(BENCH_DB_PATH ".journal");
+    unlink(BENCH_LOG_PATH);
+    return 0;
+}
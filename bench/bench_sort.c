@@ -0,0 +1,114 @@
+// Times switching the sort order of 1M contacts in ContactListModel, against
+// a GListStore of ContactObjects under a GtkSortListModel with the
+// GtkCustomSorter and strcmp comparison it replaced.
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <gtk/gtk.h>
+#include "src/contact_object.h"
+#include "src/contact_list_model.h"
+
+#define BENCH_DB_PATH "/tmp/contact_manager_bench_sort.db"
+#define BENCH_CONTACTS 1000000
+
+static const ContactSortOrder switches[] = {
+    CONTACT_SORT_ORDER_NAME_DESC, CONTACT_SORT_ORDER_NAME_ASC,   CONTACT_SORT_ORDER_PHONE_ASC,
+    CONTACT_SORT_ORDER_PHONE_DESC, CONTACT_SORT_ORDER_EMAIL_ASC, CONTACT_SORT_ORDER_NAME_ASC,
+};
+static const char* order_names[] = {"name asc", "name desc", "phone asc", "phone desc", "email asc", "email desc"};
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The previous comparison: a switch on a global order and strcmp per call
+static ContactSortOrder strcmp_order;
+
+static int strcmp_compare(gconstpointer a, gconstpointer b, gpointer user_data) {
+    const Contact* contact_a = contact_object_get_contact(CONTACT_OBJECT((gpointer)a));
+    const Contact* contact_b = contact_object_get_contact(CONTACT_OBJECT((gpointer)b));
+    switch (strcmp_order) {
+        case CONTACT_SORT_ORDER_NAME_ASC:
+            return strcmp(contact_a->name, contact_b->name);
+        case CONTACT_SORT_ORDER_NAME_DESC:
+            return strcmp(contact_b->name, contact_a->name);
+        case CONTACT_SORT_ORDER_PHONE_ASC:
+            return strcmp(contact_a->phone, contact_b->phone);
+        case CONTACT_SORT_ORDER_PHONE_DESC:
+            return strcmp(contact_b->phone, contact_a->phone);
+        case CONTACT_SORT_ORDER_EMAIL_ASC:
+            return strcmp(contact_a->email, contact_b->email);
+        case CONTACT_SORT_ORDER_EMAIL_DESC:
+            return strcmp(contact_b->email, contact_a->email);
+    }
+    return 0;
+}
+
+static GListStore* new_store(Database* db) {
+    GListStore* store = g_list_store_new(CONTACT_TYPE_OBJECT);
+    for (int i = 0; i < db->count; i++) {
+        ContactObject* object = contact_object_new(db->contacts[i]);
+        g_list_store_append(store, object);
+        g_object_unref(object);
+    }
+    return store;
+}
+
+static void bench_strcmp(Database* db) {
+    GListStore* store = new_store(db);
+    strcmp_order = CONTACT_SORT_ORDER_NAME_ASC;
+    double start = now_seconds();
+    GtkSortListModel* model = gtk_sort_list_model_new(
+        G_LIST_MODEL(store), GTK_SORTER(gtk_custom_sorter_new(strcmp_compare, NULL, NULL)));
+    printf("strcmp:   initial %-10s %8.1f ms\n", order_names[CONTACT_SORT_ORDER_NAME_ASC], (now_seconds() - start) * 1000);
+    for (size_t i = 0; i < G_N_ELEMENTS(switches); i++) {
+        start = now_seconds();
+        strcmp_order = switches[i];
+        gtk_sort_list_model_set_sorter(model, GTK_SORTER(gtk_custom_sorter_new(strcmp_compare, NULL, NULL)));
+        printf("strcmp:   to %-15s %8.1f ms\n", order_names[switches[i]], (now_seconds() - start) * 1000);
+    }
+    g_object_unref(model);
+}
+
+static void bench_list_model(Database* db) {
+    double start = now_seconds();
+    ContactListModel* model = contact_list_model_new(db);
+    printf("model:    initial %-10s %8.1f ms\n", order_names[CONTACT_SORT_ORDER_NAME_ASC], (now_seconds() - start) * 1000);
+    for (size_t i = 0; i < G_N_ELEMENTS(switches); i++) {
+        start = now_seconds();
+        contact_list_model_set_sort_order(model, switches[i]);
+        printf("model:    to %-15s %8.1f ms\n", order_names[switches[i]], (now_seconds() - start) * 1000);
+    }
+    g_object_unref(model);
+}
+
+int main(void) {
+    setlocale(LC_ALL, "");
+    unlink(BENCH_DB_PATH);
+    Database* db = database_new(BENCH_DB_PATH);
+    const char* first[] = {"Alice", "Bob", "Carol", "Dave", "Erin", "Frank", "Grace", "Heidi", "Ivan", "Judy"};
+    const char* last[] = {"Smith", "Jones", "Brown", "Taylor", "Wilson", "Davies", "Evans", "Thomas", "Roberts", "Walker"};
+    char name[64], phone[32], email[64];
+    srand(42);
+    database_begin_batch(db);
+    for (int i = 0; i < BENCH_CONTACTS; i++) {
+        snprintf(name, sizeof(name), "%s %s %d", first[rand() % 10], last[rand() % 10], rand());
+        snprintf(phone, sizeof(phone), "+1-555-%07d", rand() % 10000000);
+        snprintf(email, sizeof(email), "user%d@example.com", rand());
+        database_add_contact(db, name, phone, email);
+    }
+    database_end_batch(db);
+
+    bench_strcmp(db);
+    // The first sort by each field includes computing that field's keys
+    bench_list_model(db);
+
+    database_close(db);
+    unlink(BENCH_DB_PATH);
+    return 0;
+}
@@ -0,0 +1,360 @@
+// Times the storage layer's main operations on synthetic contact sets (see
+// dataset.h) of each size: loading and saving CSV and binary stores, vCard
+// import and export, lookups by name and deletes. Each is run several times
+// and the median and fastest runs are reported, as a table and optionally as
+// JSON lines, one per benchmark and size, to compare commits:
+//   bench/bench_suite --commit abc123 --json abc123.jsonl
+//   bench/bench_suite --baseline abc123.jsonl
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bench/dataset.h"
+#include "src/database.h"
+
+#define BENCH_DIR "/tmp/contact_manager_bench_suite"
+#define BENCH_SEED 42
+#define BENCH_LOOKUPS 1000000
+// Share of the contacts deleted by the del benchmark
+#define BENCH_DELETE_DIVISOR 10
+
+typedef struct {
+    long size;
+    char csv_path[256];
+    char binary_path[256];
+    char vcard_path[256];
+    char scratch_path[256];
+    // Loaded from csv_path, for the benchmarks that only read it
+    Database* db;
+    // Names to look up or delete
+    char** names;
+    long name_count;
+} BenchContext;
+
+typedef struct {
+    char benchmark[32];
+    long contacts;
+    double median;
+} BaselineResult;
+
+static BaselineResult* baseline;
+static size_t baseline_count;
+static FILE* json;
+static const char* commit = "";
+static int runs = 3;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void remove_store(const char* path) {
+    char extra[300];
+    unlink(path);
+    snprintf(extra, sizeof(extra), "%s.journal", path);
+    unlink(extra);
+    snprintf(extra, sizeof(extra), "%s.compact", path);
+    unlink(extra);
+}
+
+// --- Benchmarks: each times one run and returns seconds ---
+
+static double bench_load_csv(BenchContext* context) {
+    double start = now_seconds();
+    Database* db = database_new(context->csv_path);
+    double elapsed = now_seconds() - start;
+    database_close(db);
+    return elapsed;
+}
+
+static double bench_load_binary(BenchContext* context) {
+    double start = now_seconds();
+    Database* db = database_new(context->binary_path);
+    double elapsed = now_seconds() - start;
+    database_close(db);
+    return elapsed;
+}
+
+static double bench_save_csv(BenchContext* context) {
+    double start = now_seconds();
+    database_save_as(context->db, context->scratch_path, DATABASE_FORMAT_CSV);
+    double elapsed = now_seconds() - start;
+    unlink(context->scratch_path);
+    return elapsed;
+}
+
+static double bench_save_binary(BenchContext* context) {
+    double start = now_seconds();
+    database_save_as(context->db, context->scratch_path, DATABASE_FORMAT_BINARY);
+    double elapsed = now_seconds() - start;
+    unlink(context->scratch_path);
+    return elapsed;
+}
+
+static double bench_import(BenchContext* context) {
+    remove_store(context->scratch_path);
+    Database* db = database_new(context->scratch_path);
+    double start = now_seconds();
+    database_import(db, context->vcard_path, DATABASE_IMPORT_APPEND, NULL, NULL);
+    double elapsed = now_seconds() - start;
+    database_close(db);
+    remove_store(context->scratch_path);
+    return elapsed;
+}
+
+static double bench_import_merge(BenchContext* context) {
+    remove_store(context->scratch_path);
+    Database* db = database_new(context->scratch_path);
+    double start = now_seconds();
+    database_import(db, context->vcard_path, DATABASE_IMPORT_MERGE, NULL, NULL);
+    double elapsed = now_seconds() - start;
+    database_close(db);
+    remove_store(context->scratch_path);
+    return elapsed;
+}
+
+static double bench_export(BenchContext* context) {
+    double start = now_seconds();
+    database_export(context->db, context->scratch_path, VCARD_VERSION_3);
+    double elapsed = now_seconds() - start;
+    unlink(context->scratch_path);
+    return elapsed;
+}
+
+static double bench_get(BenchContext* context) {
+    int found = 0;
+    double start = now_seconds();
+    for (long i = 0; i < BENCH_LOOKUPS; i++) {
+        found += database_get_contact(context->db, context->names[i % context->name_count]) != NULL;
+    }
+    double elapsed = now_seconds() - start;
+    if (found != BENCH_LOOKUPS) {
+        fprintf(stderr, "get: only %d of %d names found\n", found, BENCH_LOOKUPS);
+    }
+    return elapsed;
+}
+
+static double bench_get_missing(BenchContext* context) {
+    char name[64];
+    int found = 0;
+    double start = now_seconds();
+    for (long i = 0; i < BENCH_LOOKUPS; i++) {
+        snprintf(name, sizeof(name), "Nobody %ld", i);
+        found += database_get_contact(context->db, name) != NULL;
+    }
+    double elapsed = now_seconds() - start;
+    if (found != 0) {
+        fprintf(stderr, "get_missing: %d names found\n", found);
+    }
+    return elapsed;
+}
+
+// Deletes a random 1/BENCH_DELETE_DIVISOR of the contacts by name in one batch, from a fresh copy of the store
+static double bench_del(BenchContext* context) {
+    remove_store(context->scratch_path);
+    database_save_as(context->db, context->scratch_path, DATABASE_FORMAT_CSV);
+    Database* db = database_new(context->scratch_path);
+    database_build_name_index(db);
+    long count = context->size / BENCH_DELETE_DIVISOR;
+    double start = now_seconds();
+    database_begin_batch(db);
+    for (long i = 0; i < count; i++) {
+        database_del_contact(db, context->names[i]);
+    }
+    database_end_batch(db);
+    double elapsed = now_seconds() - start;
+    database_close(db);
+    remove_store(context->scratch_path);
+    return elapsed;
+}
+
+typedef struct {
+    const char* name;
+    double (*run)(BenchContext* context);
+    // Operations per run, for the time per operation: 0 means one per contact, -1 the deleted ones
+    long ops;
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    {"load_csv", bench_load_csv, 0},
+    {"load_binary", bench_load_binary, 0},
+    {"save_csv", bench_save_csv, 0},
+    {"save_binary", bench_save_binary, 0},
+    {"import", bench_import, 0},
+    {"import_merge", bench_import_merge, 0},
+    {"export", bench_export, 0},
+    {"get", bench_get, BENCH_LOOKUPS},
+    {"get_missing", bench_get_missing, BENCH_LOOKUPS},
+    {"del", bench_del, -1},
+};
+
+// --- Results ---
+
+static void load_baseline(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+    char line[512];
+    size_t capacity = 0;
+    while (fgets(line, sizeof(line), file)) {
+        const char* benchmark = strstr(line, "\"benchmark\":\"");
+        const char* contacts = strstr(line, "\"contacts\":");
+        const char* median = strstr(line, "\"median_s\":");
+        if (benchmark == NULL || contacts == NULL || median == NULL) {
+            continue;
+        }
+        if (baseline_count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            baseline = realloc(baseline, sizeof(BaselineResult) * capacity);
+        }
+        BaselineResult* result = &baseline[baseline_count++];
+        sscanf(benchmark + strlen("\"benchmark\":\""), "%31[^\"]", result->benchmark);
+        result->contacts = atol(contacts + strlen("\"contacts\":"));
+        result->median = atof(median + strlen("\"median_s\":"));
+    }
+    fclose(file);
+}
+
+static const BaselineResult* find_baseline(const char* benchmark, long contacts) {
+    for (size_t i = 0; i < baseline_count; i++) {
+        if (baseline[i].contacts == contacts && strcmp(baseline[i].benchmark, benchmark) == 0) {
+            return &baseline[i];
+        }
+    }
+    return NULL;
+}
+
+static void run_benchmark(BenchContext* context, const Benchmark* benchmark) {
+    double* times = malloc(sizeof(double) * runs);
+    for (int i = 0; i < runs; i++) {
+        times[i] = benchmark->run(context);
+    }
+    qsort(times, runs, sizeof(double), compare_doubles);
+    double median = times[runs / 2];
+    double fastest = times[0];
+    free(times);
+
+    long ops = benchmark->ops > 0 ? benchmark->ops
+               : benchmark->ops < 0 ? context->size / BENCH_DELETE_DIVISOR
+                                    : context->size;
+    double ns_per_op = ops > 0 ? median * 1e9 / ops : 0;
+    printf("%-13s %9ld %12.3f ms %12.3f ms %12.1f ns/op", benchmark->name, context->size, median * 1000,
+           fastest * 1000, ns_per_op);
+    const BaselineResult* base = find_baseline(benchmark->name, context->size);
+    if (base && base->median > 0) {
+        printf("  %+7.1f%%", (median / base->median - 1) * 100);
+    }
+    printf("\n");
+    fflush(stdout);
+    if (json) {
+        fprintf(json,
+                "{\"commit\":\"%s\",\"benchmark\":\"%s\",\"contacts\":%ld,\"ops\":%ld,\"runs\":%d,"
+                "\"median_s\":%.9f,\"min_s\":%.9f,\"ns_per_op\":%.1f}\n",
+                commit, benchmark->name, context->size, ops, runs, median, fastest, ns_per_op);
+        fflush(json);
+    }
+}
+
+static void bench_size(long size) {
+    BenchContext context;
+    context.size = size;
+    snprintf(context.csv_path, sizeof(context.csv_path), "%s/%ld.db", BENCH_DIR, size);
+    snprintf(context.binary_path, sizeof(context.binary_path), "%s/%ld.bin.db", BENCH_DIR, size);
+    snprintf(context.vcard_path, sizeof(context.vcard_path), "%s/%ld.vcf", BENCH_DIR, size);
+    snprintf(context.scratch_path, sizeof(context.scratch_path), "%s/scratch", BENCH_DIR);
+    if (!dataset_write_csv(context.csv_path, size, BENCH_SEED) ||
+        !dataset_write_vcard(context.vcard_path, size, BENCH_SEED)) {
+        perror(BENCH_DIR);
+        exit(1);
+    }
+    context.db = database_new(context.csv_path);
+    database_save_as(context.db, context.binary_path, DATABASE_FORMAT_BINARY);
+    database_build_name_index(context.db);
+
+    // Names of contacts in random order, the first ones distinct for the del benchmark
+    context.name_count = size;
+    context.names = malloc(sizeof(char*) * size);
+    for (long i = 0; i < size; i++) {
+        context.names[i] = strdup(context.db->contacts[i]->name);
+    }
+    srand(BENCH_SEED);
+    for (long i = size - 1; i > 0; i--) {
+        long j = ((long)rand() * RAND_MAX + rand()) % (i + 1);
+        char* name = context.names[i];
+        context.names[i] = context.names[j];
+        context.names[j] = name;
+    }
+
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        run_benchmark(&context, &benchmarks[i]);
+    }
+
+    for (long i = 0; i < size; i++) {
+        free(context.names[i]);
+    }
+    free(context.names);
+    database_close(context.db);
+    remove_store(context.csv_path);
+    remove_store(context.binary_path);
+    unlink(context.vcard_path);
+}
+
+int main(int argc, char* argv[]) {
+    const char* sizes = "10000,100000,1000000";
+    const char* json_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "--sizes") == 0) {
+            sizes = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "--runs") == 0) {
+            runs = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "--commit") == 0) {
+            commit = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "--json") == 0) {
+            json_path = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "--baseline") == 0) {
+            load_baseline(argv[++i]);
+        } else {
+            fprintf(stderr,
+                    "Usage: %s [--sizes n,n,...] [--runs n] [--commit id] [--json file] [--baseline file]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (runs < 1) {
+        runs = 1;
+    }
+    // Opened after reading the baseline, which may be the same file
+    if (json_path && (json = fopen(json_path, "w")) == NULL) {
+        perror(json_path);
+        return 1;
+    }
+
+    mkdir(BENCH_DIR, 0755);
+    printf("%-13s %9s %15s %15s %18s%s\n", "benchmark", "contacts", "median", "fastest", "per op",
+           baseline_count ? "  vs baseline" : "");
+    for (const char* p = sizes; *p;) {
+        char* end;
+        long size = strtol(p, &end, 10);
+        if (end == p || size <= 0) {
+            fprintf(stderr, "Bad size list %s\n", sizes);
+            return 1;
+        }
+        bench_size(size);
+        p = *end == ',' ? end + 1 : end;
+    }
+    rmdir(BENCH_DIR);
+    if (json) {
+        fclose(json);
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Measures the text_search.h kernel against strstr, the search index's check
+// before it, on the folded keys of 1M synthetic contacts (see dataset.h),
+// packed into one heap the way the index stores them.
+// contact_column_search, with each implementation the CPU supports, scans
+// every key for a few needles; then a phone-number query is matched against
+// the contacts' phone digits.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bench/dataset.h"
+#include "src/contact_column.h"
+#include "src/text_fold.h"
+#include "src/text_search.h"
+
+#define BENCH_CONTACTS 1000000
+#define BENCH_SEED 42
+#define BENCH_RUNS 5
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long scan_strstr(const ContactColumn* column, const char* needle) {
+    long found = 0;
+    for (uint32_t i = 0; i < column->count; i++) {
+        found += strstr(column->heap + column->offsets[i], needle) != NULL;
+    }
+    return found;
+}
+
+static uint32_t* ids;
+
+static long scan_kernel(const ContactColumn* column, const char* needle) {
+    return contact_column_search(column, needle, strlen(needle), ids);
+}
+
+// Fastest of BENCH_RUNS scans, in ms
+static double time_scan(long (*scan)(const ContactColumn*, const char*), const ContactColumn* column,
+                        const char* needle, long* found) {
+    double best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        double start = now_seconds();
+        *found = scan(column, needle);
+        double ms = (now_seconds() - start) * 1000;
+        best = run == 0 || ms < best ? ms : best;
+    }
+    return best;
+}
+
+static void compare(const ContactColumn* column, const char* label, const char* needle) {
+    long expected;
+    double baseline = time_scan(scan_strstr, column, needle, &expected);
+    printf("%-16s %8ld matches: strstr %7.2f ms", label, expected, baseline);
+    for (int impl = TEXT_SEARCH_SCALAR; impl <= TEXT_SEARCH_AVX2; impl++) {
+        if (!text_search_set_impl(impl)) {
+            continue;
+        }
+        long found;
+        double ms = time_scan(scan_kernel, column, needle, &found);
+        printf(", %s %7.2f ms (%.1fx)%s", text_search_impl_name(impl), ms, baseline / ms,
+               found == expected ? "" : " MISMATCH");
+    }
+    printf("\n");
+}
+
+int main(void) {
+    Dataset dataset;
+    dataset_init(&dataset, BENCH_SEED);
+    ContactColumn keys, digits;
+    contact_column_init(&keys);
+    contact_column_init(&digits);
+    char key[DATASET_FIELD_SIZE * 3 + 3];
+    char joined[DATASET_FIELD_SIZE * 3 + 3];
+    for (uint32_t i = 0; i < BENCH_CONTACTS; i++) {
+        DatasetContact contact;
+        dataset_next(&dataset, &contact);
+        snprintf(joined, sizeof(joined), "%s\x1f%s\x1f%s", contact.name, contact.phone, contact.email);
+        text_fold(joined, key);
+        contact_column_set(&keys, i, key);
+        size_t n = 0;
+        for (const char* c = contact.phone; *c; c++) {
+            if (*c >= '0' && *c <= '9') {
+                key[n++] = *c;
+            }
+        }
+        key[n] = '\0';
+        contact_column_set(&digits, i, key);
+    }
+    ids = malloc(sizeof(uint32_t) * BENCH_CONTACTS);
+    printf("%d keys, %.1f MB; best of %d scans\n", BENCH_CONTACTS, keys.heap_size / (1024.0 * 1024.0), BENCH_RUNS);
+
+    const char* needles[] = {"a", "smith", "muller", "@gmail.com", "maria garcia", "zzqx"};
+    for (size_t q = 0; q < sizeof(needles) / sizeof(needles[0]); q++) {
+        compare(&keys, needles[q], needles[q]);
+    }
+    // "555-1234" as its digits, which finds (555) 123-4..., 555.123.4... and +1-555-123-4...
+    compare(&digits, "phone 555-1234", "5551234");
+
+    contact_column_free(&keys);
+    contact_column_free(&digits);
+    free(ids);
+    return 0;
+}
@@ -0,0 +1,275 @@
+#include "bench/dataset.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    const char* name;
+    // For email addresses, when the name is not plain ASCII
+    const char* ascii;
+} DatasetName;
+
+// Most common first
+static const DatasetName first_names[] = {
+    {"James", NULL},     {"Mary", NULL},      {"Maria", NULL},     {"John", NULL},      {"Anna", NULL},
+    {"Michael", NULL},   {"David", NULL},     {"Linda", NULL},     {"José", "jose"},    {"Sarah", NULL},
+    {"Robert", NULL},    {"Elizabeth", NULL}, {"William", NULL},   {"Jennifer", NULL},  {"Thomas", NULL},
+    {"Laura", NULL},     {"Daniel", NULL},    {"Emma", NULL},      {"Richard", NULL},   {"Sophie", NULL},
+    {"Joseph", NULL},    {"Susan", NULL},     {"Christopher", NULL}, {"Jessica", NULL}, {"Peter", NULL},
+    {"Karen", NULL},     {"Paul", NULL},      {"Lisa", NULL},      {"Mark", NULL},      {"Nancy", NULL},
+    {"Andrew", NULL},    {"Hannah", NULL},    {"Jürgen", "juergen"}, {"Julia", NULL},   {"Kevin", NULL},
+    {"Claire", NULL},    {"Brian", NULL},     {"Olivia", NULL},    {"Stefan", NULL},    {"Chloé", "chloe"},
+    {"George", NULL},    {"Amélie", "amelie"}, {"Edward", NULL},   {"Rachel", NULL},    {"Ryan", NULL},
+    {"Zoë", "zoe"},      {"Jacob", NULL},     {"Ingrid", NULL},    {"Lukas", NULL},     {"Isabel", NULL},
+    {"François", "francois"}, {"Helen", NULL}, {"Björn", "bjorn"}, {"Katarzyna", NULL}, {"Matteo", NULL},
+    {"Fatima", NULL},    {"Ahmed", NULL},     {"Mei", NULL},       {"Hiroshi", NULL},   {"Priya", NULL},
+    {"Raj", NULL},       {"Sofía", "sofia"},  {"Alejandro", NULL}, {"Lucía", "lucia"},  {"Mateus", NULL},
+    {"Ana", NULL},       {"Søren", "soren"},  {"Astrid", NULL},    {"Łukasz", "lukasz"}, {"Agnieszka", NULL},
+    {"Dmitri", NULL},    {"Olga", NULL},      {"Noah", NULL},      {"Mia", NULL},       {"Liam", NULL},
+    {"Ava", NULL},       {"Ethan", NULL},     {"Grace", NULL},     {"Oscar", NULL},     {"Ella", NULL},
+    {"Felix", NULL},     {"Clara", NULL},     {"Hugo", NULL},      {"Léa", "lea"},      {"Emil", NULL},
+    {"Ida", NULL},       {"Nils", NULL},      {"Maja", NULL},      {"Aarav", NULL},     {"Ananya", NULL},
+    {"Kenji", NULL},     {"Yuki", NULL},      {"Chen", NULL},      {"Wei", NULL},       {"Omar", NULL},
+    {"Leila", NULL},     {"Tomás", "tomas"},  {"Inês", "ines"},    {"Kwame", NULL},     {"Amara", NULL},
+};
+
+static const DatasetName last_names[] = {
+    {"Smith", NULL},     {"Johnson", NULL},   {"Garcia", NULL},    {"Müller", "mueller"}, {"Brown", NULL},
+    {"Williams", NULL},  {"Jones", NULL},     {"Martin", NULL},    {"Rodríguez", "rodriguez"}, {"Miller", NULL},
+    {"Davis", NULL},     {"Schmidt", NULL},   {"Wilson", NULL},    {"Martínez", "martinez"}, {"Taylor", NULL},
+    {"Anderson", NULL},  {"Thomas", NULL},    {"Bernard", NULL},   {"Schneider", NULL}, {"Moore", NULL},
+    {"Jackson", NULL},   {"White", NULL},     {"López", "lopez"},  {"Harris", NULL},    {"Fischer", NULL},
+    {"Clark", NULL},     {"Lewis", NULL},     {"Dubois", NULL},    {"Robinson", NULL},  {"Walker", NULL},
+    {"Weber", NULL},     {"Young", NULL},     {"Allen", NULL},     {"González", "gonzalez"}, {"King", NULL},
+    {"Wright", NULL},    {"Meyer", NULL},     {"Scott", NULL},     {"Torres", NULL},    {"Nguyen", NULL},
+    {"Hill", NULL},      {"Flores", NULL},    {"Wagner", NULL},    {"Green", NULL},     {"Adams", NULL},
+    {"Nelson", NULL},    {"Becker", NULL},    {"Baker", NULL},     {"Hall", NULL},      {"Rivera", NULL},
+    {"Campbell", NULL},  {"Mitchell", NULL},  {"Schulz", NULL},    {"Carter", NULL},    {"Roberts", NULL},
+    {"Lefèvre", "lefevre"}, {"Kowalski", NULL}, {"Nowak", NULL},   {"Wiśniewski", "wisniewski"}, {"Rossi", NULL},
+    {"Russo", NULL},     {"Ferrari", NULL},   {"Esposito", NULL},  {"Bianchi", NULL},   {"Silva", NULL},
+    {"Santos", NULL},    {"Ferreira", NULL},  {"Pereira", NULL},   {"Jensen", NULL},    {"Nielsen", NULL},
+    {"Hansen", NULL},    {"Andersson", NULL}, {"Johansson", NULL}, {"Karlsson", NULL},  {"Ivanov", NULL},
+    {"Smirnov", NULL},   {"Kim", NULL},       {"Lee", NULL},       {"Park", NULL},      {"Wang", NULL},
+    {"Li", NULL},        {"Zhang", NULL},     {"Liu", NULL},       {"Chen", NULL},      {"Tanaka", NULL},
+    {"Suzuki", NULL},    {"Sato", NULL},      {"Patel", NULL},     {"Sharma", NULL},    {"Singh", NULL},
+    {"Khan", NULL},      {"Ali", NULL},       {"Hassan", NULL},    {"Mensah", NULL},    {"Okafor", NULL},
+    {"O'Brien", "obrien"}, {"Murphy", NULL},  {"Kelly", NULL},     {"Dupont", NULL},    {"Fernández", "fernandez"},
+};
+
+// For the long tail of names that are not in the lists above
+static const char* first_syllables[] = {
+    "ka", "lo", "mi", "ra", "ne", "to", "sa", "vi", "el", "an", "dor", "ri", "na", "li", "ja", "mar",
+    "te", "so", "be", "da", "fe", "gu", "ho", "ir", "ju", "ke", "len", "mo", "nu", "or", "pa", "ros",
+};
+static const char* last_syllables[] = {
+    "ber", "ka", "lin", "mor", "sta", "ve", "dra", "ho", "pel", "ri", "san", "tor", "wa", "zel", "bo", "cha",
+    "den", "fal", "gro", "ha", "kor", "lu", "mann", "nor", "pe", "ro", "sel", "ta", "vo", "wen", "ya", "zo",
+};
+static const char* last_endings[] = {"", "son", "berg", "ez", "ski", "ov", "ini", "ton", "ley", "ard", "sen", "ić"};
+
+static const char* domains[] = {
+    "gmail.com",   "yahoo.com",  "outlook.com",     "hotmail.com",  "icloud.com",   "gmx.de",
+    "web.de",      "orange.fr",  "btinternet.com",  "aol.com",      "proton.me",    "live.com",
+    "example.com", "acme-corp.com", "university.edu", "mail.ru",    "qq.com",       "free.fr",
+};
+
+#define COUNT_OF(array) (sizeof(array) / sizeof(array[0]))
+#define FIRST_COUNT COUNT_OF(first_names)
+#define LAST_COUNT COUNT_OF(last_names)
+#define DOMAIN_COUNT COUNT_OF(domains)
+// Share of first and last names taken from the lists rather than the long tail
+#define LISTED_FIRST_PERCENT 40
+#define LISTED_LAST_PERCENT 20
+
+// Cumulative Zipf weights (1/rank) of each list
+static double first_weights[FIRST_COUNT];
+static double last_weights[LAST_COUNT];
+static double domain_weights[DOMAIN_COUNT];
+static pthread_once_t weights_once = PTHREAD_ONCE_INIT;
+
+static void zipf_init(double* weights, size_t n) {
+    double total = 0;
+    for (size_t i = 0; i < n; i++) {
+        total += 1.0 / (i + 1);
+        weights[i] = total;
+    }
+}
+
+static void weights_init(void) {
+    zipf_init(first_weights, FIRST_COUNT);
+    zipf_init(last_weights, LAST_COUNT);
+    zipf_init(domain_weights, DOMAIN_COUNT);
+}
+
+// splitmix64
+static uint64_t next_u64(Dataset* dataset) {
+    uint64_t z = (dataset->state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static unsigned next_below(Dataset* dataset, unsigned n) {
+    return next_u64(dataset) % n;
+}
+
+static size_t zipf_pick(Dataset* dataset, const double* weights, size_t n) {
+    double x = (next_u64(dataset) >> 11) * (1.0 / 9007199254740992.0) * weights[n - 1];
+    size_t lo = 0, hi = n - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (weights[mid] <= x) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// A listed name, with its lowercase ASCII form for email addresses
+static void listed_name(const DatasetName* name, char* display, char* ascii) {
+    strcpy(display, name->name);
+    const char* source = name->ascii ? name->ascii : name->name;
+    while (*source) {
+        *ascii++ = tolower((unsigned char)*source++);
+    }
+    *ascii = '\0';
+}
+
+// A made-up name of two or three syllables, plus an ending
+static void tail_name(Dataset* dataset, const char** syllables, size_t syllable_count, const char* ending,
+                      char* display, char* ascii) {
+    ascii[0] = '\0';
+    unsigned length = 2 + next_below(dataset, 2);
+    for (unsigned i = 0; i < length; i++) {
+        strcat(ascii, syllables[next_below(dataset, syllable_count)]);
+    }
+    strcpy(display, ascii);
+    strcat(display, ending);
+    display[0] = toupper((unsigned char)display[0]);
+    // Email addresses keep only the ASCII part of the ending
+    for (const char* p = ending; *p && (unsigned char)*p < 0x80; p++) {
+        strncat(ascii, p, 1);
+    }
+}
+
+void dataset_init(Dataset* dataset, uint64_t seed) {
+    pthread_once(&weights_once, weights_init);
+    dataset->state = seed;
+}
+
+static void make_phone(Dataset* dataset, char* phone) {
+    unsigned style = next_below(dataset, 100);
+    unsigned area = 201 + next_below(dataset, 799);
+    unsigned a = next_below(dataset, 10000), b = next_below(dataset, 10000);
+    if (style < 5) {
+        phone[0] = '\0';
+    } else if (style < 30) {
+        snprintf(phone, DATASET_FIELD_SIZE, "+1-%03u-%03u-%04u", area, a % 1000, b);
+    } else if (style < 50) {
+        snprintf(phone, DATASET_FIELD_SIZE, "(%03u) %03u-%04u", area, a % 1000, b);
+    } else if (style < 60) {
+        snprintf(phone, DATASET_FIELD_SIZE, "%03u.%03u.%04u", area, a % 1000, b);
+    } else if (style < 68) {
+        snprintf(phone, DATASET_FIELD_SIZE, "+44 20 %04u %04u", a, b);
+    } else if (style < 75) {
+        snprintf(phone, DATASET_FIELD_SIZE, "07%03u %06u", a % 1000, b * 100 + a % 100);
+    } else if (style < 81) {
+        snprintf(phone, DATASET_FIELD_SIZE, "0049 30 %04u%03u", a, b % 1000);
+    } else if (style < 87) {
+        snprintf(phone, DATASET_FIELD_SIZE, "+49 151 %04u%04u", a, b);
+    } else if (style < 96) {
+        snprintf(phone, DATASET_FIELD_SIZE, "+33 1 %02u %02u %02u %02u", a / 100, a % 100, b / 100, b % 100);
+    } else {
+        snprintf(phone, DATASET_FIELD_SIZE, "+81 3-%04u-%04u", a, b);
+    }
+}
+
+static void make_email(Dataset* dataset, char* email, const char* f, const char* l) {
+    const char* domain = domains[zipf_pick(dataset, domain_weights, DOMAIN_COUNT)];
+    unsigned style = next_below(dataset, 100);
+    unsigned number = 1 + next_below(dataset, 9999);
+    if (style < 8) {
+        email[0] = '\0';
+    } else if (style < 40) {
+        snprintf(email, DATASET_FIELD_SIZE, "%s.%s@%s", f, l, domain);
+    } else if (style < 60) {
+        snprintf(email, DATASET_FIELD_SIZE, "%c%s%u@%s", f[0], l, number, domain);
+    } else if (style < 80) {
+        snprintf(email, DATASET_FIELD_SIZE, "%s%s%u@%s", f, l, number % 100, domain);
+    } else if (style < 90) {
+        snprintf(email, DATASET_FIELD_SIZE, "%s_%s@%s", f, l, domain);
+    } else {
+        snprintf(email, DATASET_FIELD_SIZE, "%s%u@%s", f, 1950 + number % 60, domain);
+    }
+}
+
+static void make_last_name(Dataset* dataset, char* display, char* ascii) {
+    if (next_below(dataset, 100) < LISTED_LAST_PERCENT) {
+        listed_name(&last_names[zipf_pick(dataset, last_weights, LAST_COUNT)], display, ascii);
+    } else {
+        tail_name(dataset, last_syllables, COUNT_OF(last_syllables),
+                  last_endings[next_below(dataset, COUNT_OF(last_endings))], display, ascii);
+    }
+}
+
+void dataset_next(Dataset* dataset, DatasetContact* contact) {
+    char first[32], first_ascii[32], last[32], last_ascii[32];
+    if (next_below(dataset, 100) < LISTED_FIRST_PERCENT) {
+        listed_name(&first_names[zipf_pick(dataset, first_weights, FIRST_COUNT)], first, first_ascii);
+    } else {
+        tail_name(dataset, first_syllables, COUNT_OF(first_syllables), "", first, first_ascii);
+    }
+    make_last_name(dataset, last, last_ascii);
+    unsigned style = next_below(dataset, 100);
+    if (style < 85) {
+        snprintf(contact->name, DATASET_FIELD_SIZE, "%s %s", first, last);
+    } else if (style < 95) {
+        snprintf(contact->name, DATASET_FIELD_SIZE, "%s %c. %s", first, 'A' + next_below(dataset, 26), last);
+    } else {
+        char second[32], second_ascii[32];
+        make_last_name(dataset, second, second_ascii);
+        snprintf(contact->name, DATASET_FIELD_SIZE, "%s %s-%s", first, last, second);
+    }
+    make_phone(dataset, contact->phone);
+    make_email(dataset, contact->email, first_ascii, last_ascii);
+}
+
+int dataset_write_csv(const char* path, long count, uint64_t seed) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return 0;
+    }
+    Dataset dataset;
+    dataset_init(&dataset, seed);
+    DatasetContact contact;
+    for (long i = 0; i < count; i++) {
+        dataset_next(&dataset, &contact);
+        fprintf(file, "%s,%s,%s\n", contact.name, contact.phone, contact.email);
+    }
+    return fclose(file) == 0;
+}
+
+int dataset_write_vcard(const char* path, long count, uint64_t seed) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return 0;
+    }
+    Dataset dataset;
+    dataset_init(&dataset, seed);
+    DatasetContact contact;
+    for (long i = 0; i < count; i++) {
+        dataset_next(&dataset, &contact);
+        fprintf(file, "BEGIN:VCARD\r\nVERSION:3.0\r\nFN:%s\r\n", contact.name);
+        if (contact.phone[0]) {
+            fprintf(file, "TEL;TYPE=CELL:%s\r\n", contact.phone);
+        }
+        if (contact.email[0]) {
+            fprintf(file, "EMAIL;TYPE=INTERNET:%s\r\n", contact.email);
+        }
+        fputs("END:VCARD\r\n", file);
+    }
+    return fclose(file) == 0;
+}
@@ -0,0 +1,33 @@
+#ifndef BENCH_DATASET_H
+#define BENCH_DATASET_H
+
+#include <stdint.h>
+
+// Synthetic contacts for the benchmarks. Names mix 100 common first and last
+// names, some accented, drawn with Zipf-like frequencies (a few very common),
+// with a long tail of made-up ones, and an occasional middle initial or
+// double-barrelled last name. Large sets repeat the common names, as real
+// address books do, without every other contact being a James Smith. Phone
+// numbers mix US, UK, German and French numbering and punctuation styles;
+// emails are built from the name at a skewed mix of domains. A few contacts
+// have no phone or no email. The same seed always gives the same contacts.
+
+typedef struct {
+    uint64_t state;
+} Dataset;
+
+#define DATASET_FIELD_SIZE 96
+
+typedef struct {
+    char name[DATASET_FIELD_SIZE];
+    char phone[DATASET_FIELD_SIZE];
+    char email[DATASET_FIELD_SIZE];
+} DatasetContact;
+
+void dataset_init(Dataset* dataset, uint64_t seed);
+void dataset_next(Dataset* dataset, DatasetContact* contact);
+// Writes count contacts as a CSV store or a vCard 3.0 file. Returns 0 on error.
+int dataset_write_csv(const char* path, long count, uint64_t seed);
+int dataset_write_vcard(const char* path, long count, uint64_t seed);
+
+#endif
@@ -0,0 +1,34 @@
+// Writes a synthetic contact set (see dataset.h) as a CSV store or a vCard
+// file, e.g. to try the programs on a large address book:
+//   bench/gen_dataset 1000000 contacts.db
+//   bench/gen_dataset --vcard --seed 7 100000 contacts.vcf
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench/dataset.h"
+
+int main(int argc, char* argv[]) {
+    int vcard = 0;
+    uint64_t seed = 1;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "--vcard") == 0) {
+            vcard = 1;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else {
+            break;
+        }
+    }
+    long count = i + 2 == argc ? atol(argv[i]) : -1;
+    if (count < 0) {
+        fprintf(stderr, "Usage: %s [--vcard] [--seed n] count file\n", argv[0]);
+        return 1;
+    }
+    const char* path = argv[i + 1];
+    if (!(vcard ? dataset_write_vcard(path, count, seed) : dataset_write_csv(path, count, seed))) {
+        perror(path);
+        return 1;
+    }
+    return 0;
+}
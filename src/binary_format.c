@@ -0,0 +1,177 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "binary_format.h"
+
+static uint64_t align8(uint64_t n) {
+    return (n + 7) & ~(uint64_t)7;
+}
+
+int binary_format_detect(const char* data, size_t size) {
+    return size >= BINARY_FORMAT_MAGIC_SIZE && memcmp(data, BINARY_FORMAT_MAGIC, BINARY_FORMAT_MAGIC_SIZE) == 0;
+}
+
+// A terminated heap means any in-bounds offset yields a terminated string
+static int heap_valid(const char* data, size_t size, uint64_t offset, uint64_t heap_size, uint64_t record_count) {
+    if (offset > size || heap_size > size - offset) {
+        return 0;
+    }
+    return record_count == 0 || (heap_size > 0 && data[offset + heap_size - 1] == '\0');
+}
+
+static int table_valid(size_t size, uint64_t offset, uint64_t count, size_t entry_size) {
+    return offset % sizeof(uint64_t) == 0 && offset <= size && count <= (size - offset) / entry_size;
+}
+
+static int open_v1(char* data, size_t size, const BinaryFormatHeader* header, BinaryFormatView* view) {
+    if (!table_valid(size, header->records_offset, header->record_count, sizeof(BinaryFormatRecord)) ||
+        !heap_valid(data, size, header->heap_offset, header->heap_size, header->record_count)) {
+        return 0;
+    }
+    view->records = (const BinaryFormatRecord*)(data + header->records_offset);
+    view->heap = data + header->heap_offset;
+    view->heap_size = header->heap_size;
+    return 1;
+}
+
+static int open_v2(char* data, size_t size, const BinaryFormatHeader* header, BinaryFormatView* view) {
+    if (header->header_size < sizeof(BinaryFormatHeader) ||
+        !table_valid(size, header->columns_offset, header->field_count, sizeof(BinaryFormatColumn))) {
+        return 0;
+    }
+    const BinaryFormatColumn* columns = (const BinaryFormatColumn*)(data + header->columns_offset);
+    // Only an empty store lacks a name column, whose offsets table also bounds
+    // record_count by the file size
+    if (header->record_count > 0 &&
+        (header->field_count <= CONTACT_FIELD_NAME || columns[CONTACT_FIELD_NAME].offsets_offset == 0)) {
+        return 0;
+    }
+    for (uint32_t f = 0; f < header->field_count && f < CONTACT_FIELD_COUNT; f++) {
+        if (columns[f].offsets_offset == 0) {
+            continue;
+        }
+        if (!table_valid(size, columns[f].offsets_offset, header->record_count, sizeof(uint64_t)) ||
+            !heap_valid(data, size, columns[f].heap_offset, columns[f].heap_size, header->record_count)) {
+            return 0;
+        }
+        view->columns[f].offsets = (const uint64_t*)(data + columns[f].offsets_offset);
+        view->columns[f].heap = data + columns[f].heap_offset;
+        view->columns[f].heap_size = columns[f].heap_size;
+    }
+    return 1;
+}
+
+int binary_format_open(char* data, size_t size, BinaryFormatView* view) {
+    if (size < BINARY_FORMAT_V1_HEADER_SIZE || !binary_format_detect(data, size)) {
+        return 0;
+    }
+    BinaryFormatHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(&header, data, BINARY_FORMAT_V1_HEADER_SIZE);
+    // Records are loaded into an int-indexed database
+    if (header.header_size < BINARY_FORMAT_V1_HEADER_SIZE || header.header_size > size ||
+        header.record_count > INT_MAX) {
+        return 0;
+    }
+    memcpy(&header, data, header.header_size < sizeof(header) ? header.header_size : sizeof(header));
+    memset(view, 0, sizeof(BinaryFormatView));
+    view->version = header.version;
+    view->record_count = header.record_count;
+    if (header.version == 1) {
+        return open_v1(data, size, &header, view);
+    }
+    return header.version == BINARY_FORMAT_VERSION && open_v2(data, size, &header, view);
+}
+
+int binary_format_record(const BinaryFormatView* view, uint64_t index, Contact* fields) {
+    contact_clear(fields);
+    if (view->version == 1) {
+        const BinaryFormatRecord* record = &view->records[index];
+        if (record->name >= view->heap_size || record->phone >= view->heap_size || record->email >= view->heap_size) {
+            return 0;
+        }
+        fields->name = view->heap + record->name;
+        fields->phone = view->heap + record->phone;
+        fields->email = view->heap + record->email;
+        return 1;
+    }
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        const BinaryFormatColumnView* column = &view->columns[f];
+        if (column->offsets) {
+            if (column->offsets[index] >= column->heap_size) {
+                return 0;
+            }
+            fields->fields[f] = column->heap + column->offsets[index];
+        }
+    }
+    return 1;
+}
+
+static int write_padding(FILE* file, uint64_t size) {
+    static const char zeros[8];
+    return size == 0 || fwrite(zeros, size, 1, file) == 1;
+}
+
+// Walks one field of every contact to lay out its column: a shared NUL at
+// offset 0 for empty values, then the others in contact order.
+static uint64_t column_heap_size(Contact** contacts, int count, int field) {
+    uint64_t heap_size = 1;
+    for (int i = 0; i < count; i++) {
+        const char* value = contacts[i]->fields[field];
+        if (value[0]) {
+            heap_size += strlen(value) + 1;
+        }
+    }
+    return heap_size;
+}
+
+static int write_column(FILE* file, Contact** contacts, int count, int field, uint64_t* offsets) {
+    uint64_t used = 1;
+    for (int i = 0; i < count; i++) {
+        const char* value = contacts[i]->fields[field];
+        offsets[i] = value[0] ? used : 0;
+        used += value[0] ? strlen(value) + 1 : 0;
+    }
+    int ok = fwrite(offsets, sizeof(uint64_t), count, file) == (size_t)count && fputc('\0', file) != EOF;
+    for (int i = 0; ok && i < count; i++) {
+        const char* value = contacts[i]->fields[field];
+        ok = value[0] == '\0' || fwrite(value, strlen(value) + 1, 1, file) == 1;
+    }
+    return ok && write_padding(file, align8(used) - used);
+}
+
+int binary_format_write(FILE* file, Contact** contacts, int count) {
+    BinaryFormatHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_FORMAT_MAGIC, BINARY_FORMAT_MAGIC_SIZE);
+    header.version = BINARY_FORMAT_VERSION;
+    header.header_size = sizeof(BinaryFormatHeader);
+    header.record_count = count;
+    header.field_count = CONTACT_FIELD_COUNT;
+    header.columns_offset = sizeof(BinaryFormatHeader);
+
+    BinaryFormatColumn columns[CONTACT_FIELD_COUNT];
+    uint64_t offset = header.columns_offset + sizeof(columns);
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        uint64_t heap_size = column_heap_size(contacts, count, f);
+        // The name column is kept even when empty, as readers require it
+        if (heap_size == 1 && (f != CONTACT_FIELD_NAME || count == 0)) {
+            memset(&columns[f], 0, sizeof(BinaryFormatColumn));
+            continue;
+        }
+        columns[f].offsets_offset = offset;
+        columns[f].heap_offset = offset + sizeof(uint64_t) * (uint64_t)count;
+        columns[f].heap_size = heap_size;
+        offset = align8(columns[f].heap_offset + heap_size);
+    }
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(columns, sizeof(columns), 1, file) == 1;
+    uint64_t* offsets = malloc(sizeof(uint64_t) * (count > 0 ? count : 1));
+    for (int f = 0; ok && f < CONTACT_FIELD_COUNT; f++) {
+        if (columns[f].offsets_offset) {
+            ok = write_column(file, contacts, count, f, offsets);
+        }
+    }
+    free(offsets);
+    return ok;
+}
@@ -0,0 +1,85 @@
+#ifndef BINARY_FORMAT_H
+#define BINARY_FORMAT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "contact_arena.h"
+
+// Binary .db layout (all integers little-endian), version 2:
+//
+//   BinaryFormatHeader
+//   BinaryFormatColumn[field_count]    one per ContactField, in schema order
+//   per column:
+//     uint64_t[record_count]           offset of each record's value in the column heap
+//     string heap                      the column's NUL-terminated values, 8-byte padded
+//
+// Each field is stored as a column, so a scan of one field reads one
+// contiguous table and heap. A column whose values are all empty has no table
+// or heap, except the name column of a non-empty store, which is required. Fields a file has no column for read as empty, and columns past
+// the schema are ignored. Records are reached by index without parsing, and
+// their fields can be used in place straight from a mapping of the file.
+//
+// Version 1 files hold name, phone and email row-wise, one BinaryFormatRecord
+// of offsets per record into a single heap; they are still read.
+
+#define BINARY_FORMAT_MAGIC "CMGTKDB\0"
+#define BINARY_FORMAT_MAGIC_SIZE 8
+#define BINARY_FORMAT_VERSION 2
+
+typedef struct {
+    char magic[BINARY_FORMAT_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t record_count;
+    // Version 1 only
+    uint64_t records_offset;
+    uint64_t heap_offset;
+    uint64_t heap_size;
+    // Version 2 only
+    uint32_t field_count;
+    uint32_t reserved;
+    uint64_t columns_offset;
+} BinaryFormatHeader;
+
+// Version 1 headers end before field_count
+#define BINARY_FORMAT_V1_HEADER_SIZE 48
+
+typedef struct {
+    uint64_t name;
+    uint64_t phone;
+    uint64_t email;
+} BinaryFormatRecord;
+
+typedef struct {
+    // 0 when every value is empty
+    uint64_t offsets_offset;
+    uint64_t heap_offset;
+    uint64_t heap_size;
+} BinaryFormatColumn;
+
+typedef struct {
+    // NULL when every value is empty
+    const uint64_t* offsets;
+    char* heap;
+    uint64_t heap_size;
+} BinaryFormatColumnView;
+
+typedef struct {
+    uint32_t version;
+    uint64_t record_count;
+    // Version 1
+    const BinaryFormatRecord* records;
+    char* heap;
+    uint64_t heap_size;
+    // Version 2
+    BinaryFormatColumnView columns[CONTACT_FIELD_COUNT];
+} BinaryFormatView;
+
+int binary_format_detect(const char* data, size_t size);
+// Validates the header and table bounds; returns 0 if the data is not a usable binary store.
+int binary_format_open(char* data, size_t size, BinaryFormatView* view);
+// Points fields at the record's values. Returns 0 if its offsets point outside the heap.
+int binary_format_record(const BinaryFormatView* view, uint64_t index, Contact* fields);
+int binary_format_write(FILE* file, Contact** contacts, int count);
+
+#endif
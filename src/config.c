@@ -9,6 +9,8 @@ void config_load(char* filename, Config* config) {
     config->port = strdup("1234");
     config->logfile = strdup("contact_manager_gtk.log");
     config->db_filename = strdup("contact_manager_gtk.db");
+    config->save_window_ms = 1000;
+    config->import_policy = strdup("merge");
 
     FILE* file = fopen(filename, "r");
     if (file == NULL) {
@@ -29,6 +31,11 @@ void config_load(char* filename, Config* config) {
             } else if (strcmp(key, "db_filename") == 0) {
                 free(config->db_filename);
                 config->db_filename = strdup(value);
+            } else if (strcmp(key, "save_window_ms") == 0) {
+                config->save_window_ms = atoi(value);
+            } else if (strcmp(key, "import_policy") == 0) {
+                free(config->import_policy);
+                config->import_policy = strdup(value);
             }
         }
     }
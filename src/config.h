@@ -5,6 +5,10 @@ typedef struct {
     char* port;
     char* logfile;
     char* db_filename;
+    // Saves requested within this many milliseconds of the last one are coalesced
+    int save_window_ms;
+    // What imports do with duplicates: skip, overwrite, merge or append
+    char* import_policy;
 } Config;
 
 void config_load(char* filename, Config* config);
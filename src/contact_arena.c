@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <string.h>
+#include "contact_arena.h"
+
+struct ContactArenaBlock {
+    ContactArenaBlock* next;
+    size_t used;
+    char data[];
+};
+
+// Records bigger than CONTACT_ARENA_MAX_SLOT get their own allocation, linked so they can be unlinked in O(1).
+struct ContactArenaLarge {
+    ContactArenaLarge* prev;
+    ContactArenaLarge* next;
+};
+
+struct ContactArenaFree {
+    ContactArenaFree* next;
+};
+
+typedef struct {
+    unsigned int size_class; // 0 for large records
+    unsigned int size;
+} SlotHeader;
+
+#define BLOCK_CAPACITY (CONTACT_ARENA_BLOCK_SIZE - sizeof(ContactArenaBlock))
+
+static size_t round_up(size_t n) {
+    return (n + CONTACT_ARENA_GRANULE - 1) & ~(size_t)(CONTACT_ARENA_GRANULE - 1);
+}
+
+static SlotHeader* slot_of(Contact* contact) {
+    return (SlotHeader*)((char*)contact - sizeof(SlotHeader));
+}
+
+void contact_arena_init(ContactArena* arena) {
+    memset(arena, 0, sizeof(ContactArena));
+}
+
+void contact_arena_destroy(ContactArena* arena) {
+    ContactArenaBlock* block = arena->blocks;
+    while (block) {
+        ContactArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    ContactArenaLarge* large = arena->large;
+    while (large) {
+        ContactArenaLarge* next = large->next;
+        free(large);
+        large = next;
+    }
+    memset(arena, 0, sizeof(ContactArena));
+}
+
+static SlotHeader* arena_alloc_slot(ContactArena* arena, size_t size) {
+    size_t size_class = size / CONTACT_ARENA_GRANULE;
+
+    if (size > CONTACT_ARENA_MAX_SLOT) {
+        ContactArenaLarge* large = malloc(sizeof(ContactArenaLarge) + size);
+        large->prev = NULL;
+        large->next = arena->large;
+        if (arena->large) {
+            arena->large->prev = large;
+        }
+        arena->large = large;
+        arena->bytes_reserved += size;
+        SlotHeader* slot = (SlotHeader*)(large + 1);
+        slot->size_class = 0;
+        slot->size = size;
+        return slot;
+    }
+
+    ContactArenaFree* reused = arena->free_lists[size_class];
+    if (reused) {
+        arena->free_lists[size_class] = reused->next;
+        SlotHeader* slot = (SlotHeader*)reused;
+        slot->size_class = size_class;
+        slot->size = size;
+        return slot;
+    }
+
+    if (arena->blocks == NULL || arena->blocks->used + size > BLOCK_CAPACITY) {
+        ContactArenaBlock* block = malloc(CONTACT_ARENA_BLOCK_SIZE);
+        block->next = arena->blocks;
+        block->used = 0;
+        arena->blocks = block;
+        arena->bytes_reserved += CONTACT_ARENA_BLOCK_SIZE;
+    }
+    SlotHeader* slot = (SlotHeader*)(arena->blocks->data + arena->blocks->used);
+    arena->blocks->used += size;
+    slot->size_class = size_class;
+    slot->size = size;
+    return slot;
+}
+
+Contact* contact_arena_alloc(ContactArena* arena, const Contact* fields) {
+    size_t lengths[CONTACT_FIELD_COUNT];
+    size_t size = sizeof(SlotHeader) + sizeof(Contact);
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        lengths[f] = fields->fields[f][0] ? strlen(fields->fields[f]) + 1 : 0;
+        size += lengths[f];
+    }
+
+    SlotHeader* slot = arena_alloc_slot(arena, round_up(size));
+    Contact* contact = (Contact*)(slot + 1);
+    char* strings = (char*)(contact + 1);
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        contact->fields[f] = lengths[f] ? memcpy(strings, fields->fields[f], lengths[f]) : "";
+        strings += lengths[f];
+    }
+    arena->bytes_live += slot->size;
+    return contact;
+}
+
+Contact* contact_arena_alloc_ref(ContactArena* arena, const Contact* fields) {
+    SlotHeader* slot = arena_alloc_slot(arena, round_up(sizeof(SlotHeader) + sizeof(Contact)));
+    Contact* contact = (Contact*)(slot + 1);
+    *contact = *fields;
+    arena->bytes_live += slot->size;
+    return contact;
+}
+
+void contact_arena_free(ContactArena* arena, Contact* contact) {
+    SlotHeader* slot = slot_of(contact);
+    arena->bytes_live -= slot->size;
+
+    if (slot->size_class == 0) {
+        ContactArenaLarge* large = (ContactArenaLarge*)slot - 1;
+        if (large->prev) {
+            large->prev->next = large->next;
+        } else {
+            arena->large = large->next;
+        }
+        if (large->next) {
+            large->next->prev = large->prev;
+        }
+        arena->bytes_reserved -= slot->size;
+        free(large);
+        return;
+    }
+
+    ContactArenaFree* freed = (ContactArenaFree*)slot;
+    freed->next = arena->free_lists[slot->size_class];
+    arena->free_lists[slot->size_class] = freed;
+}
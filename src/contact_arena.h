@@ -0,0 +1,37 @@
+#ifndef CONTACT_ARENA_H
+#define CONTACT_ARENA_H
+
+#include <stddef.h>
+#include "contact_schema.h"
+
+// Slab allocator for Contact records. Each record is packed together with its
+// field bytes into one slot carved out of a large block. Freed
+// slots go onto per-size-class free lists and are reused by later
+// allocations; destroying the arena releases every block at once.
+
+#define CONTACT_ARENA_BLOCK_SIZE (1024 * 1024)
+#define CONTACT_ARENA_GRANULE 16
+#define CONTACT_ARENA_MAX_SLOT 4096
+#define CONTACT_ARENA_CLASSES (CONTACT_ARENA_MAX_SLOT / CONTACT_ARENA_GRANULE + 1)
+
+typedef struct ContactArenaBlock ContactArenaBlock;
+typedef struct ContactArenaLarge ContactArenaLarge;
+typedef struct ContactArenaFree ContactArenaFree;
+
+typedef struct {
+    ContactArenaBlock* blocks;
+    ContactArenaLarge* large;
+    ContactArenaFree* free_lists[CONTACT_ARENA_CLASSES];
+    size_t bytes_reserved;
+    size_t bytes_live;
+} ContactArena;
+
+void contact_arena_init(ContactArena* arena);
+void contact_arena_destroy(ContactArena* arena);
+// Copies the fields; empty ones share one static "" instead.
+Contact* contact_arena_alloc(ContactArena* arena, const Contact* fields);
+// Allocates a record whose fields point at caller-owned strings (e.g. a mapped file) instead of copies
+Contact* contact_arena_alloc_ref(ContactArena* arena, const Contact* fields);
+void contact_arena_free(ContactArena* arena, Contact* contact);
+
+#endif
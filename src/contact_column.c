@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include "contact_column.h"
+#include "text_search.h"
+
+// Repacking a small heap saves too little to be worth a pass
+#define CONTACT_COLUMN_MIN_REPACK 65536
+
+void contact_column_init(ContactColumn* column) {
+    memset(column, 0, sizeof(ContactColumn));
+}
+
+void contact_column_free(ContactColumn* column) {
+    free(column->heap);
+    free(column->offsets);
+    memset(column, 0, sizeof(ContactColumn));
+}
+
+static void reserve_heap(ContactColumn* column, uint64_t size) {
+    if (size > column->heap_capacity) {
+        uint64_t capacity = column->heap_capacity ? column->heap_capacity : 4096;
+        while (capacity < size) {
+            capacity *= 2;
+        }
+        column->heap = realloc(column->heap, capacity);
+        column->heap_capacity = capacity;
+    }
+    if (column->heap_size == 0) {
+        // The shared empty value
+        column->heap[0] = '\0';
+        column->heap_size = 1;
+    }
+}
+
+static void reserve_offsets(ContactColumn* column, uint32_t count) {
+    if (count > column->capacity) {
+        uint32_t capacity = column->capacity ? column->capacity : 1024;
+        while (capacity < count) {
+            capacity *= 2;
+        }
+        column->offsets = realloc(column->offsets, sizeof(uint64_t) * capacity);
+        column->capacity = capacity;
+    }
+}
+
+void contact_column_reserve(ContactColumn* column, uint32_t count, uint64_t heap_size) {
+    reserve_offsets(column, count);
+    reserve_heap(column, heap_size + 1);
+}
+
+static void drop_value(ContactColumn* column, uint64_t offset) {
+    if (offset != CONTACT_COLUMN_ABSENT && offset != 0) {
+        column->garbage += strlen(column->heap + offset) + 1;
+    }
+}
+
+// Copies the live values into a fresh heap in position order, so a scan reads them front to back.
+static void repack(ContactColumn* column) {
+    uint64_t size = column->heap_size - column->garbage;
+    char* heap = malloc(size);
+    heap[0] = '\0';
+    uint64_t used = 1;
+    for (uint32_t i = 0; i < column->count; i++) {
+        uint64_t offset = column->offsets[i];
+        if (offset != CONTACT_COLUMN_ABSENT && offset != 0) {
+            size_t len = strlen(column->heap + offset) + 1;
+            memcpy(heap + used, column->heap + offset, len);
+            column->offsets[i] = used;
+            used += len;
+        }
+    }
+    free(column->heap);
+    column->heap = heap;
+    column->heap_size = used;
+    column->heap_capacity = size;
+    column->garbage = 0;
+}
+
+static void maybe_repack(ContactColumn* column) {
+    if (column->garbage >= CONTACT_COLUMN_MIN_REPACK && column->garbage * 2 > column->heap_size) {
+        repack(column);
+    }
+}
+
+// Drops absent values from the end
+static void trim(ContactColumn* column) {
+    while (column->count > 0 && column->offsets[column->count - 1] == CONTACT_COLUMN_ABSENT) {
+        column->count--;
+    }
+}
+
+void contact_column_set(ContactColumn* column, uint32_t index, const char* value) {
+    if (index >= column->count) {
+        reserve_offsets(column, index + 1);
+        for (uint32_t i = column->count; i < index; i++) {
+            column->offsets[i] = CONTACT_COLUMN_ABSENT;
+        }
+        column->offsets[index] = CONTACT_COLUMN_ABSENT;
+        column->count = index + 1;
+    }
+    drop_value(column, column->offsets[index]);
+    size_t len = strlen(value);
+    if (len == 0) {
+        reserve_heap(column, 1);
+        column->offsets[index] = 0;
+    } else {
+        // value may point into the heap, which can move
+        uint64_t inside = value >= column->heap && value < column->heap + column->heap_size ? value - column->heap : 0;
+        reserve_heap(column, column->heap_size + len + 1);
+        if (inside) {
+            value = column->heap + inside;
+        }
+        memcpy(column->heap + column->heap_size, value, len + 1);
+        column->offsets[index] = column->heap_size;
+        column->heap_size += len + 1;
+    }
+    maybe_repack(column);
+}
+
+void contact_column_clear(ContactColumn* column, uint32_t index) {
+    if (index >= column->count) {
+        return;
+    }
+    drop_value(column, column->offsets[index]);
+    column->offsets[index] = CONTACT_COLUMN_ABSENT;
+    trim(column);
+    maybe_repack(column);
+}
+
+void contact_column_move(ContactColumn* column, uint32_t from, uint32_t to) {
+    if (from >= column->count || from == to) {
+        return;
+    }
+    uint64_t offset = column->offsets[from];
+    column->offsets[from] = CONTACT_COLUMN_ABSENT;
+    if (to >= column->count) {
+        reserve_offsets(column, to + 1);
+        for (uint32_t i = column->count; i <= to; i++) {
+            column->offsets[i] = CONTACT_COLUMN_ABSENT;
+        }
+        column->count = to + 1;
+    }
+    drop_value(column, column->offsets[to]);
+    column->offsets[to] = offset;
+    trim(column);
+    maybe_repack(column);
+}
+
+const char* contact_column_get(const ContactColumn* column, uint32_t index) {
+    if (index >= column->count || column->offsets[index] == CONTACT_COLUMN_ABSENT) {
+        return NULL;
+    }
+    return column->heap + column->offsets[index];
+}
+
+// Whether the non-empty values of positions [begin, end) lie in the heap in
+// position order, as after a build or a repack, so that part of the heap can
+// be scanned as one run.
+static int heap_in_order(const ContactColumn* column, uint32_t begin, uint32_t end) {
+    uint64_t last = 0;
+    for (uint32_t i = begin; i < end; i++) {
+        uint64_t offset = column->offsets[i];
+        if (offset != CONTACT_COLUMN_ABSENT && offset != 0) {
+            if (offset <= last) {
+                return 0;
+            }
+            last = offset;
+        }
+    }
+    return 1;
+}
+
+// Searches the values of positions [from, end) one by one, appending matches to ids.
+static uint32_t search_each(const ContactColumn* column, uint32_t from, uint32_t end, const char* needle, size_t len,
+                            uint32_t* ids, uint32_t n) {
+    const char* limit = column->heap + column->heap_size;
+    for (uint32_t i = from; i < end; i++) {
+        uint64_t offset = column->offsets[i];
+        if (offset != CONTACT_COLUMN_ABSENT && text_search_find(column->heap + offset, limit, needle, len)) {
+            ids[n++] = i;
+        }
+    }
+    return n;
+}
+
+// Scanned in batches of this many hits
+#define CONTACT_COLUMN_SEARCH_HITS 1024
+
+// Finds the first occurrence of needle in each string of the heap from the
+// first value of [begin, end) to the end of the last, values and garbage
+// alike, and walks the offsets along with the hits: the value starting last
+// before a hit contains it if no NUL lies in between. Over the whole column
+// without garbage there never is one; a part of the heap may also hold
+// values of other positions. Once a batch shows most values matching,
+// skipping from hit to hit gains nothing over checking each value, which is
+// cheaper per value, so the rest is left to search_each.
+static uint32_t search_heap(const ContactColumn* column, uint32_t begin, uint32_t end, const char* needle, size_t len,
+                            uint32_t* ids) {
+    uint32_t first = begin, last = end;
+    while (first < end && (column->offsets[first] == CONTACT_COLUMN_ABSENT || column->offsets[first] == 0)) {
+        first++;
+    }
+    while (last > first && (column->offsets[last - 1] == CONTACT_COLUMN_ABSENT || column->offsets[last - 1] == 0)) {
+        last--;
+    }
+    if (first == last) {
+        return 0;
+    }
+    const char* p = column->heap + column->offsets[first];
+    const char* last_value = column->heap + column->offsets[last - 1];
+    const char* limit = last_value + strlen(last_value) + 1;
+    int check_nul = column->garbage != 0 || begin != 0 || end != column->count;
+
+    const char* hits[CONTACT_COLUMN_SEARCH_HITS];
+    uint32_t n = 0;
+    uint32_t i = first;
+    while (p < limit) {
+        uint32_t batch_start = i;
+        size_t hit_count = text_search_find_each(p, limit, needle, len, hits, CONTACT_COLUMN_SEARCH_HITS, &p);
+        for (size_t h = 0; h < hit_count; h++) {
+            uint64_t at = hits[h] - column->heap;
+            uint32_t candidate = UINT32_MAX;
+            for (; i < last; i++) {
+                uint64_t offset = column->offsets[i];
+                if (offset != CONTACT_COLUMN_ABSENT && offset != 0) {
+                    if (offset > at) {
+                        break;
+                    }
+                    candidate = i;
+                }
+            }
+            if (candidate == UINT32_MAX) {
+                continue;
+            }
+            const char* value = column->heap + column->offsets[candidate];
+            if (!check_nul || memchr(value, '\0', hits[h] - value) == NULL) {
+                ids[n++] = candidate;
+            }
+        }
+        if (hit_count == CONTACT_COLUMN_SEARCH_HITS && i - batch_start < 2 * hit_count) {
+            // The values up to i are done, and p is past any hit in them
+            return search_each(column, i, last, needle, len, ids, n);
+        }
+    }
+    return n;
+}
+
+uint32_t contact_column_search(const ContactColumn* column, const char* needle, size_t len, uint32_t* ids) {
+    return contact_column_search_range(column, 0, column->count, needle, len, ids);
+}
+
+uint32_t contact_column_search_range(const ContactColumn* column, uint32_t begin, uint32_t end, const char* needle,
+                                     size_t len, uint32_t* ids) {
+    if (end > column->count) {
+        end = column->count;
+    }
+    if (begin >= end) {
+        return 0;
+    }
+    if (len == 0 || !heap_in_order(column, begin, end)) {
+        return search_each(column, begin, end, needle, len, ids, 0);
+    }
+    return search_heap(column, begin, end, needle, len, ids);
+}
@@ -0,0 +1,52 @@
+#ifndef CONTACT_COLUMN_H
+#define CONTACT_COLUMN_H
+
+#include <stdint.h>
+
+// One string per position, stored column-wise: the bytes of every value in a
+// single heap and a parallel array of offsets into it. A scan over one field
+// reads two contiguous arrays instead of following a pointer per record.
+//
+// Empty values all share one NUL at the start of the heap. Changing or
+// clearing a value leaves its old bytes behind as garbage, which is reclaimed
+// by repacking the heap once it makes up half of it. Values returned by
+// contact_column_get are therefore only valid until the column next changes.
+
+typedef struct {
+    char* heap;
+    uint64_t heap_size;
+    uint64_t heap_capacity;
+    // Bytes of the heap no value refers to any more
+    uint64_t garbage;
+    // CONTACT_COLUMN_ABSENT for positions without a value
+    uint64_t* offsets;
+    uint32_t count;
+    uint32_t capacity;
+} ContactColumn;
+
+#define CONTACT_COLUMN_ABSENT UINT64_MAX
+
+void contact_column_init(ContactColumn* column);
+void contact_column_free(ContactColumn* column);
+// Makes room for count values totalling heap_size bytes, e.g. ahead of a build.
+void contact_column_reserve(ContactColumn* column, uint32_t count, uint64_t heap_size);
+// Stores a copy of value at index, extending the column with absent values if index is past its end.
+void contact_column_set(ContactColumn* column, uint32_t index, const char* value);
+// Makes index absent. Absent values at the end are dropped from the count.
+void contact_column_clear(ContactColumn* column, uint32_t index);
+// Moves the value at from to position to, dropping to's old value; from becomes absent.
+void contact_column_move(ContactColumn* column, uint32_t from, uint32_t to);
+
+// NULL if index is absent or past the end.
+const char* contact_column_get(const ContactColumn* column, uint32_t index);
+// Writes the positions of the values containing needle (len bytes, no NUL)
+// to ids, which has room for count, in ascending order; returns how many.
+// While the heap holds the values in position order, it is scanned in one run.
+uint32_t contact_column_search(const ContactColumn* column, const char* needle, size_t len, uint32_t* ids);
+// contact_column_search over positions [begin, end) only, e.g. one chunk of a
+// parallel scan; ids needs room for end - begin. Only the part of the heap
+// holding those values is read.
+uint32_t contact_column_search_range(const ContactColumn* column, uint32_t begin, uint32_t end, const char* needle,
+                                     size_t len, uint32_t* ids);
+
+#endif
@@ -0,0 +1,199 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "contact_dedup.h"
+#include "text_fold.h"
+
+#define CONTACT_DEDUP_BLOCK_SIZE (64 * 1024)
+
+struct ContactDedupBlock {
+    ContactDedupBlock* next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+typedef size_t (*ContactDedupNormalizeFunc)(const char* text, char* out);
+
+static size_t normalize_email(const char* email, char* out) {
+    size_t n = 0;
+    for (; email[n]; n++) {
+        char c = email[n];
+        out[n] = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+static size_t normalize_phone(const char* phone, char* out) {
+    size_t n = 0;
+    for (const char* p = phone; *p; p++) {
+        if (*p >= '0' && *p <= '9') {
+            out[n++] = *p;
+        }
+    }
+    if (n > 2 && out[0] == '0' && out[1] == '0') {
+        memmove(out, out + 2, n - 2);
+        n -= 2;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+// None of the normalizations makes a value longer
+static const struct {
+    ContactField field;
+    ContactDedupNormalizeFunc normalize;
+} contact_dedup_fields[CONTACT_DEDUP_KEYS] = {
+    {CONTACT_FIELD_NAME, text_fold},
+    {CONTACT_FIELD_EMAIL, normalize_email},
+    {CONTACT_FIELD_PHONE, normalize_phone},
+};
+
+// Steps through the values of a field: the whole text, or each of several
+// joined values. Returns NULL after the last one.
+static const char* next_value(const char** cursor, size_t* len, int key) {
+    const char* value = *cursor;
+    if (value == NULL) {
+        return NULL;
+    }
+    const char* end = NULL;
+    if (contact_fields[contact_dedup_fields[key].field].flags & CONTACT_FIELD_MULTIPLE) {
+        end = strchr(value, CONTACT_VALUE_SEPARATOR);
+    }
+    *len = end ? (size_t)(end - value) : strlen(value);
+    *cursor = end ? end + 1 : NULL;
+    return value;
+}
+
+static char* contact_dedup_scratch(ContactDedup* dedup, int which, size_t size) {
+    if (size > dedup->scratch_size[which]) {
+        dedup->scratch_size[which] = size * 2;
+        dedup->scratch[which] = realloc(dedup->scratch[which], dedup->scratch_size[which]);
+    }
+    return dedup->scratch[which];
+}
+
+// Normalizes one value for key into scratch buffer which; returns NULL for an empty key
+static const char* contact_dedup_normalize(ContactDedup* dedup, int which, const char* value, size_t len, int key) {
+    // The value is copied out first, since it is not terminated where several are joined
+    char* text = contact_dedup_scratch(dedup, which, 2 * (len + 1));
+    memcpy(text, value, len);
+    text[len] = '\0';
+    char* out = text + len + 1;
+    return contact_dedup_fields[key].normalize(text, out) > 0 ? out : NULL;
+}
+
+static const char* contact_dedup_store(ContactDedup* dedup, const char* key) {
+    size_t size = strlen(key) + 1;
+    ContactDedupBlock* block = dedup->blocks;
+    if (block == NULL || block->size - block->used < size) {
+        size_t block_size = size > CONTACT_DEDUP_BLOCK_SIZE ? size : CONTACT_DEDUP_BLOCK_SIZE;
+        block = malloc(sizeof(ContactDedupBlock) + block_size);
+        block->next = dedup->blocks;
+        block->used = 0;
+        block->size = block_size;
+        dedup->blocks = block;
+    }
+    char* copy = block->data + block->used;
+    memcpy(copy, key, size);
+    block->used += size;
+    return copy;
+}
+
+void contact_dedup_init(ContactDedup* dedup, int count) {
+    for (int key = 0; key < CONTACT_DEDUP_KEYS; key++) {
+        hash_index_init(&dedup->keys[key]);
+        hash_index_reserve(&dedup->keys[key], count);
+    }
+    dedup->blocks = NULL;
+    for (int i = 0; i < 2; i++) {
+        dedup->scratch[i] = NULL;
+        dedup->scratch_size[i] = 0;
+    }
+}
+
+void contact_dedup_free(ContactDedup* dedup) {
+    for (int key = 0; key < CONTACT_DEDUP_KEYS; key++) {
+        hash_index_free(&dedup->keys[key]);
+    }
+    while (dedup->blocks) {
+        ContactDedupBlock* next = dedup->blocks->next;
+        free(dedup->blocks);
+        dedup->blocks = next;
+    }
+    for (int i = 0; i < 2; i++) {
+        free(dedup->scratch[i]);
+    }
+}
+
+static void contact_dedup_add_values(ContactDedup* dedup, int key, const char* field, int position) {
+    const char* cursor = field;
+    const char* value;
+    size_t len;
+    while ((value = next_value(&cursor, &len, key)) != NULL) {
+        const char* normalized = contact_dedup_normalize(dedup, 0, value, len, key);
+        if (normalized) {
+            hash_index_insert(&dedup->keys[key], contact_dedup_store(dedup, normalized), position);
+        }
+    }
+}
+
+void contact_dedup_add(ContactDedup* dedup, const Contact* contact, int position) {
+    for (int key = 0; key < CONTACT_DEDUP_KEYS; key++) {
+        contact_dedup_add_values(dedup, key, contact->fields[contact_dedup_fields[key].field], position);
+    }
+}
+
+void contact_dedup_add_column(ContactDedup* dedup, ContactField field, const ContactColumn* column) {
+    for (int key = 0; key < CONTACT_DEDUP_KEYS; key++) {
+        if (contact_dedup_fields[key].field != field) {
+            continue;
+        }
+        for (uint32_t i = 0; i < column->count; i++) {
+            const char* value = contact_column_get(column, i);
+            if (value && value[0]) {
+                contact_dedup_add_values(dedup, key, value, i);
+            }
+        }
+    }
+}
+
+// Whether any value of field normalizes to normalized
+static int contact_dedup_has_value(ContactDedup* dedup, int key, const char* field, const char* normalized) {
+    const char* cursor = field;
+    const char* value;
+    size_t len;
+    while ((value = next_value(&cursor, &len, key)) != NULL) {
+        const char* current = contact_dedup_normalize(dedup, 1, value, len, key);
+        if (current && strcmp(current, normalized) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int contact_dedup_find(ContactDedup* dedup, Contact* const* contacts, const Contact* contact) {
+    for (int key = 0; key < CONTACT_DEDUP_KEYS; key++) {
+        ContactField field = contact_dedup_fields[key].field;
+        const char* cursor = contact->fields[field];
+        const char* value;
+        size_t len;
+        while ((value = next_value(&cursor, &len, key)) != NULL) {
+            const char* normalized = contact_dedup_normalize(dedup, 0, value, len, key);
+            if (normalized == NULL) {
+                continue;
+            }
+            HashIndex* index = &dedup->keys[key];
+            HashIndexIter iter;
+            for (int i = hash_index_first(index, normalized, &iter); i != -1;
+                 i = hash_index_next(index, normalized, &iter)) {
+                // The entry may predate a change to the contact at i
+                if (contact_dedup_has_value(dedup, key, contacts[i]->fields[field], normalized)) {
+                    return i;
+                }
+            }
+        }
+    }
+    return -1;
+}
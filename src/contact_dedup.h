@@ -0,0 +1,45 @@
+#ifndef CONTACT_DEDUP_H
+#define CONTACT_DEDUP_H
+
+#include <stddef.h>
+#include "contact_arena.h"
+#include "contact_column.h"
+#include "hash_index.h"
+
+// Finds the contact an incoming one duplicates. Contacts are keyed three ways:
+// by name folded for case and accents (text_fold), by phone number reduced to
+// its digits, and by lowercased email. Empty fields are not keyed. Each key
+// maps to a position in the caller's contact array, and lookups check the
+// contact now at that position, so a contact whose fields changed only needs
+// its new keys added.
+//
+// Phone numbers are compared as E.164 digit strings: punctuation and spaces go,
+// and a leading 00 international prefix is treated like a leading +. A phone
+// or email field holding several values is keyed by each of them.
+
+typedef struct ContactDedupBlock ContactDedupBlock;
+
+#define CONTACT_DEDUP_KEYS 3
+
+typedef struct {
+    // By name, email and phone, in lookup order
+    HashIndex keys[CONTACT_DEDUP_KEYS];
+    // The normalized keys, which the indexes borrow
+    ContactDedupBlock* blocks;
+    // Normalized fields of the contact being looked up, and of a candidate
+    char* scratch[2];
+    size_t scratch_size[2];
+} ContactDedup;
+
+void contact_dedup_init(ContactDedup* dedup, int count);
+void contact_dedup_free(ContactDedup* dedup);
+void contact_dedup_add(ContactDedup* dedup, const Contact* contact, int position);
+// Keys every value of one field at its position in the column, for a field
+// contact_dedup uses; other fields are ignored. Keying an existing set of
+// contacts field by field walks each column once instead of every record.
+void contact_dedup_add_column(ContactDedup* dedup, ContactField field, const ContactColumn* column);
+// Returns the position of a contact sharing the name, else the email, else the
+// phone number of contact, or -1.
+int contact_dedup_find(ContactDedup* dedup, Contact* const* contacts, const Contact* contact);
+
+#endif
@@ -0,0 +1,531 @@
+#define _GNU_SOURCE
+#include "contact_list_model.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Insertions larger than this are sorted on their own and merged in, with a
+// single items-changed for the whole list, instead of one at a time
+#define CONTACT_LIST_MODEL_MERGE_MIN 16
+
+typedef struct {
+    char* data;
+    gsize length;
+} SortKey;
+
+struct _ContactListModel {
+    GObject parent_instance;
+    Database* db;
+    ContactField field;
+    gboolean descending;
+    // Collation keys by database position, per field; NULL until the list is first sorted by that field
+    SortKey* sort_keys[CONTACT_FIELD_COUNT];
+    guint keys_capacity;
+    // Every database position, in ascending order
+    guint* order;
+    guint n_order;
+    guint order_capacity;
+    // While searching: the matching positions, and the subsequence of order they make up
+    char* search_text;
+    GtkBitset* matches;
+    guint* rows;
+    guint n_rows;
+    guint rows_capacity;
+    // While narrowing: rows [gap_start, gap_start + gap) were dropped and are not part of the list
+    guint gap_start;
+    guint gap;
+    // Set when nothing matched the search exactly and rows holds the closest fuzzy matches, best first
+    gboolean ranked;
+    // ContactObjects handed out and still alive, by database position
+    GHashTable* objects;
+};
+
+static void contact_list_model_list_model_init(GListModelInterface* iface);
+
+G_DEFINE_TYPE_WITH_CODE(ContactListModel, contact_list_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_LIST_MODEL, contact_list_model_list_model_init))
+
+static void sort_key_set(SortKey* key, const char* value) {
+    key->data = g_utf8_collate_key(value, -1);
+    key->length = strlen(key->data);
+}
+
+static int compare_positions(const SortKey* keys, guint a, guint b) {
+    int cmp = memcmp(keys[a].data, keys[b].data, MIN(keys[a].length, keys[b].length));
+    if (cmp == 0) {
+        cmp = (keys[a].length > keys[b].length) - (keys[a].length < keys[b].length);
+    }
+    if (cmp == 0) {
+        cmp = (a > b) - (a < b);
+    }
+    return cmp;
+}
+
+static int compare_positions_qsort(const void* a, const void* b, void* keys) {
+    return compare_positions(keys, *(const guint*)a, *(const guint*)b);
+}
+
+// Index of the first entry of a sorted array not below position
+static guint lower_bound(const guint* array, guint n, const SortKey* keys, guint position) {
+    guint low = 0, high = n;
+    while (low < high) {
+        guint mid = low + (high - low) / 2;
+        if (compare_positions(keys, array[mid], position) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Merges k sorted positions into a sorted array with room for them, from the back
+static void merge_into(guint* array, guint n, const guint* added, guint k, const SortKey* keys) {
+    guint i = n, j = k, out = n + k;
+    while (j > 0) {
+        if (i > 0 && compare_positions(keys, array[i - 1], added[j - 1]) > 0) {
+            array[--out] = array[--i];
+        } else {
+            array[--out] = added[--j];
+        }
+    }
+}
+
+static void array_reserve(guint** array, guint* capacity, guint count) {
+    if (count > *capacity) {
+        *capacity = MAX(count, *capacity * 2);
+        *array = g_renew(guint, *array, *capacity);
+    }
+}
+
+static void array_insert(guint* array, guint* n, guint index, guint value) {
+    memmove(array + index + 1, array + index, sizeof(guint) * (*n - index));
+    array[index] = value;
+    (*n)++;
+}
+
+static void array_remove(guint* array, guint* n, guint index) {
+    (*n)--;
+    memmove(array + index, array + index + 1, sizeof(guint) * (*n - index));
+}
+
+static const guint* shown_rows(ContactListModel* self, guint* n) {
+    *n = self->matches ? self->n_rows : self->n_order;
+    return self->matches ? self->rows : self->order;
+}
+
+// Model position of a row of the ascending array, in a list of n
+static guint model_position(ContactListModel* self, guint row, guint n) {
+    return self->descending && !self->ranked ? n - 1 - row : row;
+}
+
+// --- Cached objects ---
+
+static gboolean is_object(gpointer key, gpointer value, gpointer object) {
+    return value == object;
+}
+
+static void on_object_finalized(gpointer data, GObject* object) {
+    ContactListModel* self = data;
+    g_hash_table_foreach_remove(self->objects, is_object, object);
+}
+
+// Stops handing out the object for a position whose contact changed
+static void forget_object(ContactListModel* self, guint position) {
+    GObject* object = g_hash_table_lookup(self->objects, GUINT_TO_POINTER(position));
+    if (object) {
+        g_object_weak_unref(object, on_object_finalized, self);
+        g_hash_table_remove(self->objects, GUINT_TO_POINTER(position));
+    }
+}
+
+static void forget_all_objects(ContactListModel* self) {
+    GHashTableIter iter;
+    gpointer object;
+    g_hash_table_iter_init(&iter, self->objects);
+    while (g_hash_table_iter_next(&iter, NULL, &object)) {
+        g_object_weak_unref(G_OBJECT(object), on_object_finalized, self);
+        g_hash_table_iter_remove(&iter);
+    }
+}
+
+// --- Keys and order ---
+
+static void reserve_keys(ContactListModel* self, guint count) {
+    if (count <= self->keys_capacity) {
+        return;
+    }
+    self->keys_capacity = MAX(count, self->keys_capacity * 2);
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        if (self->sort_keys[f]) {
+            self->sort_keys[f] = g_renew(SortKey, self->sort_keys[f], self->keys_capacity);
+        }
+    }
+}
+
+static void set_keys(ContactListModel* self, guint position) {
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        if (self->sort_keys[f]) {
+            sort_key_set(&self->sort_keys[f][position], self->db->contacts[position]->fields[f]);
+        }
+    }
+}
+
+static void free_keys(ContactListModel* self, guint position) {
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        if (self->sort_keys[f]) {
+            g_free(self->sort_keys[f][position].data);
+        }
+    }
+}
+
+// Reads the field's column rather than every contact
+static void ensure_field_keys(ContactListModel* self, ContactField field) {
+    if (self->sort_keys[field] == NULL) {
+        const ContactColumn* column = database_column(self->db, field);
+        self->sort_keys[field] = g_new(SortKey, MAX(self->keys_capacity, 1));
+        for (guint i = 0; i < self->n_order; i++) {
+            sort_key_set(&self->sort_keys[field][i], contact_column_get(column, i));
+        }
+    }
+}
+
+// Makes rows the subsequence of order that matches
+static void filter_rows(ContactListModel* self) {
+    EventLogTime start = event_log_start();
+    array_reserve(&self->rows, &self->rows_capacity, self->n_order);
+    guint out = 0;
+    for (guint i = 0; i < self->n_order; i++) {
+        if (gtk_bitset_contains(self->matches, self->order[i])) {
+            self->rows[out++] = self->order[i];
+        }
+    }
+    self->n_rows = out;
+    event_log_end("filter", start, out, 0);
+}
+
+// Drops the rows that no longer match, in place, with one items-changed per
+// run of dropped rows, so the rows that stay keep their widgets, selection
+// and scroll position. The dropped rows so far are left as a gap that
+// get_item skips, so the list is consistent at each signal without moving
+// the rest of the array every time.
+static void narrow_rows(ContactListModel* self) {
+    EventLogTime start = event_log_start();
+    guint n = self->n_rows;
+    guint out = 0;
+    for (guint i = 0; i < n;) {
+        if (gtk_bitset_contains(self->matches, self->rows[i])) {
+            self->rows[out++] = self->rows[i++];
+            continue;
+        }
+        guint k = 1;
+        while (i + k < n && !gtk_bitset_contains(self->matches, self->rows[i + k])) {
+            k++;
+        }
+        i += k;
+        guint shown = self->n_rows;
+        self->gap_start = out;
+        self->gap = i - out;
+        self->n_rows -= k;
+        g_list_model_items_changed(G_LIST_MODEL(self), self->descending ? shown - out - k : out, k, 0);
+    }
+    self->gap = 0;
+    event_log_end("filter", start, out, 0);
+}
+
+// Makes rows the fuzzy matches for the search text, in rank order; FALSE if there are none
+static gboolean rank_rows(ContactListModel* self) {
+    int count;
+    FuzzyMatch* found = database_search_fuzzy(self->db, self->search_text, &count);
+    gtk_bitset_remove_all(self->matches);
+    array_reserve(&self->rows, &self->rows_capacity, count);
+    for (int i = 0; i < count; i++) {
+        gtk_bitset_add(self->matches, found[i].id);
+        self->rows[i] = found[i].id;
+    }
+    self->n_rows = count;
+    free(found);
+    return count > 0;
+}
+
+// --- Following the database ---
+
+// Takes a position out of the list, while its keys still describe the contact it held
+static void unlink_position(ContactListModel* self, guint position) {
+    const SortKey* keys = self->sort_keys[self->field];
+    guint n = self->n_order;
+    guint i = lower_bound(self->order, self->n_order, keys, position);
+    array_remove(self->order, &self->n_order, i);
+    // Ranked rows are worked out again once the change is done
+    if (self->matches == NULL) {
+        g_list_model_items_changed(G_LIST_MODEL(self), model_position(self, i, n), 1, 0);
+    } else if (!self->ranked && gtk_bitset_contains(self->matches, position)) {
+        gtk_bitset_remove(self->matches, position);
+        n = self->n_rows;
+        guint row = lower_bound(self->rows, self->n_rows, keys, position);
+        array_remove(self->rows, &self->n_rows, row);
+        g_list_model_items_changed(G_LIST_MODEL(self), model_position(self, row, n), 1, 0);
+    }
+    free_keys(self, position);
+    forget_object(self, position);
+}
+
+// Adds the contact now at a position to the list
+static void link_position(ContactListModel* self, guint position) {
+    set_keys(self, position);
+    const SortKey* keys = self->sort_keys[self->field];
+    guint i = lower_bound(self->order, self->n_order, keys, position);
+    array_reserve(&self->order, &self->order_capacity, self->n_order + 1);
+    array_insert(self->order, &self->n_order, i, position);
+    if (self->ranked) {
+        return;
+    }
+    if (self->matches == NULL) {
+        g_list_model_items_changed(G_LIST_MODEL(self), model_position(self, i, self->n_order), 0, 1);
+    } else if (database_contact_matches(self->db, position, self->search_text)) {
+        gtk_bitset_add(self->matches, position);
+        guint row = lower_bound(self->rows, self->n_rows, keys, position);
+        array_reserve(&self->rows, &self->rows_capacity, self->n_rows + 1);
+        array_insert(self->rows, &self->n_rows, row, position);
+        g_list_model_items_changed(G_LIST_MODEL(self), model_position(self, row, self->n_rows), 0, 1);
+    }
+}
+
+// Sorts a run of new positions on its own and merges it into order and rows
+static void merge_positions(ContactListModel* self, guint index, guint count) {
+    guint n_shown;
+    shown_rows(self, &n_shown);
+    const SortKey* keys = self->sort_keys[self->field];
+    guint* added = g_new(guint, count);
+    for (guint i = 0; i < count; i++) {
+        set_keys(self, index + i);
+        added[i] = index + i;
+    }
+    qsort_r(added, count, sizeof(guint), compare_positions_qsort, (void*)keys);
+    array_reserve(&self->order, &self->order_capacity, self->n_order + count);
+    merge_into(self->order, self->n_order, added, count, keys);
+    self->n_order += count;
+    if (self->ranked) {
+        g_free(added);
+        return;
+    }
+    if (self->matches) {
+        guint k = 0;
+        for (guint i = 0; i < count; i++) {
+            if (database_contact_matches(self->db, added[i], self->search_text)) {
+                gtk_bitset_add(self->matches, added[i]);
+                added[k++] = added[i];
+            }
+        }
+        array_reserve(&self->rows, &self->rows_capacity, self->n_rows + k);
+        merge_into(self->rows, self->n_rows, added, k, keys);
+        self->n_rows += k;
+    }
+    g_free(added);
+    guint n_after;
+    shown_rows(self, &n_after);
+    g_list_model_items_changed(G_LIST_MODEL(self), 0, n_shown, n_after);
+}
+
+static void on_database_changed(DatabaseChange change, int index, int count, gpointer user_data) {
+    ContactListModel* self = user_data;
+    guint n_before;
+    shown_rows(self, &n_before);
+    switch (change) {
+        case DATABASE_CHANGE_INSERTED:
+            reserve_keys(self, index + count);
+            if (count > CONTACT_LIST_MODEL_MERGE_MIN) {
+                merge_positions(self, index, count);
+            } else {
+                for (int i = index; i < index + count; i++) {
+                    link_position(self, i);
+                }
+            }
+            break;
+        case DATABASE_CHANGE_UPDATED:
+            unlink_position(self, index);
+            link_position(self, index);
+            break;
+        case DATABASE_CHANGE_REMOVED: {
+            // The last position's contact moved into index, or was the one removed
+            guint last = self->n_order - 1;
+            if ((guint)index < last) {
+                unlink_position(self, index);
+            }
+            unlink_position(self, last);
+            if ((guint)index < last) {
+                link_position(self, index);
+            }
+            break;
+        }
+    }
+    // Any change can move a contact up or down the ranking, and removals renumber positions
+    if (self->ranked) {
+        rank_rows(self);
+        g_list_model_items_changed(G_LIST_MODEL(self), 0, n_before, self->n_rows);
+    }
+}
+
+// --- GListModel ---
+
+static GType contact_list_model_get_item_type(GListModel* list) {
+    return CONTACT_TYPE_OBJECT;
+}
+
+static guint contact_list_model_get_n_items(GListModel* list) {
+    guint n;
+    shown_rows(CONTACT_LIST_MODEL(list), &n);
+    return n;
+}
+
+static gpointer contact_list_model_get_item(GListModel* list, guint item) {
+    ContactListModel* self = CONTACT_LIST_MODEL(list);
+    guint n;
+    const guint* rows = shown_rows(self, &n);
+    if (item >= n) {
+        return NULL;
+    }
+    guint row = model_position(self, item, n);
+    if (self->matches && row >= self->gap_start) {
+        row += self->gap;
+    }
+    guint position = rows[row];
+    ContactObject* object = g_hash_table_lookup(self->objects, GUINT_TO_POINTER(position));
+    if (object) {
+        return g_object_ref(object);
+    }
+    object = contact_object_new(self->db->contacts[position]);
+    g_object_weak_ref(G_OBJECT(object), on_object_finalized, self);
+    g_hash_table_insert(self->objects, GUINT_TO_POINTER(position), object);
+    return object;
+}
+
+static void contact_list_model_list_model_init(GListModelInterface* iface) {
+    iface->get_item_type = contact_list_model_get_item_type;
+    iface->get_n_items = contact_list_model_get_n_items;
+    iface->get_item = contact_list_model_get_item;
+}
+
+// --- Object ---
+
+static void contact_list_model_finalize(GObject* gobject) {
+    ContactListModel* self = CONTACT_LIST_MODEL(gobject);
+    database_set_change_func(self->db, NULL, NULL);
+    forget_all_objects(self);
+    g_hash_table_unref(self->objects);
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        if (self->sort_keys[f]) {
+            for (guint i = 0; i < self->n_order; i++) {
+                g_free(self->sort_keys[f][i].data);
+            }
+            g_free(self->sort_keys[f]);
+        }
+    }
+    g_free(self->order);
+    g_free(self->rows);
+    g_free(self->search_text);
+    g_clear_pointer(&self->matches, gtk_bitset_unref);
+    G_OBJECT_CLASS(contact_list_model_parent_class)->finalize(gobject);
+}
+
+static void contact_list_model_class_init(ContactListModelClass* klass) {
+    GObjectClass* gobject_class = G_OBJECT_CLASS(klass);
+    gobject_class->finalize = contact_list_model_finalize;
+}
+
+static void contact_list_model_init(ContactListModel* self) {
+    self->objects = g_hash_table_new(g_direct_hash, g_direct_equal);
+}
+
+ContactListModel* contact_list_model_new(Database* db) {
+    ContactListModel* self = g_object_new(CONTACT_TYPE_LIST_MODEL, NULL);
+    self->db = db;
+    self->field = CONTACT_FIELD_NAME;
+    int count;
+    database_list_contacts(db, &count);
+    self->n_order = count;
+    array_reserve(&self->order, &self->order_capacity, MAX(count, 1));
+    for (int i = 0; i < count; i++) {
+        self->order[i] = i;
+    }
+    reserve_keys(self, MAX(count, 1));
+    ensure_field_keys(self, self->field);
+    qsort_r(self->order, self->n_order, sizeof(guint), compare_positions_qsort, self->sort_keys[self->field]);
+    database_set_change_func(db, on_database_changed, self);
+    return self;
+}
+
+void contact_list_model_set_sort_order(ContactListModel* self, ContactSortOrder order) {
+    ContactField field = (ContactField)(order / 2);
+    gboolean descending = order % 2;
+    if (field == self->field && descending == self->descending) {
+        return;
+    }
+    if (field != self->field) {
+        self->field = field;
+        ensure_field_keys(self, field);
+        EventLogTime start = event_log_start();
+        qsort_r(self->order, self->n_order, sizeof(guint), compare_positions_qsort, self->sort_keys[field]);
+        event_log_end("sort", start, self->n_order, 0);
+        if (self->matches && !self->ranked) {
+            filter_rows(self);
+        }
+    }
+    self->descending = descending;
+    // Fuzzy matches stay in rank order whatever the sort order
+    if (self->ranked) {
+        return;
+    }
+    guint n;
+    shown_rows(self, &n);
+    g_list_model_items_changed(G_LIST_MODEL(self), 0, n, n);
+}
+
+void contact_list_model_set_search(ContactListModel* self, const char* text) {
+    guint n_before;
+    shown_rows(self, &n_before);
+    gboolean was_active = self->matches != NULL;
+    gboolean was_ranked = self->ranked;
+    if (text == NULL || *text == '\0') {
+        if (!was_active) {
+            return;
+        }
+        g_clear_pointer(&self->search_text, g_free);
+        g_clear_pointer(&self->matches, gtk_bitset_unref);
+        self->ranked = FALSE;
+        self->n_rows = 0;
+        g_list_model_items_changed(G_LIST_MODEL(self), 0, n_before, self->n_order);
+        return;
+    }
+
+    int count;
+    SearchChange change;
+    int* positions = database_search(self->db, text, &count, &change);
+    g_free(self->search_text);
+    self->search_text = g_strdup(text);
+    if (was_active && change == SEARCH_CHANGE_NONE) {
+        free(positions);
+        return;
+    }
+    g_clear_pointer(&self->matches, gtk_bitset_unref);
+    self->matches = gtk_bitset_new_empty();
+    // Positions come in ascending order, so a dense result adds a few long runs
+    for (int i = 0, run; i < count; i += run) {
+        run = 1;
+        while (i + run < count && positions[i + run] == positions[i] + run) {
+            run++;
+        }
+        gtk_bitset_add_range(self->matches, positions[i], run);
+    }
+    free(positions);
+    // With no exact match, show the contacts the text is closest to instead, say for a misspelled name
+    self->ranked = count == 0 && rank_rows(self);
+    // Narrowing only has to look at the rows shown now; anything else starts from the full order
+    if (!self->ranked && was_active && !was_ranked && change == SEARCH_CHANGE_MORE_STRICT) {
+        narrow_rows(self);
+        return;
+    }
+    if (!self->ranked) {
+        filter_rows(self);
+    }
+    g_list_model_items_changed(G_LIST_MODEL(self), 0, n_before, self->n_rows);
+}
@@ -0,0 +1,43 @@
+#ifndef CONTACT_LIST_MODEL_H
+#define CONTACT_LIST_MODEL_H
+
+#include <gtk/gtk.h>
+#include "contact_object.h"
+#include "database.h"
+
+// A GListModel of ContactObjects read straight from a Database, sorted and
+// filtered by the search text. Objects are created when a row is asked for
+// and dropped once nothing references them, so memory follows the visible
+// rows rather than the number of contacts.
+//
+// The model keeps every database position in ascending order of the current
+// field's collation key (g_utf8_collate_key, compared with memcmp, ties in
+// database order), and the subsequence matching the search. Descending order
+// reads the same arrays backwards. The model follows the database through its
+// change notifications, which it takes over.
+
+#define CONTACT_TYPE_LIST_MODEL (contact_list_model_get_type())
+G_DECLARE_FINAL_TYPE(ContactListModel, contact_list_model, CONTACT, LIST_MODEL, GObject)
+
+// In the order of the sort menu
+typedef enum {
+    CONTACT_SORT_ORDER_NAME_ASC,
+    CONTACT_SORT_ORDER_NAME_DESC,
+    CONTACT_SORT_ORDER_PHONE_ASC,
+    CONTACT_SORT_ORDER_PHONE_DESC,
+    CONTACT_SORT_ORDER_EMAIL_ASC,
+    CONTACT_SORT_ORDER_EMAIL_DESC
+} ContactSortOrder;
+
+ContactListModel* contact_list_model_new(Database* db);
+// Sorting by a field computes its collation keys the first time. Switching
+// only the direction costs nothing beyond telling the view.
+void contact_list_model_set_sort_order(ContactListModel* self, ContactSortOrder order);
+// Shows only the contacts matching text (see database_search); NULL or ""
+// shows everyone. A text that narrows the last one only re-checks the rows
+// shown now. When nothing matches exactly, the list shows the contacts within
+// a few typos of the text instead (see database_search_fuzzy), closest first
+// whatever the sort order.
+void contact_list_model_set_search(ContactListModel* self, const char* text);
+
+#endif // CONTACT_LIST_MODEL_H
@@ -1,12 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 #include "config.h"
 #include "database.h"
+#include "event_log.h"
 
-char* commands[] = {"add", "get", "del", "list", "help", "exit", NULL};
+char* commands[] = {"add", "get", "set", "del", "list", "find", "import", "export", "save", "stats", "help", "exit", NULL};
+// From import_policy in the config; an import command can name another
+static DatabaseImportPolicy import_policy = DATABASE_IMPORT_MERGE;
 
 char* command_generator(const char* text, int state) {
     static int list_index, len;
@@ -26,8 +30,80 @@ char* command_generator(const char* text, int state) {
     return NULL;
 }
 
+// Names listed at most for one Tab; past this many, it only completes as far as they all agree
+#define NAME_COMPLETION_MAX 1000
+
+// Read by the completers; set before the first prompt
+static Database* completion_db;
+
+// Length of the common start of a and b, cut back to a whole UTF-8 character
+static size_t common_prefix(const char* a, const char* b) {
+    size_t len = 0;
+    while (a[len] && a[len] == b[len]) {
+        len++;
+    }
+    while (len > 0 && ((unsigned char)a[len] & 0xc0) == 0x80) {
+        len--;
+    }
+    return len;
+}
+
+char* name_generator(const char* text, int state) {
+    static SortedIndexIter iter;
+    static size_t len;
+    static int done;
+    const SortedIndex* names = database_sorted_names(completion_db);
+
+    if (!state) {
+        len = strlen(text);
+        done = 0;
+        if (sorted_index_count_prefix(names, text, NAME_COMPLETION_MAX + 1, &iter) > NAME_COMPLETION_MAX) {
+            // Too many to list: the first and last in order share what they all share
+            done = 1;
+            const char* first = sorted_index_next(names, &iter);
+            size_t common = common_prefix(first, sorted_index_last_prefix(names, text));
+            if (common > len) {
+                rl_completion_append_character = '\0';
+                return strndup(first, common);
+            }
+            return NULL;
+        }
+    }
+
+    const char* name = done ? NULL : sorted_index_next(names, &iter);
+    if (name && strncmp(name, text, len) == 0) {
+        return strdup(name);
+    }
+    done = 1;
+    return NULL;
+}
+
+// Whether the word at start is the first argument of a command taking a contact name
+static int completes_name(int start) {
+    const char* line = rl_line_buffer;
+    line += strspn(line, " ");
+    size_t command = strcspn(line, " ");
+    const char* argument = line + command + strspn(line + command, " ");
+    if (argument - rl_line_buffer != start) {
+        return 0;
+    }
+    return (command == 3 && (strncmp(line, "get", 3) == 0 || strncmp(line, "del", 3) == 0 ||
+                             strncmp(line, "set", 3) == 0));
+}
+
+// Sorts the names once the first prompt is up, while the user starts typing, rather than on the first Tab
+static int sort_names_for_completion() {
+    database_sorted_names(completion_db);
+    rl_pre_input_hook = NULL;
+    return 0;
+}
+
 char** command_completion(const char* text, int start, int end) {
+    (void)end;
     rl_attempted_completion_over = 1;
+    if (start > 0) {
+        return completes_name(start) ? rl_completion_matches(text, name_generator) : NULL;
+    }
     return rl_completion_matches(text, command_generator);
 }
 
@@ -36,17 +112,78 @@ void print_contact(Contact* contact) {
         printf("  Name:  %s\n", contact->name);
         printf("  Phone: %s\n", contact->phone);
         printf("  Email: %s\n", contact->email);
+        for (int f = CONTACT_BASIC_FIELDS; f < CONTACT_FIELD_COUNT; f++) {
+            if (contact->fields[f][0]) {
+                printf("  %s: %s\n", contact_fields[f].label, contact->fields[f]);
+            }
+        }
+    }
+}
+
+// Listing a large store goes through one buffer and large fwrites instead of a printf per field
+#define LIST_BUFFER_SIZE (1024 * 1024)
+
+typedef struct {
+    char* data;
+    size_t used;
+} ListBuffer;
+
+static void list_put(ListBuffer* buffer, const char* text, size_t length) {
+    if (buffer->used + length > LIST_BUFFER_SIZE) {
+        fwrite(buffer->data, 1, buffer->used, stdout);
+        buffer->used = 0;
+        if (length > LIST_BUFFER_SIZE) {
+            fwrite(text, 1, length, stdout);
+            return;
+        }
     }
+    memcpy(buffer->data + buffer->used, text, length);
+    buffer->used += length;
 }
 
-void handle_command(char* line, Database* db) {
-    if (line == NULL) {
-        return;
+static void list_put_str(ListBuffer* buffer, const char* text) {
+    list_put(buffer, text, strlen(text));
+}
+
+static void list_contacts(Database* db) {
+    int count;
+    Contact** contacts = database_list_contacts(db, &count);
+    ListBuffer buffer = {malloc(LIST_BUFFER_SIZE), 0};
+    char number[32];
+    for (int i = 0; i < count; i++) {
+        list_put(&buffer, number, snprintf(number, sizeof(number), "Contact #%d:\n", i + 1));
+        list_put_str(&buffer, "  Name:  ");
+        list_put_str(&buffer, contacts[i]->name);
+        list_put_str(&buffer, "\n  Phone: ");
+        list_put_str(&buffer, contacts[i]->phone);
+        list_put_str(&buffer, "\n  Email: ");
+        list_put_str(&buffer, contacts[i]->email);
+        for (int f = CONTACT_BASIC_FIELDS; f < CONTACT_FIELD_COUNT; f++) {
+            if (contacts[i]->fields[f][0]) {
+                list_put_str(&buffer, "\n  ");
+                list_put_str(&buffer, contact_fields[f].label);
+                list_put_str(&buffer, ": ");
+                list_put_str(&buffer, contacts[i]->fields[f]);
+            }
+        }
+        list_put_str(&buffer, "\n\n");
+    }
+    if (count == 0) {
+        list_put_str(&buffer, "No contacts found.\n");
     }
-    add_history(line);
+    fwrite(buffer.data, 1, buffer.used, stdout);
+    free(buffer.data);
+}
+
+static int is_mutation(const char* line) {
+    return strncmp(line, "add ", 4) == 0 || strncmp(line, "set ", 4) == 0 || strncmp(line, "del ", 4) == 0;
+}
+
+// Returns 0 once the command asks to exit.
+int handle_command(char* line, Database* db) {
     char* command = strtok(line, " \n");
     if (command == NULL) {
-        return;
+        return 1;
     }
 
     if (strcmp(command, "add") == 0) {
@@ -54,11 +191,7 @@ void handle_command(char* line, Database* db) {
         char* phone = strtok(NULL, " \n");
         char* email = strtok(NULL, " \n");
         if (name && phone && email) {
-            Contact* contact = malloc(sizeof(Contact));
-            contact->name = strdup(name);
-            contact->phone = strdup(phone);
-            contact->email = strdup(email);
-            database_add_contact(db, contact);
+            database_add_contact(db, name, phone, email);
             printf("Contact added.\n");
         } else {
             printf("Usage: add <name> <phone> <email>\n");
@@ -75,6 +208,28 @@ void handle_command(char* line, Database* db) {
         } else {
             printf("Usage: get <name>\n");
         }
+    } else if (strcmp(command, "set") == 0) {
+        char* name = strtok(NULL, " \n");
+        char* field_name = strtok(NULL, " \n");
+        // The value is the rest of the line, so it may contain spaces; without one the field is cleared
+        char* value = strtok(NULL, "\n");
+        ContactField field;
+        if (name == NULL || field_name == NULL || !contact_field_parse(field_name, &field)) {
+            printf("Usage: set <name> <field> [value]\n");
+        } else {
+            Contact* contact = database_get_contact(db, name);
+            value = value ? value + strspn(value, " ") : "";
+            if (contact == NULL) {
+                printf("Contact not found.\n");
+            } else if (field == CONTACT_FIELD_NAME && value[0] == '\0') {
+                printf("A contact's name cannot be empty.\n");
+            } else {
+                Contact fields = *contact;
+                fields.fields[field] = value;
+                database_update_record(db, contact, &fields);
+                printf("Contact updated.\n");
+            }
+        }
     } else if (strcmp(command, "del") == 0) {
         char* name = strtok(NULL, " \n");
         if (name) {
@@ -87,50 +242,190 @@ void handle_command(char* line, Database* db) {
             printf("Usage: del <name>\n");
         }
     } else if (strcmp(command, "list") == 0) {
-        int count;
-        Contact** contacts = database_list_contacts(db, &count);
-        for (int i = 0; i < count; i++) {
-            printf("Contact #%d:\n", i + 1);
-            print_contact(contacts[i]);
-            printf("\n");
+        list_contacts(db);
+    } else if (strcmp(command, "find") == 0) {
+        char* query = strtok(NULL, "\n");
+        if (query) {
+            int count;
+            FuzzyMatch* matches = database_search_fuzzy(db, query, &count);
+            for (int i = 0; i < count; i++) {
+                printf("Match #%d (%u edit%s):\n", i + 1, matches[i].distance, matches[i].distance == 1 ? "" : "s");
+                print_contact(db->contacts[matches[i].id]);
+            }
+            if (count == 0) {
+                printf("No contacts found.\n");
+            }
+            free(matches);
+        } else {
+            printf("Usage: find <text>\n");
+        }
+    } else if (strcmp(command, "import") == 0) {
+        char* path = strtok(NULL, " \n");
+        char* policy_name = strtok(NULL, " \n");
+        DatabaseImportPolicy policy = import_policy;
+        VCardReadStats stats;
+        DatabaseImportStats import_stats;
+        if (path == NULL || (policy_name && !database_import_policy_parse(policy_name, &policy))) {
+            printf("Usage: import <file.vcf> [skip|overwrite|merge|append]\n");
+        } else if (database_import(db, path, policy, &import_stats, &stats)) {
+            double mb = stats.bytes / (1024.0 * 1024.0);
+            printf("Read %llu contacts (%.1f MB in %.2f s, %.1f MB/s).\n", (unsigned long long)stats.cards, mb,
+                   stats.seconds, stats.seconds > 0 ? mb / stats.seconds : 0.0);
+            printf("Added %lu, skipped %lu, overwrote %lu, merged %lu.\n", import_stats.added, import_stats.skipped,
+                   import_stats.overwritten, import_stats.merged);
         }
-        if (count == 0) {
-            printf("No contacts found.\n");
+    } else if (strcmp(command, "export") == 0) {
+        char* path = strtok(NULL, " \n");
+        char* version = strtok(NULL, " \n");
+        if (path == NULL) {
+            printf("Usage: export <file.vcf> [3|4]\n");
+        } else if (database_export(db, path, version && strcmp(version, "4") == 0 ? VCARD_VERSION_4 : VCARD_VERSION_3)) {
+            printf("Exported %d contacts.\n", db->count);
+        }
+    } else if (strcmp(command, "save") == 0) {
+        database_save(db);
+        printf("Save requested.\n");
+    } else if (strcmp(command, "stats") == 0) {
+        const DatabaseSaveStats* stats = database_get_save_stats(db);
+        printf("Save requests: %lu (%lu coalesced), writes: %lu\n", stats->requests, stats->coalesced, stats->writes);
+        if (stats->writes > 0) {
+            printf("Last write: %llu bytes in %.2f ms\n", (unsigned long long)stats->last_bytes, stats->last_ms);
+            printf("Total: %llu bytes, avg %.2f ms, max %.2f ms\n", (unsigned long long)stats->total_bytes,
+                   stats->total_ms / stats->writes, stats->max_ms);
         }
     } else if (strcmp(command, "help") == 0) {
         printf("Available commands:\n");
         printf("  add <name> <phone> <email> - Add a new contact\n");
         printf("  get <name>                  - Get a contact by name\n");
+        printf("  set <name> <field> [value]  - Set or clear one field of a contact: name, phone, email,\n");
+        printf("                                organization, address or notes\n");
         printf("  del <name>                  - Delete a contact by name\n");
         printf("  list                        - List all contacts\n");
+        printf("  find <text>                 - Find contacts by the words of their name or email, allowing\n");
+        printf("                                a typo or two; closest first\n");
+        printf("  import <file.vcf> [policy]  - Import contacts from a vCard file; duplicates are skipped,\n");
+        printf("                                overwritten, merged or appended (default: import_policy)\n");
+        printf("  export <file.vcf> [3|4]     - Export contacts as vCard 3.0 (default) or 4.0\n");
+        printf("  save                        - Write the journal into the database file\n");
+        printf("  stats                       - Show save counts, bytes written and latency\n");
         printf("  exit                        - Exit the program\n");
     } else if (strcmp(command, "exit") == 0) {
-        free(line);
-        database_close(db);
-        exit(0);
+        return 0;
     } else {
         printf("Unknown command. Type 'help' for a list of commands.\n");
     }
+    return 1;
+}
+
+// Runs commands from file, one per line, without prompting. Consecutive adds
+// and deletes are grouped into journal batches of up to BATCH_MUTATIONS, so
+// each batch is written and synced once; any other command ends the batch
+// first, so it sees and saves everything before it.
+#define BATCH_MUTATIONS 65536
+#define BATCH_IO_BUFFER_SIZE (1024 * 1024)
 
+static void run_batch(FILE* file, Database* db) {
+    setvbuf(file, NULL, _IOFBF, BATCH_IO_BUFFER_SIZE);
+    setvbuf(stdout, NULL, _IOFBF, BATCH_IO_BUFFER_SIZE);
+    char* line = NULL;
+    size_t capacity = 0;
+    int pending = 0;
+    int running = 1;
+    while (running && getline(&line, &capacity, file) != -1) {
+        if (!is_mutation(line) && pending > 0) {
+            database_end_batch(db);
+            database_poll(db);
+            pending = 0;
+        }
+        if (is_mutation(line) && pending++ == 0) {
+            database_begin_batch(db);
+        }
+        running = handle_command(line, db);
+        if (pending == BATCH_MUTATIONS) {
+            database_end_batch(db);
+            database_poll(db);
+            pending = 0;
+        }
+    }
+    if (pending > 0) {
+        database_end_batch(db);
+    }
     free(line);
+    fflush(stdout);
+}
+
+static double elapsed_ms(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
 }
 
-int main(int argc, char* argv[]) {\
+int main(int argc, char* argv[]) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // --batch [file] runs commands from file, or stdin, instead of prompting
+    FILE* batch = NULL;
+    if (argc > 1) {
+        if (strcmp(argv[1], "--batch") != 0 || argc > 3) {
+            fprintf(stderr, "Usage: %s [--batch [file]]\n", argv[0]);
+            return 1;
+        }
+        batch = argc == 3 && strcmp(argv[2], "-") != 0 ? fopen(argv[2], "r") : stdin;
+        if (batch == NULL) {
+            perror(argv[2]);
+            return 1;
+        }
+    }
+
     Config config;\
     config_load("contact_manager_gtk.conf", &config);\
+    if (!event_log_open(config.logfile)) {
+        perror(config.logfile);
+    }
 \
     Database* db = database_new(config.db_filename);\
     if (db == NULL) {\
         return 1;
     }
+    database_set_save_window(db, config.save_window_ms);
+    if (!database_import_policy_parse(config.import_policy, &import_policy)) {
+        fprintf(stderr, "Unknown import_policy %s, using merge\n", config.import_policy);
+    }
+
+    if (batch) {
+        run_batch(batch, db);
+        if (batch != stdin) {
+            fclose(batch);
+        }
+        int count = db->count;
+        database_close(db);
+        event_log_close();
+        if (getenv("CONTACT_MANAGER_TIMING")) {
+            fprintf(stderr, "Batch finished with %d contacts, saved, in %.1f ms\n", count, elapsed_ms(&start));
+        }
+        return 0;
+    }
 
+    completion_db = db;
     rl_attempted_completion_function = command_completion;
+    rl_pre_input_hook = sort_names_for_completion;
+
+    // Set CONTACT_MANAGER_TIMING to measure startup
+    if (getenv("CONTACT_MANAGER_TIMING")) {
+        fprintf(stderr, "Loaded %d contacts, time to first prompt: %.1f ms\n", db->count, elapsed_ms(&start));
+    }
 
     char* line;
-    while ((line = readline("> ")) != NULL) {
-        handle_command(line, db);
+    int running = 1;
+    while (running && (line = readline("> ")) != NULL) {
+        add_history(line);
+        running = handle_command(line, db);
+        free(line);
+        database_poll(db);
     }
 
     database_close(db);
+    event_log_close();
     return 0;
 }
\ No newline at end of file
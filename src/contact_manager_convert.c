@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <string.h>
+#include "database.h"
+
+// Converts a contact store between the CSV and binary .db formats.
+int main(int argc, char* argv[]) {
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr, "Usage: %s <input.db> <output.db> [csv|binary]\n", argv[0]);
+        fprintf(stderr, "Without a format, the output uses the opposite format of the input.\n");
+        return 1;
+    }
+
+    Database* db = database_new(argv[1]);
+    DatabaseFormat format = db->format == DATABASE_FORMAT_CSV ? DATABASE_FORMAT_BINARY : DATABASE_FORMAT_CSV;
+    if (argc == 4) {
+        if (strcmp(argv[3], "csv") == 0) {
+            format = DATABASE_FORMAT_CSV;
+        } else if (strcmp(argv[3], "binary") == 0) {
+            format = DATABASE_FORMAT_BINARY;
+        } else {
+            fprintf(stderr, "Unknown format '%s'. Use 'csv' or 'binary'.\n", argv[3]);
+            database_close(db);
+            return 1;
+        }
+    }
+
+    if (format == DATABASE_FORMAT_CSV) {
+        int dropped = 0, unquoted = 0;
+        for (int i = 0; i < db->count; i++) {
+            dropped += contact_has_extra_fields(db->contacts[i]);
+            unquoted += contact_has_csv_separators(db->contacts[i]);
+        }
+        // Fields are not quoted, so a comma or line break would split the record when it is read back
+        if (unquoted > 0) {
+            fprintf(stderr, "%d contacts have a comma or line break in their name, phone or email, which CSV cannot hold.\n",
+                    unquoted);
+            database_close(db);
+            return 1;
+        }
+        if (dropped > 0) {
+            fprintf(stderr, "Warning: CSV holds only name, phone and email; the other fields of %d contacts are dropped.\n", dropped);
+        }
+    }
+
+    int ok = database_save_as(db, argv[2], format);
+    if (ok) {
+        printf("Converted %d contacts to %s.\n", db->count, format == DATABASE_FORMAT_BINARY ? "binary" : "CSV");
+    } else {
+        perror("Error writing output file");
+    }
+    database_close(db);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,505 @@
+// Serves the contact store over a line-based protocol on config.port (a TCP
+// port on the loopback interface, or a Unix socket if it contains a '/').
+//
+// Requests, one per line, fields separated by spaces:
+//   add <name> <phone> <email>   -> OK
+//   del <name>                   -> OK | ERR not found
+//   get <name>                   -> OK 1, then the contact | ERR not found
+//   list                         -> OK <n>, then n contacts
+//   search <query>               -> OK <n>, then n contacts
+//   fuzzy <query>                -> OK <n>, then n contacts, closest first
+// Contacts are sent one per line as name, phone and email separated by tabs.
+// Anything else gets "ERR <reason>". Requests may be pipelined.
+//
+// The main thread runs an epoll loop that only accepts connections and hands
+// readable ones to a pool of workers. Connections are registered one-shot, so
+// exactly one worker serves a connection at a time and re-arms it when done.
+// Workers share the Database through a writer-preferring read/write lock:
+// gets, lists and searches run concurrently under the read lock, using the
+// prebuilt name and search indexes and no per-query state.
+//
+// Every connection is logged to config.logfile when it closes, as an event
+// with its request count and bytes transferred (see event_log.h).
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "config.h"
+#include "database.h"
+#include "event_log.h"
+
+#define SERVER_MAX_EVENTS 64
+#define SERVER_READ_SIZE (64 * 1024)
+// A connection sending a longer line than this is closed
+#define SERVER_MAX_LINE (64 * 1024)
+#define SERVER_POLL_MS 1000
+
+typedef struct {
+    int fd;
+    char* in;
+    size_t in_used;
+    size_t in_capacity;
+    char* out;
+    size_t out_used;
+    size_t out_sent;
+    size_t out_capacity;
+    // The peer has closed its side; close once the output is sent
+    int closing;
+    // Logged as one event when the connection closes
+    EventLogTime opened;
+    unsigned long requests;
+    uint64_t bytes;
+} Connection;
+
+typedef struct {
+    Connection** items;
+    size_t head;
+    size_t count;
+    size_t capacity;
+    int stopping;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} WorkQueue;
+
+static Database* db;
+static pthread_rwlock_t db_lock;
+static int epoll_fd;
+static WorkQueue work_queue;
+
+// Markers for the epoll entries that are not connections
+static int listen_marker;
+static int signal_marker;
+
+// --- Work Queue ---
+
+static void work_queue_push(WorkQueue* queue, Connection* conn) {
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count == queue->capacity) {
+        size_t capacity = queue->capacity ? queue->capacity * 2 : 64;
+        Connection** items = malloc(sizeof(Connection*) * capacity);
+        for (size_t i = 0; i < queue->count; i++) {
+            items[i] = queue->items[(queue->head + i) % queue->capacity];
+        }
+        free(queue->items);
+        queue->items = items;
+        queue->head = 0;
+        queue->capacity = capacity;
+    }
+    queue->items[(queue->head + queue->count) % queue->capacity] = conn;
+    queue->count++;
+    pthread_cond_signal(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+// Returns NULL once the queue is stopping
+static Connection* work_queue_pop(WorkQueue* queue) {
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == 0 && !queue->stopping) {
+        pthread_cond_wait(&queue->cond, &queue->mutex);
+    }
+    Connection* conn = NULL;
+    if (!queue->stopping) {
+        conn = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return conn;
+}
+
+static void work_queue_stop(WorkQueue* queue) {
+    pthread_mutex_lock(&queue->mutex);
+    queue->stopping = 1;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+// --- Responses ---
+
+static void out_reserve(Connection* conn, size_t length) {
+    if (conn->out_used + length > conn->out_capacity) {
+        size_t capacity = conn->out_capacity ? conn->out_capacity : 4096;
+        while (capacity < conn->out_used + length) {
+            capacity *= 2;
+        }
+        conn->out = realloc(conn->out, capacity);
+        conn->out_capacity = capacity;
+    }
+}
+
+static void out_put(Connection* conn, const char* text, size_t length) {
+    out_reserve(conn, length);
+    memcpy(conn->out + conn->out_used, text, length);
+    conn->out_used += length;
+}
+
+static void out_str(Connection* conn, const char* text) {
+    out_put(conn, text, strlen(text));
+}
+
+static void out_count(Connection* conn, int count) {
+    char line[32];
+    out_put(conn, line, snprintf(line, sizeof(line), "OK %d\n", count));
+}
+
+static void out_contact(Connection* conn, const Contact* contact) {
+    size_t name = strlen(contact->name), phone = strlen(contact->phone), email = strlen(contact->email);
+    out_reserve(conn, name + phone + email + 3);
+    char* p = conn->out + conn->out_used;
+    memcpy(p, contact->name, name);
+    p += name;
+    *p++ = '\t';
+    memcpy(p, contact->phone, phone);
+    p += phone;
+    *p++ = '\t';
+    memcpy(p, contact->email, email);
+    p += email;
+    *p++ = '\n';
+    conn->out_used = p - conn->out;
+}
+
+static void handle_request(Connection* conn, char* line) {
+    conn->requests++;
+    char* save;
+    char* command = strtok_r(line, " \t\r", &save);
+    if (command == NULL) {
+        out_str(conn, "ERR empty request\n");
+    } else if (strcmp(command, "add") == 0) {
+        char* name = strtok_r(NULL, " \t\r", &save);
+        char* phone = strtok_r(NULL, " \t\r", &save);
+        char* email = strtok_r(NULL, " \t\r", &save);
+        if (name && phone && email) {
+            pthread_rwlock_wrlock(&db_lock);
+            database_add_contact(db, name, phone, email);
+            pthread_rwlock_unlock(&db_lock);
+            out_str(conn, "OK\n");
+        } else {
+            out_str(conn, "ERR usage: add <name> <phone> <email>\n");
+        }
+    } else if (strcmp(command, "del") == 0) {
+        char* name = strtok_r(NULL, " \t\r", &save);
+        if (name) {
+            pthread_rwlock_wrlock(&db_lock);
+            int deleted = database_del_contact(db, name);
+            pthread_rwlock_unlock(&db_lock);
+            out_str(conn, deleted ? "OK\n" : "ERR not found\n");
+        } else {
+            out_str(conn, "ERR usage: del <name>\n");
+        }
+    } else if (strcmp(command, "get") == 0) {
+        char* name = strtok_r(NULL, " \t\r", &save);
+        if (name) {
+            // The contact may be freed by the next writer, so it is copied out under the lock
+            pthread_rwlock_rdlock(&db_lock);
+            Contact* contact = database_get_contact(db, name);
+            if (contact) {
+                out_count(conn, 1);
+                out_contact(conn, contact);
+            }
+            pthread_rwlock_unlock(&db_lock);
+            if (contact == NULL) {
+                out_str(conn, "ERR not found\n");
+            }
+        } else {
+            out_str(conn, "ERR usage: get <name>\n");
+        }
+    } else if (strcmp(command, "list") == 0) {
+        pthread_rwlock_rdlock(&db_lock);
+        int count;
+        Contact** contacts = database_list_contacts(db, &count);
+        out_count(conn, count);
+        for (int i = 0; i < count; i++) {
+            out_contact(conn, contacts[i]);
+        }
+        pthread_rwlock_unlock(&db_lock);
+    } else if (strcmp(command, "search") == 0) {
+        char* query = strtok_r(NULL, "\r", &save);
+        if (query) {
+            pthread_rwlock_rdlock(&db_lock);
+            int count;
+            int* positions = database_search_shared(db, query, &count);
+            out_count(conn, count);
+            for (int i = 0; i < count; i++) {
+                out_contact(conn, db->contacts[positions[i]]);
+            }
+            pthread_rwlock_unlock(&db_lock);
+            free(positions);
+        } else {
+            out_str(conn, "ERR usage: search <query>\n");
+        }
+    } else if (strcmp(command, "fuzzy") == 0) {
+        char* query = strtok_r(NULL, "\r", &save);
+        if (query) {
+            pthread_rwlock_rdlock(&db_lock);
+            int count;
+            FuzzyMatch* matches = database_search_fuzzy(db, query, &count);
+            out_count(conn, count);
+            for (int i = 0; i < count; i++) {
+                out_contact(conn, db->contacts[matches[i].id]);
+            }
+            pthread_rwlock_unlock(&db_lock);
+            free(matches);
+        } else {
+            out_str(conn, "ERR usage: fuzzy <query>\n");
+        }
+    } else {
+        out_str(conn, "ERR unknown command\n");
+    }
+}
+
+// --- Connections ---
+
+static void connection_close(Connection* conn) {
+    event_log_end("connection", conn->opened, conn->requests, conn->bytes);
+    close(conn->fd);
+    free(conn->in);
+    free(conn->out);
+    free(conn);
+}
+
+static void connection_arm(Connection* conn, uint32_t events) {
+    struct epoll_event event;
+    event.events = events | EPOLLONESHOT;
+    event.data.ptr = conn;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+}
+
+// Returns 0 if the peer is gone
+static int connection_flush(Connection* conn) {
+    while (conn->out_sent < conn->out_used) {
+        ssize_t n = send(conn->fd, conn->out + conn->out_sent, conn->out_used - conn->out_sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            conn->out_sent += n;
+            conn->bytes += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+    conn->out_used = 0;
+    conn->out_sent = 0;
+    return 1;
+}
+
+// Runs on a worker: reads what has arrived, answers every complete line and
+// sends as much as the socket takes. Level-triggered, so unread input or
+// unsent output brings the connection back.
+static void connection_serve(Connection* conn) {
+    if (conn->out_sent == conn->out_used && !conn->closing) {
+        if (conn->in_capacity - conn->in_used < SERVER_READ_SIZE) {
+            conn->in_capacity = conn->in_used + SERVER_READ_SIZE;
+            conn->in = realloc(conn->in, conn->in_capacity);
+        }
+        ssize_t n = recv(conn->fd, conn->in + conn->in_used, SERVER_READ_SIZE, 0);
+        if (n > 0) {
+            conn->in_used += n;
+            conn->bytes += n;
+        } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            conn->closing = 1;
+        }
+
+        char* start = conn->in;
+        char* end = conn->in + conn->in_used;
+        char* newline;
+        while ((newline = memchr(start, '\n', end - start)) != NULL) {
+            *newline = '\0';
+            handle_request(conn, start);
+            start = newline + 1;
+        }
+        conn->in_used = end - start;
+        memmove(conn->in, start, conn->in_used);
+        if (conn->in_used > SERVER_MAX_LINE) {
+            conn->closing = 1;
+        }
+    }
+
+    if (!connection_flush(conn)) {
+        connection_close(conn);
+    } else if (conn->out_sent < conn->out_used) {
+        connection_arm(conn, EPOLLOUT);
+    } else if (conn->closing) {
+        connection_close(conn);
+    } else {
+        connection_arm(conn, EPOLLIN);
+    }
+}
+
+static void* worker_main(void* arg) {
+    (void)arg;
+    Connection* conn;
+    while ((conn = work_queue_pop(&work_queue)) != NULL) {
+        connection_serve(conn);
+    }
+    return NULL;
+}
+
+static void accept_connections(int listen_fd) {
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        Connection* conn = calloc(1, sizeof(Connection));
+        conn->fd = fd;
+        conn->opened = event_log_start();
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLONESHOT;
+        event.data.ptr = conn;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+static int listen_on(const char* port) {
+    int fd;
+    if (strchr(port, '/')) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", port);
+        unlink(port);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            perror(port);
+            return -1;
+        }
+    } else {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            perror("bind");
+            return -1;
+        }
+    }
+    if (listen(fd, SOMAXCONN) != 0) {
+        perror("listen");
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char* argv[]) {
+    Config config;
+    config_load("contact_manager_gtk.conf", &config);
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--port") == 0) {
+            config.port = argv[i + 1];
+        } else if (strcmp(argv[i], "--db") == 0) {
+            config.db_filename = argv[i + 1];
+        } else if (strcmp(argv[i], "--log") == 0) {
+            config.logfile = argv[i + 1];
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            threads = atoi(argv[i + 1]);
+        } else {
+            break;
+        }
+    }
+    if (argc % 2 == 0 || threads < 1) {
+        fprintf(stderr, "Usage: %s [--port port|path] [--db file] [--log file] [--threads n]\n", argv[0]);
+        return 1;
+    }
+
+    if (!event_log_open(config.logfile)) {
+        perror(config.logfile);
+    }
+    db = database_new(config.db_filename);
+    database_set_save_window(db, config.save_window_ms);
+    // Built up front so lookups and searches only read the database
+    database_build_name_index(db);
+    database_build_search_index(db);
+
+    pthread_rwlockattr_t lock_attr;
+    pthread_rwlockattr_init(&lock_attr);
+    // A steady stream of readers must not starve writers
+    pthread_rwlockattr_setkind_np(&lock_attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&db_lock, &lock_attr);
+
+    int listen_fd = listen_on(config.port);
+    if (listen_fd < 0) {
+        database_close(db);
+        event_log_close();
+        return 1;
+    }
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = &listen_marker;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+    event.data.ptr = &signal_marker;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &event);
+
+    pthread_mutex_init(&work_queue.mutex, NULL);
+    pthread_cond_init(&work_queue.cond, NULL);
+    pthread_t* workers = malloc(sizeof(pthread_t) * threads);
+    for (long i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, worker_main, NULL);
+    }
+    fprintf(stderr, "Serving %d contacts on %s with %ld workers\n", db->count, config.port, threads);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    time_t last_poll = time(NULL);
+    int running = 1;
+    while (running) {
+        int n = epoll_wait(epoll_fd, events, SERVER_MAX_EVENTS, SERVER_POLL_MS);
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == &listen_marker) {
+                accept_connections(listen_fd);
+            } else if (events[i].data.ptr == &signal_marker) {
+                running = 0;
+            } else {
+                work_queue_push(&work_queue, events[i].data.ptr);
+            }
+        }
+        // Deferred saves and compactions, about once a second so readers are rarely held up
+        if (time(NULL) != last_poll) {
+            last_poll = time(NULL);
+            pthread_rwlock_wrlock(&db_lock);
+            database_poll(db);
+            pthread_rwlock_unlock(&db_lock);
+        }
+    }
+
+    work_queue_stop(&work_queue);
+    for (long i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    close(listen_fd);
+    if (strchr(config.port, '/')) {
+        unlink(config.port);
+    }
+    database_close(db);
+    event_log_close();
+    return 0;
+}
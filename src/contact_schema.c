@@ -0,0 +1,45 @@
+#include <string.h>
+#include "contact_schema.h"
+
+const ContactFieldInfo contact_fields[CONTACT_FIELD_COUNT] = {
+    [CONTACT_FIELD_NAME] = {"name", "Name", 0},
+    [CONTACT_FIELD_PHONE] = {"phone", "Phone", CONTACT_FIELD_MULTIPLE},
+    [CONTACT_FIELD_EMAIL] = {"email", "Email", CONTACT_FIELD_MULTIPLE},
+    [CONTACT_FIELD_ORGANIZATION] = {"organization", "Organization", 0},
+    [CONTACT_FIELD_ADDRESS] = {"address", "Address", 0},
+    [CONTACT_FIELD_NOTES] = {"notes", "Notes", 0},
+};
+
+void contact_clear(Contact* contact) {
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        contact->fields[f] = "";
+    }
+}
+
+int contact_has_extra_fields(const Contact* contact) {
+    for (int f = CONTACT_BASIC_FIELDS; f < CONTACT_FIELD_COUNT; f++) {
+        if (contact->fields[f][0]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int contact_has_csv_separators(const Contact* contact) {
+    for (int f = 0; f < CONTACT_BASIC_FIELDS; f++) {
+        if (strpbrk(contact->fields[f], ",\n\r")) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int contact_field_parse(const char* name, ContactField* field) {
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        if (strcmp(name, contact_fields[f].name) == 0) {
+            *field = (ContactField)f;
+            return 1;
+        }
+    }
+    return 0;
+}
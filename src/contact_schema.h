@@ -0,0 +1,63 @@
+#ifndef CONTACT_SCHEMA_H
+#define CONTACT_SCHEMA_H
+
+// The fields of a contact record. Every field is a string, "" when unset and
+// never NULL. Phone and email may hold several values joined by
+// CONTACT_VALUE_SEPARATOR, the preferred one first. Stores and indexes walk
+// contact_fields rather than naming fields, so a field added here is saved,
+// journaled, imported and searched without further changes.
+
+typedef enum {
+    CONTACT_FIELD_NAME,
+    CONTACT_FIELD_PHONE,
+    CONTACT_FIELD_EMAIL,
+    CONTACT_FIELD_ORGANIZATION,
+    CONTACT_FIELD_ADDRESS,
+    CONTACT_FIELD_NOTES,
+    CONTACT_FIELD_COUNT
+} ContactField;
+
+// The fields a CSV store holds; the others are only kept by binary stores
+#define CONTACT_BASIC_FIELDS 3
+#define CONTACT_VALUE_SEPARATOR ';'
+
+typedef struct {
+    union {
+        struct {
+            char* name;
+            char* phone;
+            char* email;
+            char* organization;
+            char* address;
+            char* notes;
+        };
+        char* fields[CONTACT_FIELD_COUNT];
+    };
+} Contact;
+
+typedef enum {
+    // Holds several values joined by CONTACT_VALUE_SEPARATOR
+    CONTACT_FIELD_MULTIPLE = 1 << 0
+} ContactFieldFlags;
+
+typedef struct {
+    // As typed in commands, e.g. "organization"
+    const char* name;
+    // As shown next to a value, e.g. "Organization"
+    const char* label;
+    unsigned int flags;
+} ContactFieldInfo;
+
+extern const ContactFieldInfo contact_fields[CONTACT_FIELD_COUNT];
+
+// Sets every field to "".
+void contact_clear(Contact* contact);
+// Whether any field beyond the CONTACT_BASIC_FIELDS is set.
+int contact_has_extra_fields(const Contact* contact);
+// Whether the name, phone or email holds a comma or line break, which would
+// split an unquoted CSV record.
+int contact_has_csv_separators(const Contact* contact);
+// Looks a field up by its name; returns 0 if there is none.
+int contact_field_parse(const char* name, ContactField* field);
+
+#endif
@@ -1,164 +1,1114 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "binary_format.h"
 #include "database.h"
+#include "file_util.h"
 
-static void database_load(Database* db) {
-    FILE* file = fopen(db->filename, "r");
-    if (file == NULL) {
-        return;
+// The journal is folded into the base file once it outgrows half the base, and never below this size
+#define DATABASE_COMPACT_MIN_BYTES (1024 * 1024)
+
+// A snapshot of the store being written to "<db>.compact" by a background thread
+struct DatabaseCompaction {
+    pthread_t thread;
+    char* snapshot;
+    size_t snapshot_size;
+    char* tmp_path;
+    // Journal length when the snapshot was taken: everything before it is in the snapshot
+    uint64_t journal_offset;
+    uint64_t checksum;
+    double write_ms;
+    int count;
+    int ok;
+    atomic_int done;
+};
+
+static void database_reserve(Database* db, int count) {
+    if (count > db->capacity) {
+        db->capacity = count;
+        db->contacts = realloc(db->contacts, sizeof(Contact*) * db->capacity);
+    }
+}
+
+// The name index is built on the first lookup rather than during load, so
+// opening a large store does not pay for hashing every name up front.
+static HashIndex* database_name_index(Database* db) {
+    if (!db->name_index_built) {
+        hash_index_reserve(&db->name_index, db->count);
+        for (int i = 0; i < db->count; i++) {
+            hash_index_insert(&db->name_index, db->contacts[i]->name, i);
+        }
+        db->name_index_built = 1;
     }
+    return &db->name_index;
+}
 
-    char line[1024];
-    while (fgets(line, sizeof(line), file)) {
-        char* name = strtok(line, ",");
-        char* phone = strtok(NULL, ",");
-        char* email = strtok(NULL, "\n");
+void database_build_name_index(Database* db) {
+    database_name_index(db);
+}
 
-        if (name && phone && email) {
-            Contact* contact = malloc(sizeof(Contact));
-            contact->name = strdup(name);
-            contact->phone = strdup(phone);
-            contact->email = strdup(email);
-            database_add_contact(db, contact);
+const SortedIndex* database_sorted_names(Database* db) {
+    if (!db->sorted_names_built) {
+        const char** names = malloc(sizeof(const char*) * (db->count ? db->count : 1));
+        for (int i = 0; i < db->count; i++) {
+            names[i] = db->contacts[i]->name;
         }
+        sorted_index_build(&db->sorted_names, names, db->count);
+        free(names);
+        db->sorted_names_built = 1;
     }
-    fclose(file);
+    return &db->sorted_names;
 }
 
-void database_save(Database* db) {
-    FILE* file = fopen(db->filename, "w");
-    if (file == NULL) {
+const ContactColumn* database_column(Database* db, ContactField field) {
+    ContactColumn* column = &db->columns[field];
+    if (!db->column_built[field]) {
+        uint64_t heap_size = 0;
+        for (int i = 0; i < db->count; i++) {
+            heap_size += strlen(db->contacts[i]->fields[field]) + 1;
+        }
+        contact_column_reserve(column, db->count, heap_size);
+        for (int i = 0; i < db->count; i++) {
+            contact_column_set(column, i, db->contacts[i]->fields[field]);
+        }
+        db->column_built[field] = 1;
+    }
+    return column;
+}
+
+void database_build_columns(Database* db) {
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        database_column(db, (ContactField)f);
+    }
+}
+
+static void database_set_columns(Database* db, int i, const Contact* contact) {
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        if (db->column_built[f]) {
+            contact_column_set(&db->columns[f], i, contact->fields[f]);
+        }
+    }
+}
+
+static Contact* database_append(Database* db, Contact* contact) {
+    if (db->count == db->capacity) {
+        db->capacity *= 2;
+        db->contacts = realloc(db->contacts, sizeof(Contact*) * db->capacity);
+    }
+    if (db->name_index_built) {
+        hash_index_insert(&db->name_index, contact->name, db->count);
+    }
+    if (db->sorted_names_built) {
+        sorted_index_insert(&db->sorted_names, contact->name);
+    }
+    if (db->search_index_built) {
+        search_index_add(&db->search_index, contact, db->count);
+    }
+    database_set_columns(db, db->count, contact);
+    db->contacts[db->count++] = contact;
+    return contact;
+}
+
+// Maps the file copy-on-write, falling back to reading it into the heap when it cannot be mapped.
+static int database_map_file(Database* db) {
+    int fd = open(db->filename, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    size_t size = st.st_size;
+
+    char* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+        madvise(map, size, MADV_SEQUENTIAL);
+        db->map_is_heap = 0;
+    } else {
+        map = malloc(size);
+        size_t done = 0;
+        while (done < size) {
+            ssize_t n = read(fd, map + done, size - done);
+            if (n <= 0) {
+                break;
+            }
+            done += n;
+        }
+        size = done;
+        db->map_is_heap = 1;
+    }
+    close(fd);
+
+    db->map = map;
+    db->map_size = size;
+    return 1;
+}
+
+static void database_unmap_file(Database* db) {
+    if (db->map == NULL) {
         return;
     }
+    if (db->map_is_heap) {
+        free(db->map);
+    } else {
+        munmap(db->map, db->map_size);
+    }
+    db->map = NULL;
+    db->map_size = 0;
+}
 
-    for (int i = 0; i < db->count; i++) {
-        fprintf(file, "%s,%s,%s\n", db->contacts[i]->name, db->contacts[i]->phone, db->contacts[i]->email);
+// Where the file loaders put contacts: straight into the database, or in runs to a DatabaseLoadFunc
+typedef struct {
+    Database* db;
+    DatabaseLoadFunc func;
+    void* user_data;
+    Contact** batch;
+    int count;
+    int batch_size;
+    int stopped;
+    int loaded;
+} DatabaseLoader;
+
+static void loader_flush(DatabaseLoader* loader, double fraction) {
+    if (loader->count > 0 && !loader->stopped) {
+        loader->stopped = !loader->func(loader->batch, loader->count, fraction, loader->user_data);
     }
-    fclose(file);
+    loader->count = 0;
 }
 
-void database_import(Database* db, const char* filepath) {
-    FILE* file = fopen(filepath, "r");
-    if (file == NULL) {
-        perror("Error opening import file");
+static void loader_add(DatabaseLoader* loader, Contact* contact, double fraction) {
+    loader->loaded++;
+    if (loader->func == NULL) {
+        database_append(loader->db, contact);
         return;
     }
+    loader->batch[loader->count++] = contact;
+    if (loader->count == loader->batch_size) {
+        loader_flush(loader, fraction);
+    }
+}
 
-    char line[1024];
-    Contact* current_contact = NULL;
-
-    while (fgets(line, sizeof(line), file)) {
-        // Remove trailing newline or carriage return
-        line[strcspn(line, "\r\n")] = 0;
-
-        if (strcmp(line, "BEGIN:VCARD") == 0) {
-            current_contact = malloc(sizeof(Contact));
-            current_contact->name = NULL;
-            current_contact->phone = NULL;
-            current_contact->email = NULL;
-        } else if (current_contact != NULL && strncmp(line, "FN:", 3) == 0) {
-            if (current_contact->name) free(current_contact->name);
-            current_contact->name = strdup(line + 3);
-        } else if (current_contact != NULL && strncmp(line, "TEL:", 4) == 0) {
-            if (current_contact->phone) free(current_contact->phone);
-            current_contact->phone = strdup(line + 4);
-        } else if (current_contact != NULL && strncmp(line, "EMAIL:", 6) == 0) {
-            if (current_contact->email) free(current_contact->email);
-            current_contact->email = strdup(line + 6);
-        } else if (strcmp(line, "END:VCARD") == 0) {
-            if (current_contact != NULL && current_contact->name != NULL) {
-                // Ensure all fields are non-NULL before adding, use empty string if missing
-                if (current_contact->phone == NULL) current_contact->phone = strdup("");
-                if (current_contact->email == NULL) current_contact->email = strdup("");
-                database_add_contact(db, current_contact);
+// Binary stores are used entirely in place: the heap strings are already terminated, so pages stay clean and shared.
+static void database_load_binary(Database* db, DatabaseLoader* loader) {
+    BinaryFormatView view;
+    if (!binary_format_open(db->map, db->map_size, &view)) {
+        fprintf(stderr, "%s: unsupported or corrupt binary database\n", db->filename);
+        return;
+    }
+    if (loader->func == NULL) {
+        database_reserve(db, view.record_count);
+    }
+    for (uint64_t i = 0; i < view.record_count && !loader->stopped; i++) {
+        Contact fields;
+        if (binary_format_record(&view, i, &fields)) {
+            loader_add(loader, contact_arena_alloc_ref(&db->arena, &fields), (double)i / view.record_count);
+        }
+    }
+}
+
+// Parses "name,phone,email" lines in place: separators are overwritten with
+// NULs and contacts point at the field slices, so nothing is copied.
+static void database_load_csv(Database* db, DatabaseLoader* loader) {
+    char* p = db->map;
+    char* end = db->map + db->map_size;
+
+    // Runs handed to a loader func are added by the caller, which reserves as they come
+    if (loader->func == NULL) {
+        int lines = 0;
+        for (char* q = p; (q = memchr(q, '\n', end - q)) != NULL; q++) {
+            lines++;
+        }
+        database_reserve(db, lines + 1);
+    }
+
+    while (p < end && !loader->stopped) {
+        char* eol = memchr(p, '\n', end - p);
+        char* line_end = eol ? eol : end;
+        char* next = eol ? eol + 1 : end;
+        if (line_end > p && line_end[-1] == '\r') {
+            line_end--;
+        }
+
+        // The email is the rest of the line, so it may itself contain commas
+        char* phone = memchr(p, ',', line_end - p);
+        char* email = phone ? memchr(phone + 1, ',', line_end - phone - 1) : NULL;
+        if (email) {
+            *phone++ = '\0';
+            *email++ = '\0';
+            Contact fields;
+            contact_clear(&fields);
+            fields.name = p;
+            fields.phone = phone;
+            fields.email = email;
+            if (eol) {
+                *line_end = '\0';
+                loader_add(loader, contact_arena_alloc_ref(&db->arena, &fields), (double)(p - db->map) / db->map_size);
             } else {
-                // If contact is incomplete, free allocated memory
-                if (current_contact->name) free(current_contact->name);
-                if (current_contact->phone) free(current_contact->phone);
-                if (current_contact->email) free(current_contact->email);
-                free(current_contact);
+                // Last line without a newline: there is no byte left to terminate it in place
+                fields.email = strndup(email, line_end - email);
+                loader_add(loader, contact_arena_alloc(&db->arena, &fields), 1.0);
+                free(fields.email);
             }
-            current_contact = NULL;
         }
+        p = next;
     }
-    fclose(file);
-    database_save(db); // Save after import
 }
 
-void database_export(Database* db, const char* filepath) {
-    FILE* file = fopen(filepath, "w");
-    if (file == NULL) {
-        perror("Error opening export file");
-        return;
+// Reads the base file; func NULL appends the contacts to db directly.
+int database_load(Database* db, int batch_size, DatabaseLoadFunc func, void* user_data) {
+    EventLogTime start = event_log_start();
+    if (!database_map_file(db)) {
+        return 1;
     }
+    DatabaseLoader loader = {db, func, user_data, NULL, 0, batch_size > 0 ? batch_size : 1, 0, 0};
+    if (func) {
+        loader.batch = malloc(sizeof(Contact*) * loader.batch_size);
+    }
+    if (binary_format_detect(db->map, db->map_size)) {
+        db->format = DATABASE_FORMAT_BINARY;
+        database_load_binary(db, &loader);
+    } else {
+        db->format = DATABASE_FORMAT_CSV;
+        database_load_csv(db, &loader);
+    }
+    if (func) {
+        loader_flush(&loader, 1.0);
+        free(loader.batch);
+    }
+    event_log_end("load", start, loader.loaded, db->map_size);
+    return !loader.stopped;
+}
 
+static int database_write(Database* db, FILE* file, DatabaseFormat format) {
+    if (format == DATABASE_FORMAT_BINARY) {
+        return binary_format_write(file, db->contacts, db->count);
+    }
     for (int i = 0; i < db->count; i++) {
-        fprintf(file, "%s,%s,%s\n", db->contacts[i]->name, db->contacts[i]->phone, db->contacts[i]->email);
+        if (fprintf(file, "%s,%s,%s\n", db->contacts[i]->name, db->contacts[i]->phone, db->contacts[i]->email) < 0) {
+            return 0;
+        }
     }
-    fclose(file);
+    return 1;
 }
 
-Database* database_new(const char* filename) {
+static double monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void database_record_save(Database* db, uint64_t bytes, double ms) {
+    db->save_stats.writes++;
+    db->save_stats.last_bytes = bytes;
+    db->save_stats.total_bytes += bytes;
+    db->save_stats.last_ms = ms;
+    db->save_stats.total_ms += ms;
+    if (ms > db->save_stats.max_ms) {
+        db->save_stats.max_ms = ms;
+    }
+}
+
+// Writes to a temporary file next to the target, fsyncs it and renames it into
+// place, so a crash or full disk leaves either the old or the new file intact.
+int database_save_as(Database* db, const char* filename, DatabaseFormat format) {
+    EventLogTime event_start = event_log_start();
+    double start = monotonic_ms();
+    char* tmp_path = malloc(strlen(filename) + 8);
+    sprintf(tmp_path, "%s.XXXXXX", filename);
+    int fd = mkstemp(tmp_path);
+    if (fd < 0) {
+        free(tmp_path);
+        return 0;
+    }
+    struct stat st;
+    fchmod(fd, stat(filename, &st) == 0 ? st.st_mode & 0777 : 0644);
+
+    FILE* file = fdopen(fd, "w");
+    int ok = database_write(db, file, format) && fflush(file) == 0 && fsync(fd) == 0;
+    long bytes = ftell(file);
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+    ok = ok && rename(tmp_path, filename) == 0 && file_sync_parent_dir(filename);
+    if (ok) {
+        database_record_save(db, bytes, monotonic_ms() - start);
+        event_log_end("save", event_start, db->count, bytes);
+    } else {
+        unlink(tmp_path);
+    }
+    free(tmp_path);
+    return ok;
+}
+
+// --- Journal and compaction ---
+
+static void* compaction_write(void* data) {
+    struct DatabaseCompaction* job = data;
+    EventLogTime event_start = event_log_start();
+    double start = monotonic_ms();
+    int fd = open(job->tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    job->ok = fd >= 0 && file_write_all(fd, job->snapshot, job->snapshot_size) && fsync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    job->checksum = journal_checksum(JOURNAL_CHECKSUM_INIT, job->snapshot, job->snapshot_size);
+    job->write_ms = monotonic_ms() - start;
+    event_log_end("compact", event_start, job->count, job->snapshot_size);
+    atomic_store(&job->done, 1);
+    return NULL;
+}
+
+// Serializes the store in memory, so the base file can be written without touching live contacts.
+static struct DatabaseCompaction* compaction_new(Database* db) {
+    if (db->format == DATABASE_FORMAT_CSV) {
+        for (int i = 0; i < db->count; i++) {
+            if (contact_has_extra_fields(db->contacts[i]) || contact_has_csv_separators(db->contacts[i])) {
+                fprintf(stderr, "%s: saving as a binary store, which keeps values CSV cannot hold\n", db->filename);
+                db->format = DATABASE_FORMAT_BINARY;
+                break;
+            }
+        }
+    }
+    struct DatabaseCompaction* job = calloc(1, sizeof(struct DatabaseCompaction));
+    FILE* stream = open_memstream(&job->snapshot, &job->snapshot_size);
+    int ok = database_write(db, stream, db->format);
+    fclose(stream);
+    if (!ok) {
+        free(job->snapshot);
+        free(job);
+        return NULL;
+    }
+    job->tmp_path = malloc(strlen(db->filename) + 9);
+    sprintf(job->tmp_path, "%s.compact", db->filename);
+    job->journal_offset = db->journal.size;
+    job->count = db->count;
+    atomic_init(&job->done, 0);
+    db->dirty = 0;
+    return job;
+}
+
+// Publishes a written snapshot. The checkpoint goes into the journal before the
+// rename, so replay can tell whether the base file already holds the journal prefix.
+static void compaction_finish(Database* db, struct DatabaseCompaction* job) {
+    double start = monotonic_ms();
+    int ok = job->ok &&
+             journal_append_checkpoint(&db->journal, job->snapshot_size, job->checksum, job->journal_offset) &&
+             rename(job->tmp_path, db->filename) == 0 &&
+             file_sync_parent_dir(db->filename);
+    if (ok) {
+        journal_rewrite_from(&db->journal, job->journal_offset);
+        database_record_save(db, job->snapshot_size, job->write_ms + monotonic_ms() - start);
+        db->last_save_ms = monotonic_ms();
+        db->compact_threshold = job->snapshot_size / 2 > DATABASE_COMPACT_MIN_BYTES ? job->snapshot_size / 2 : DATABASE_COMPACT_MIN_BYTES;
+    } else {
+        perror("Error compacting database");
+        unlink(job->tmp_path);
+        db->dirty = 1;
+    }
+    free(job->snapshot);
+    free(job->tmp_path);
+    free(job);
+}
+
+static void database_wait_compaction(Database* db) {
+    if (db->compaction) {
+        pthread_join(db->compaction->thread, NULL);
+        compaction_finish(db, db->compaction);
+        db->compaction = NULL;
+    }
+}
+
+// Finishes a background compaction that is done, or starts one once the journal has grown enough.
+static void database_maybe_compact(Database* db) {
+    // A snapshot of a partly loaded database would replace the file with only some of its contacts
+    if (db->loading) {
+        return;
+    }
+    if (db->compaction) {
+        // Inside a batch the checkpoint would wait in the pending buffer while
+        // the journal is rewritten under it, so finishing waits for the batch
+        if (atomic_load(&db->compaction->done) && db->journal.batch_depth == 0) {
+            database_wait_compaction(db);
+        }
+        return;
+    }
+    if (db->journal.batch_depth > 0 || db->journal.size < db->compact_threshold) {
+        return;
+    }
+    struct DatabaseCompaction* job = compaction_new(db);
+    if (job == NULL) {
+        return;
+    }
+    if (pthread_create(&job->thread, NULL, compaction_write, job) != 0) {
+        compaction_write(job);
+        compaction_finish(db, job);
+        return;
+    }
+    db->compaction = job;
+}
+
+static const char* change_events[] = {[JOURNAL_OP_ADD] = "add", [JOURNAL_OP_UPDATE] = "update", [JOURNAL_OP_DELETE] = "delete"};
+
+// Writes the mutation ahead of applying it. Outside a batch this costs one
+// append and one fdatasync, and is logged as an event of its own; inside one
+// it counts towards the batch's event.
+static void database_log(Database* db, JournalOp op, const Contact* old_fields, const Contact* new_fields) {
+    EventLogTime start = db->journal.batch_depth == 0 ? event_log_start() : 0;
+    // Records go to the pending buffer inside a batch and straight to the file outside one
+    uint64_t journal_size = db->journal.size + db->journal.pending_len;
+    if (!journal_append(&db->journal, op, old_fields, new_fields)) {
+        perror("Error writing journal");
+    }
+    db->dirty = 1;
+    uint64_t bytes = db->journal.size + db->journal.pending_len - journal_size;
+    db->batch_changes++;
+    db->batch_bytes += bytes;
+    event_log_end(change_events[op], start, 1, bytes);
+}
+
+void database_set_change_func(Database* db, DatabaseChangeFunc func, void* user_data) {
+    db->change_func = func;
+    db->change_data = user_data;
+    db->pending_insert_count = 0;
+}
+
+static void database_flush_inserts(Database* db) {
+    if (db->pending_insert_count > 0) {
+        int count = db->pending_insert_count;
+        db->pending_insert_count = 0;
+        db->change_func(DATABASE_CHANGE_INSERTED, db->pending_insert_index, count, db->change_data);
+    }
+}
+
+// Appends only ever extend the pending range, since any other change flushes it first.
+static void database_notify(Database* db, DatabaseChange change, int index) {
+    if (db->change_func == NULL) {
+        return;
+    }
+    if (change == DATABASE_CHANGE_INSERTED) {
+        if (db->pending_insert_count == 0) {
+            db->pending_insert_index = index;
+        }
+        db->pending_insert_count++;
+        if (db->journal.batch_depth == 0 && !db->loading) {
+            database_flush_inserts(db);
+        }
+        return;
+    }
+    database_flush_inserts(db);
+    db->change_func(change, index, 1, db->change_data);
+}
+
+void database_begin_batch(Database* db) {
+    if (db->journal.batch_depth == 0) {
+        db->batch_start = event_log_start();
+        db->batch_changes = 0;
+        db->batch_bytes = 0;
+    }
+    journal_begin(&db->journal);
+}
+
+void database_end_batch(Database* db) {
+    if (!journal_commit(&db->journal)) {
+        perror("Error writing journal");
+    }
+    if (db->journal.batch_depth == 0) {
+        event_log_end("batch", db->batch_start, db->batch_changes, db->batch_bytes);
+        database_flush_inserts(db);
+    }
+    database_poll(db);
+}
+
+// Folds the journal into the base file right away.
+static void database_save_now(Database* db) {
+    // A partly loaded database would overwrite the file with only some of its contacts
+    if (db->journal.batch_depth > 0 || db->loading) {
+        return;
+    }
+    database_wait_compaction(db);
+    db->save_pending = 0;
+    struct DatabaseCompaction* job = compaction_new(db);
+    if (job) {
+        compaction_write(job);
+        compaction_finish(db, job);
+    }
+}
+
+// Saves requested within the save window of the previous one are deferred and
+// coalesced into a single write by database_poll or database_close. The
+// journal already holds the changes, so deferring costs no durability.
+void database_save(Database* db) {
+    db->save_stats.requests++;
+    if (monotonic_ms() - db->last_save_ms < db->save_window_ms) {
+        db->save_stats.coalesced++;
+        db->save_pending = 1;
+        return;
+    }
+    database_save_now(db);
+}
+
+void database_set_save_window(Database* db, int save_window_ms) {
+    db->save_window_ms = save_window_ms;
+}
+
+void database_poll(Database* db) {
+    if (db->loading) {
+        return;
+    }
+    database_maybe_compact(db);
+    if (db->save_pending && monotonic_ms() - db->last_save_ms >= db->save_window_ms) {
+        database_save_now(db);
+    }
+}
+
+const DatabaseSaveStats* database_get_save_stats(Database* db) {
+    return &db->save_stats;
+}
+
+static int file_checksum(const char* path, uint64_t* size, uint64_t* checksum) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    char buffer[65536];
+    ssize_t n;
+    *size = 0;
+    *checksum = JOURNAL_CHECKSUM_INIT;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        *checksum = journal_checksum(*checksum, buffer, n);
+        *size += n;
+    }
+    close(fd);
+    return n == 0;
+}
+
+static int database_find_exact(Database* db, const Contact* fields);
+static Contact* database_replace_at(Database* db, int i, const Contact* fields);
+static void database_remove_at(Database* db, int i);
+
+// Whether offset is one of the ascending record offsets
+static int is_record_offset(const uint64_t* offsets, size_t count, uint64_t offset) {
+    size_t low = 0, high = count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (offsets[mid] < offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low < count && offsets[low] == offset;
+}
+
+static void database_replay_journal(Database* db) {
+    EventLogTime event_start = event_log_start();
+    uint64_t size;
+    char* data = journal_load(&db->journal, &size);
+    if (data == NULL) {
+        return;
+    }
+
+    // A checkpoint matching the base file means a compaction already folded the records before it in
+    uint64_t start = 0;
+    uint64_t pos = 0;
+    int base_known = 0;
+    uint64_t base_size = 0, base_checksum = 0;
+    // Where each record seen so far starts, ascending; a checkpoint's offset must be one of them
+    uint64_t* offsets = NULL;
+    size_t offset_count = 0, offset_capacity = 0;
+    JournalRecord record;
+    while (journal_next(data, size, &pos, &record)) {
+        if (offset_count == offset_capacity) {
+            offset_capacity = offset_capacity ? offset_capacity * 2 : 1024;
+            offsets = realloc(offsets, sizeof(uint64_t) * offset_capacity);
+        }
+        offsets[offset_count++] = record.offset;
+        if (record.op != JOURNAL_OP_CHECKPOINT) {
+            continue;
+        }
+        if (!base_known) {
+            base_known = file_checksum(db->filename, &base_size, &base_checksum) ? 1 : -1;
+        }
+        if (base_known == 1 && record.base_size == base_size && record.base_checksum == base_checksum &&
+            is_record_offset(offsets, offset_count, record.journal_offset)) {
+            start = record.journal_offset;
+        }
+    }
+    free(offsets);
+
+    pos = start;
+    int applied = 0;
+    while (journal_next(data, size, &pos, &record)) {
+        int i;
+        switch (record.op) {
+            case JOURNAL_OP_ADD:
+                database_append(db, contact_arena_alloc(&db->arena, &record.new_fields));
+                database_notify(db, DATABASE_CHANGE_INSERTED, db->count - 1);
+                break;
+            case JOURNAL_OP_UPDATE:
+                i = database_find_exact(db, &record.old_fields);
+                if (i >= 0) {
+                    database_replace_at(db, i, &record.new_fields);
+                    database_notify(db, DATABASE_CHANGE_UPDATED, i);
+                }
+                break;
+            case JOURNAL_OP_DELETE:
+                i = database_find_exact(db, &record.old_fields);
+                if (i >= 0) {
+                    database_remove_at(db, i);
+                    database_notify(db, DATABASE_CHANGE_REMOVED, i);
+                }
+                break;
+            case JOURNAL_OP_CHECKPOINT:
+                continue;
+        }
+        applied++;
+    }
+    db->dirty = applied > 0;
+    free(data);
+    event_log_end("replay", event_start, applied, size);
+}
+
+static Contact* database_update_at(Database* db, int i, const Contact* fields);
+
+int database_import_policy_parse(const char* name, DatabaseImportPolicy* policy) {
+    static const char* names[] = {"skip", "overwrite", "merge", "append"};
+    for (int i = 0; i < 4; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *policy = (DatabaseImportPolicy)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void database_import_begin(Database* db, DatabaseImport* import, DatabaseImportPolicy policy) {
+    import->policy = policy;
+    memset(&import->stats, 0, sizeof(import->stats));
+    contact_dedup_init(&import->dedup, policy == DATABASE_IMPORT_APPEND ? 0 : db->count);
+    if (policy != DATABASE_IMPORT_APPEND) {
+        static const ContactField keyed[] = {CONTACT_FIELD_NAME, CONTACT_FIELD_EMAIL, CONTACT_FIELD_PHONE};
+        for (int k = 0; k < 3; k++) {
+            contact_dedup_add_column(&import->dedup, keyed[k], database_column(db, keyed[k]));
+        }
+    }
+}
+
+void database_import_end(DatabaseImport* import) {
+    contact_dedup_free(&import->dedup);
+}
+
+static const char* import_field(DatabaseImportPolicy policy, const char* existing, const char* card) {
+    if (policy == DATABASE_IMPORT_OVERWRITE) {
+        return card[0] ? card : existing;
+    }
+    return existing[0] ? existing : card;
+}
+
+// Merge stage of the vCard reader. Each chunk is committed as one journal
+// batch, so a large import neither holds its whole journal in memory nor
+// syncs per contact. Cards are checked against the existing contacts and the
+// ones imported before them.
+void database_import_cards(Database* db, DatabaseImport* import, const Contact* cards, size_t count) {
+    database_begin_batch(db);
+    for (size_t k = 0; k < count; k++) {
+        const Contact* card = &cards[k];
+        if (import->policy == DATABASE_IMPORT_APPEND) {
+            database_add_record(db, card);
+            import->stats.added++;
+            continue;
+        }
+        int i = contact_dedup_find(&import->dedup, db->contacts, card);
+        if (i < 0) {
+            database_add_record(db, card);
+            contact_dedup_add(&import->dedup, card, db->count - 1);
+            import->stats.added++;
+            continue;
+        }
+        Contact* existing = db->contacts[i];
+        Contact fields;
+        int changed = 0;
+        for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+            fields.fields[f] = (char*)import_field(import->policy, existing->fields[f], card->fields[f]);
+            changed |= strcmp(fields.fields[f], existing->fields[f]) != 0;
+        }
+        if (import->policy == DATABASE_IMPORT_SKIP || !changed) {
+            import->stats.skipped++;
+            continue;
+        }
+        // The new keys join the stale ones, which lookups recognize and pass over
+        contact_dedup_add(&import->dedup, database_update_at(db, i, &fields), i);
+        if (import->policy == DATABASE_IMPORT_OVERWRITE) {
+            import->stats.overwritten++;
+        } else {
+            import->stats.merged++;
+        }
+    }
+    database_end_batch(db);
+}
+
+typedef struct {
+    Database* db;
+    DatabaseImport import;
+} DatabaseImportRun;
+
+static int database_import_batch(const Contact* cards, size_t count, void* user_data) {
+    DatabaseImportRun* run = user_data;
+    database_import_cards(run->db, &run->import, cards, count);
+    return 1;
+}
+
+int database_import(Database* db, const char* filepath, DatabaseImportPolicy policy, DatabaseImportStats* import_stats,
+                    VCardReadStats* read_stats) {
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) {
+        perror("Error opening import file");
+        return 0;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    EventLogTime start = event_log_start();
+    VCardReadStats stats;
+    if (read_stats == NULL) {
+        read_stats = &stats;
+    }
+    DatabaseImportRun run;
+    run.db = db;
+    database_import_begin(db, &run.import, policy);
+    int ok = vcard_read(fd, 0, database_import_batch, &run, read_stats);
+    if (!ok) {
+        perror("Error reading import file");
+    }
+    close(fd);
+    event_log_end("import", start, read_stats->cards, read_stats->bytes);
+    if (import_stats) {
+        *import_stats = run.import.stats;
+    }
+    database_import_end(&run.import);
+    return ok;
+}
+
+int database_export(Database* db, const char* filepath, VCardVersion version) {
+    return database_export_contacts(db->contacts, db->count, filepath, version, NULL, NULL);
+}
+
+int database_export_contacts(Contact** contacts, int count, const char* filepath, VCardVersion version,
+                             DatabaseProgressFunc progress, void* user_data) {
+    int fd = open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("Error opening export file");
+        return 0;
+    }
+    EventLogTime start = event_log_start();
+    int ok = 1;
+    int cancelled = 0;
+    for (int first = 0; first < count && ok && !cancelled; first += DATABASE_EXPORT_RUN) {
+        int run = count - first < DATABASE_EXPORT_RUN ? count - first : DATABASE_EXPORT_RUN;
+        ok = vcard_write(fd, contacts + first, run, version);
+        cancelled = progress && !progress((double)(first + run) / count, user_data);
+    }
+    event_log_end("export", start, count, lseek(fd, 0, SEEK_CUR));
+    if (close(fd) != 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        perror("Error writing export file");
+    }
+    if (cancelled) {
+        unlink(filepath);
+        return 0;
+    }
+    return ok;
+}
+
+Database* database_new_unloaded(const char* filename) {
     Database* db = malloc(sizeof(Database));
     db->filename = strdup(filename);
+    db->format = DATABASE_FORMAT_CSV;
+    db->dirty = 0;
     db->count = 0;
     db->capacity = 10;
     db->contacts = malloc(sizeof(Contact*) * db->capacity);
-    database_load(db);
+    hash_index_init(&db->name_index);
+    db->name_index_built = 0;
+    sorted_index_init(&db->sorted_names);
+    db->sorted_names_built = 0;
+    search_index_init(&db->search_index);
+    db->search_index_built = 0;
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        contact_column_init(&db->columns[f]);
+        db->column_built[f] = 0;
+    }
+    contact_arena_init(&db->arena);
+    db->map = NULL;
+    db->map_size = 0;
+    db->map_is_heap = 0;
+    db->compaction = NULL;
+    // Raised to half the base file once it is loaded
+    db->compact_threshold = DATABASE_COMPACT_MIN_BYTES;
+    db->save_window_ms = DATABASE_DEFAULT_SAVE_WINDOW_MS;
+    db->last_save_ms = -1e12;
+    db->save_pending = 0;
+    memset(&db->save_stats, 0, sizeof(db->save_stats));
+    db->loading = 1;
+    db->change_func = NULL;
+    db->change_data = NULL;
+    db->pending_insert_index = 0;
+    db->pending_insert_count = 0;
+    char* journal_path = malloc(strlen(filename) + 9);
+    sprintf(journal_path, "%s.journal", filename);
+    journal_init(&db->journal, journal_path);
+    free(journal_path);
+
+    // A compaction that never got renamed into place is superseded by the journal
+    char* compact_path = malloc(strlen(filename) + 9);
+    sprintf(compact_path, "%s.compact", filename);
+    unlink(compact_path);
+    free(compact_path);
+    return db;
+}
+
+Database* database_new(const char* filename) {
+    Database* db = database_new_unloaded(filename);
+    database_load(db, 0, NULL, NULL);
+    database_finish_load(db);
     return db;
 }
 
+void database_add_loaded(Database* db, Contact** contacts, int count) {
+    for (int i = 0; i < count; i++) {
+        database_append(db, contacts[i]);
+        database_notify(db, DATABASE_CHANGE_INSERTED, db->count - 1);
+    }
+    database_flush_inserts(db);
+}
+
+void database_finish_load(Database* db) {
+    db->compact_threshold = db->map_size / 2 > DATABASE_COMPACT_MIN_BYTES ? db->map_size / 2 : DATABASE_COMPACT_MIN_BYTES;
+    database_replay_journal(db);
+    db->loading = 0;
+    database_flush_inserts(db);
+}
+
 void database_close(Database* db) {
-    database_save(db);
-    for (int i = 0; i < db->count; i++) {
-        free(db->contacts[i]->name);
-        free(db->contacts[i]->phone);
-        free(db->contacts[i]->email);
-        free(db->contacts[i]);
+    while (db->journal.batch_depth > 0) {
+        database_end_batch(db);
+    }
+    database_wait_compaction(db);
+    if (!db->loading && (db->dirty || db->save_pending || db->journal.size > 0)) {
+        database_save_now(db);
     }
+    journal_free(&db->journal);
+    // Every contact lives in the arena, so this releases the whole store block by block
+    contact_arena_destroy(&db->arena);
+    database_unmap_file(db);
     free(db->contacts);
+    hash_index_free(&db->name_index);
+    sorted_index_free(&db->sorted_names);
+    search_index_free(&db->search_index);
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        contact_column_free(&db->columns[f]);
+    }
     free(db->filename);
     free(db);
 }
 
-int database_add_contact(Database* db, Contact* contact) {
-    if (db->count == db->capacity) {
-        db->capacity *= 2;
-        db->contacts = realloc(db->contacts, sizeof(Contact*) * db->capacity);
-    }
-    db->contacts[db->count++] = contact;
-    return 1;
+Contact* database_add_record(Database* db, const Contact* fields) {
+    database_log(db, JOURNAL_OP_ADD, NULL, fields);
+    Contact* contact = database_append(db, contact_arena_alloc(&db->arena, fields));
+    database_notify(db, DATABASE_CHANGE_INSERTED, db->count - 1);
+    database_poll(db);
+    return contact;
+}
+
+Contact* database_add_contact(Database* db, const char* name, const char* phone, const char* email) {
+    Contact fields;
+    contact_clear(&fields);
+    fields.name = (char*)name;
+    fields.phone = (char*)phone;
+    fields.email = (char*)email;
+    return database_add_record(db, &fields);
 }
 
 Contact* database_get_contact(Database* db, const char* name) {
-    for (int i = 0; i < db->count; i++) {
-        if (strcmp(db->contacts[i]->name, name) == 0) {
-            return db->contacts[i];
+    int i = hash_index_find(database_name_index(db), name);
+    return i >= 0 ? db->contacts[i] : NULL;
+}
+
+static int database_index_of(Database* db, Contact* contact) {
+    HashIndex* index = database_name_index(db);
+    HashIndexIter iter;
+    for (int i = hash_index_first(index, contact->name, &iter); i != -1; i = hash_index_next(index, contact->name, &iter)) {
+        if (db->contacts[i] == contact) {
+            return i;
         }
     }
-    return NULL;
+    return -1;
 }
 
-int database_del_contact(Database* db, const char* name) {
-    for (int i = 0; i < db->count; i++) {
-        if (strcmp(db->contacts[i]->name, name) == 0) {
-            free(db->contacts[i]->name);
-            free(db->contacts[i]->phone);
-            free(db->contacts[i]->email);
-            free(db->contacts[i]);
-            db->count--;
-            if (i < db->count) {
-                db->contacts[i] = db->contacts[db->count];
-            }
-            return 1;
+// Journal records identify contacts by all their fields, so replay picks the same one even among duplicate names.
+static int database_find_exact(Database* db, const Contact* fields) {
+    HashIndex* index = database_name_index(db);
+    HashIndexIter iter;
+    for (int i = hash_index_first(index, fields->name, &iter); i != -1; i = hash_index_next(index, fields->name, &iter)) {
+        int f = 1;
+        while (f < CONTACT_FIELD_COUNT && strcmp(db->contacts[i]->fields[f], fields->fields[f]) == 0) {
+            f++;
+        }
+        if (f == CONTACT_FIELD_COUNT) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static Contact* database_replace_at(Database* db, int i, const Contact* fields) {
+    HashIndex* index = database_name_index(db);
+    Contact* contact = db->contacts[i];
+    // Allocate the replacement before releasing the old slot: the new values may alias the old ones
+    Contact* updated = contact_arena_alloc(&db->arena, fields);
+    hash_index_remove(index, contact->name, i);
+    if (db->sorted_names_built) {
+        sorted_index_remove(&db->sorted_names, contact->name);
+        sorted_index_insert(&db->sorted_names, updated->name);
+    }
+    if (db->search_index_built) {
+        search_index_remove(&db->search_index, i);
+        search_index_add(&db->search_index, updated, i);
+    }
+    database_set_columns(db, i, updated);
+    contact_arena_free(&db->arena, contact);
+    hash_index_insert(index, updated->name, i);
+    db->contacts[i] = updated;
+    return updated;
+}
+
+static void database_remove_at(Database* db, int i) {
+    HashIndex* index = database_name_index(db);
+    Contact* contact = db->contacts[i];
+    hash_index_remove(index, contact->name, i);
+    if (db->sorted_names_built) {
+        sorted_index_remove(&db->sorted_names, contact->name);
+    }
+    if (db->search_index_built) {
+        search_index_remove(&db->search_index, i);
+    }
+    contact_arena_free(&db->arena, contact);
+    db->count--;
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        if (db->column_built[f]) {
+            // The last value fills the hole, as the last contact does below
+            contact_column_move(&db->columns[f], db->count, i);
+            contact_column_clear(&db->columns[f], db->count);
+        }
+    }
+    if (i < db->count) {
+        // Fill the hole with the last contact and repoint its index entries
+        db->contacts[i] = db->contacts[db->count];
+        hash_index_set_value(index, db->contacts[i]->name, db->count, i);
+        if (db->search_index_built) {
+            search_index_move(&db->search_index, db->count, i);
         }
     }
-    return 0;
+}
+
+static Contact* database_update_at(Database* db, int i, const Contact* fields) {
+    database_log(db, JOURNAL_OP_UPDATE, db->contacts[i], fields);
+    Contact* updated = database_replace_at(db, i, fields);
+    database_notify(db, DATABASE_CHANGE_UPDATED, i);
+    database_poll(db);
+    return updated;
+}
+
+Contact* database_update_record(Database* db, Contact* contact, const Contact* fields) {
+    int i = database_index_of(db, contact);
+    if (i < 0) {
+        return NULL;
+    }
+    return database_update_at(db, i, fields);
+}
+
+Contact* database_update_contact(Database* db, Contact* contact, const char* name, const char* phone, const char* email) {
+    Contact fields = *contact;
+    fields.name = (char*)name;
+    fields.phone = (char*)phone;
+    fields.email = (char*)email;
+    return database_update_record(db, contact, &fields);
+}
+
+int database_del_contact(Database* db, const char* name) {
+    int i = hash_index_find(database_name_index(db), name);
+    if (i < 0) {
+        return 0;
+    }
+    database_log(db, JOURNAL_OP_DELETE, db->contacts[i], NULL);
+    database_remove_at(db, i);
+    database_notify(db, DATABASE_CHANGE_REMOVED, i);
+    database_poll(db);
+    return 1;
 }
 
 Contact** database_list_contacts(Database* db, int* count) {
     *count = db->count;
     return db->contacts;
-}
\ No newline at end of file
+}
+
+void database_build_search_index(Database* db) {
+    if (!db->search_index_built) {
+        for (int i = 0; i < db->count; i++) {
+            search_index_add(&db->search_index, db->contacts[i], i);
+        }
+        db->search_index_built = 1;
+    }
+}
+
+int* database_search(Database* db, const char* query, int* count, SearchChange* change) {
+    database_build_search_index(db);
+    EventLogTime start = event_log_start();
+    uint32_t match_count;
+    uint32_t* ids = search_index_query(&db->search_index, query, &match_count, change);
+    event_log_end("search", start, match_count, 0);
+    *count = match_count;
+    // Positions fit in an int, like everywhere else in Database
+    return (int*)ids;
+}
+
+void database_set_search_threads(Database* db, int threads) {
+    db->search_index.scan_threads = threads;
+}
+
+int* database_search_shared(Database* db, const char* query, int* count) {
+    if (!db->search_index_built) {
+        *count = 0;
+        return malloc(sizeof(int));
+    }
+    EventLogTime start = event_log_start();
+    uint32_t match_count;
+    uint32_t* ids = search_index_query_shared(&db->search_index, query, &match_count);
+    event_log_end("search", start, match_count, 0);
+    *count = match_count;
+    return (int*)ids;
+}
+
+int database_contact_matches(Database* db, int index, const char* query) {
+    database_build_search_index(db);
+    return search_index_matches(&db->search_index, index, query);
+}
+
+FuzzyMatch* database_search_fuzzy(Database* db, const char* query, int* count) {
+    database_build_search_index(db);
+    EventLogTime start = event_log_start();
+    uint32_t match_count;
+    FuzzyMatch* matches = search_index_query_fuzzy(&db->search_index, query, &match_count);
+    event_log_end("fuzzy_search", start, match_count, 0);
+    *count = match_count;
+    return matches;
+}
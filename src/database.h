@@ -1,27 +1,220 @@
 #ifndef DATABASE_H
 #define DATABASE_H
 
+#include "contact_arena.h"
+#include "contact_column.h"
+#include "contact_dedup.h"
+#include "event_log.h"
+#include "hash_index.h"
+#include "sorted_index.h"
+#include "journal.h"
+#include "search_index.h"
+#include "vcard.h"
+
+// CSV stores hold each contact's name, phone and email as one line. A CSV
+// store saved once some contact has other fields is written as binary.
+typedef enum {
+    DATABASE_FORMAT_CSV,
+    DATABASE_FORMAT_BINARY
+} DatabaseFormat;
+
+#define DATABASE_DEFAULT_SAVE_WINDOW_MS 1000
+#define DATABASE_EXPORT_RUN 8192
+
+// How the contact list changed, reported to the DatabaseChangeFunc
+typedef enum {
+    // Contacts [index, index + count) were appended
+    DATABASE_CHANGE_INSERTED,
+    // The contact at index was edited and now has a new Contact pointer
+    DATABASE_CHANGE_UPDATED,
+    // The contact at index was deleted. Unless it was the last one, the
+    // former last contact now sits at index.
+    DATABASE_CHANGE_REMOVED
+} DatabaseChange;
+
+typedef void (*DatabaseChangeFunc)(DatabaseChange change, int index, int count, void* user_data);
+
+// What an import does with a card that duplicates a contact (see ContactDedup)
+typedef enum {
+    // Keeps the contact as it is
+    DATABASE_IMPORT_SKIP,
+    // Takes the card's fields, keeping the contact's where the card has none
+    DATABASE_IMPORT_OVERWRITE,
+    // Keeps the contact's fields, filling only the empty ones from the card
+    DATABASE_IMPORT_MERGE,
+    // Adds every card without looking for duplicates
+    DATABASE_IMPORT_APPEND
+} DatabaseImportPolicy;
+
+typedef struct {
+    unsigned long added;
+    // Duplicates left unchanged, by the policy or because the card added nothing
+    unsigned long skipped;
+    unsigned long overwritten;
+    unsigned long merged;
+} DatabaseImportStats;
+
+// One import, which may span many calls to database_import_cards
+typedef struct {
+    DatabaseImportPolicy policy;
+    DatabaseImportStats stats;
+    ContactDedup dedup;
+} DatabaseImport;
+
+// Receives a run of contacts read by database_load, and how much of the file
+// has been read. Return 0 to stop loading.
+typedef int (*DatabaseLoadFunc)(Contact** contacts, int count, double fraction, void* user_data);
+
+// Called between runs of a long operation with the fraction done. Return 0 to cancel.
+typedef int (*DatabaseProgressFunc)(double fraction, void* user_data);
+
 typedef struct {
-    char* name;
-    char* phone;
-    char* email;
-} Contact;
+    unsigned long requests;
+    unsigned long writes;
+    // Requests folded into a later write because they fell inside the save window
+    unsigned long coalesced;
+    uint64_t last_bytes;
+    uint64_t total_bytes;
+    double last_ms;
+    double max_ms;
+    double total_ms;
+} DatabaseSaveStats;
 
 typedef struct {
     Contact** contacts;
     int count;
     int capacity;
     char* filename;
+    // Detected on load; saves keep writing the file in the same format, unless it cannot hold every field
+    DatabaseFormat format;
+    int dirty;
+    HashIndex name_index;
+    int name_index_built;
+    // Every contact's name in strcmp order, for completion; built on first use
+    SortedIndex sorted_names;
+    int sorted_names_built;
+    SearchIndex search_index;
+    int search_index_built;
+    // Each field of every contact by position, built on first use and kept up to date from then on
+    ContactColumn columns[CONTACT_FIELD_COUNT];
+    int column_built[CONTACT_FIELD_COUNT];
+    ContactArena arena;
+    // The loaded .db file. Contacts read from it point straight into this
+    // buffer; edited or added contacts get their own copy in the arena.
+    char* map;
+    size_t map_size;
+    int map_is_heap;
+    // Mutations since the base file was written, replayed on open
+    Journal journal;
+    uint64_t compact_threshold;
+    struct DatabaseCompaction* compaction;
+    int save_window_ms;
+    double last_save_ms;
+    int save_pending;
+    DatabaseSaveStats save_stats;
+    // Set until database_finish_load: the database is not saved, and appends are reported in runs
+    int loading;
+    DatabaseChangeFunc change_func;
+    void* change_data;
+    // Appends not yet reported; a batch reports them as one range
+    int pending_insert_index;
+    int pending_insert_count;
+    // The outermost open batch, logged as one event when it ends
+    EventLogTime batch_start;
+    unsigned long batch_changes;
+    uint64_t batch_bytes;
 } Database;
 
 Database* database_new(const char* filename);
+// Opens a database without reading its file, to load it in the background.
+// database_load reads the file, on any thread, and hands the contacts to func
+// in runs of batch_size. The owning thread adds each run with
+// database_add_loaded, then calls database_finish_load to replay the journal.
+// Until then the database must not be modified otherwise.
+Database* database_new_unloaded(const char* filename);
+int database_load(Database* db, int batch_size, DatabaseLoadFunc func, void* user_data);
+void database_add_loaded(Database* db, Contact** contacts, int count);
+void database_finish_load(Database* db);
 void database_close(Database* db);
 void database_save(Database* db);
-void database_import(Database* db, const char* filepath);
-void database_export(Database* db, const char* filepath);
-int database_add_contact(Database* db, Contact* contact);
+void database_set_save_window(Database* db, int save_window_ms);
+// Performs deferred saves and finishes background compactions; call it periodically.
+void database_poll(Database* db);
+const DatabaseSaveStats* database_get_save_stats(Database* db);
+int database_save_as(Database* db, const char* filename, DatabaseFormat format);
+// Reports each change made through the functions below, after it is applied.
+// Appends inside a batch are reported together when it ends. func may be NULL.
+void database_set_change_func(Database* db, DatabaseChangeFunc func, void* user_data);
+// Groups mutations so the journal is written and synced once for the whole batch.
+void database_begin_batch(Database* db);
+void database_end_batch(Database* db);
+// Reads a vCard file with one parser thread per CPU; either stats may be NULL.
+int database_import(Database* db, const char* filepath, DatabaseImportPolicy policy, DatabaseImportStats* import_stats,
+                    VCardReadStats* read_stats);
+// Imports cards read elsewhere (e.g. by vcard_read on another thread), one
+// journal batch per call. database_import_begin indexes the existing contacts
+// for duplicate checks, in O(count), walking their name, email and phone
+// columns. Once database_build_columns has run it only reads the database, so
+// it may run on another thread as long as the database does not change
+// meanwhile.
+void database_import_begin(Database* db, DatabaseImport* import, DatabaseImportPolicy policy);
+void database_import_cards(Database* db, DatabaseImport* import, const Contact* cards, size_t count);
+void database_import_end(DatabaseImport* import);
+// "skip", "overwrite", "merge" or "append"; returns 0 for anything else.
+int database_import_policy_parse(const char* name, DatabaseImportPolicy* policy);
+int database_export(Database* db, const char* filepath, VCardVersion version);
+// Writes contacts in runs of DATABASE_EXPORT_RUN, reporting progress after
+// each; progress may be NULL. Cancelling removes the file and returns 0. Only
+// the contacts are read, so this may run on another thread while they stay alive.
+int database_export_contacts(Contact** contacts, int count, const char* filepath, VCardVersion version,
+                             DatabaseProgressFunc progress, void* user_data);
+// Adds a contact with only a name, phone and email.
+Contact* database_add_contact(Database* db, const char* name, const char* phone, const char* email);
+// Adds a contact with every field of fields, which the database copies.
+Contact* database_add_record(Database* db, const Contact* fields);
 Contact* database_get_contact(Database* db, const char* name);
+// Changes the name, phone and email of a contact, keeping its other fields.
+Contact* database_update_contact(Database* db, Contact* contact, const char* name, const char* phone, const char* email);
+// Replaces every field of a contact with those of fields.
+Contact* database_update_record(Database* db, Contact* contact, const Contact* fields);
 int database_del_contact(Database* db, const char* name);
 Contact** database_list_contacts(Database* db, int* count);
+// Builds the trigram index used by database_search ahead of the first query.
+void database_build_search_index(Database* db);
+// Builds the name index used by database_get_contact and database_del_contact ahead of the first lookup.
+void database_build_name_index(Database* db);
+// Returns every contact's name in strcmp order, e.g. to complete a name from
+// its first letters. Sorted on the first call, in O(count log count); after
+// that each change updates it in place. The names stay valid until the next
+// change.
+const SortedIndex* database_sorted_names(Database* db);
+// Returns one field of every contact, in list order, for scans that only
+// need that field. The column is built on the first call, in O(count), and
+// follows every change after that; its values stay valid until the next one.
+const ContactColumn* database_column(Database* db, ContactField field);
+// Builds every column ahead of the first database_column call.
+void database_build_columns(Database* db);
+// Returns the positions in the contact list of the contacts with query in
+// any of their fields, ignoring case and accents, ascending. A query that
+// looks like a phone number also matches numbers written with other
+// punctuation. Free with
+// free(). change (may be NULL) receives how the result relates to the
+// previous search's.
+int* database_search(Database* db, const char* query, int* count, SearchChange* change);
+// Spreads the searches that scan every contact over this many threads, the
+// caller's included; 0, the default, uses one per online CPU.
+void database_set_search_threads(Database* db, int threads);
+// database_search for concurrent readers: once both indexes are built,
+// database_get_contact, database_list_contacts and this only read the
+// database, so they may run on several threads while nothing modifies it.
+int* database_search_shared(Database* db, const char* query, int* count);
+// Whether the contact at index matches query, as database_search would decide.
+int database_contact_matches(Database* db, int index, const char* query);
+// Typo-tolerant search: the contacts whose name or email has, for each word
+// of query, a word starting within one or two edits of it ("jhon smtih"
+// finds "John Smith"), fewest edits first, then in list order. Free with
+// free(). Builds the search index if needed; once it is built, this only
+// reads the database, like database_search_shared.
+FuzzyMatch* database_search_fuzzy(Database* db, const char* query, int* count);
 
 #endif
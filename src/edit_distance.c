@@ -0,0 +1,52 @@
+#include <string.h>
+#include "edit_distance.h"
+
+void edit_pattern_init(EditPattern* pattern, const char* text, size_t len) {
+    memset(pattern->match, 0, sizeof(pattern->match));
+    for (size_t i = 0; i < len; i++) {
+        pattern->match[(unsigned char)text[i]] |= (uint64_t)1 << i;
+    }
+    pattern->len = len;
+}
+
+int edit_distance_prefix(const EditPattern* pattern, const char* text, size_t len, int max) {
+    size_t m = pattern->len;
+    if (m == 0) {
+        return 0;
+    }
+    uint64_t mask = m == 64 ? UINT64_MAX : ((uint64_t)1 << m) - 1;
+    uint64_t last = (uint64_t)1 << (m - 1);
+    // Vertical differences of +1 and -1 down the current column, which starts as 0, 1, 2... m
+    uint64_t vp = mask, vn = 0;
+    uint64_t prev_match = 0, prev_d0 = 0;
+    int score = (int)m;
+    int best = score;
+    // Past m + max bytes, every prefix is more than max edits away
+    if (len > m + max) {
+        len = m + max;
+    }
+    for (size_t j = 0; j < len; j++) {
+        uint64_t eq = pattern->match[(unsigned char)text[j]];
+        // Cells reached diagonally from two rows and columns back by swapping a pair
+        uint64_t swap = ((~prev_d0 & eq) << 1) & prev_match;
+        uint64_t d0 = ((((eq & vp) + vp) ^ vp) | eq | vn | swap) & mask;
+        uint64_t hp = vn | ~(d0 | vp);
+        uint64_t hn = vp & d0;
+        if (hp & last) {
+            score++;
+        } else if (hn & last) {
+            score--;
+        }
+        // The top row is the prefix length, one more each column
+        hp = (hp << 1) | 1;
+        hn <<= 1;
+        vn = hp & d0;
+        vp = (hn | ~(hp | d0)) & mask;
+        prev_match = eq;
+        prev_d0 = d0;
+        if (score < best) {
+            best = score;
+        }
+    }
+    return best <= max ? best : max + 1;
+}
@@ -0,0 +1,31 @@
+#ifndef EDIT_DISTANCE_H
+#define EDIT_DISTANCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded edit distance between a short pattern and the start of a text,
+// counting insertions, deletions, substitutions and swaps of two adjacent
+// bytes as one edit each, so "jhon" is one edit from "john".
+//
+// Uses Myers' bit-parallel algorithm with Hyyrö's transposition step: each
+// column of the dynamic programming table is held as bit vectors of its
+// vertical differences, one bit per pattern byte, and a text byte updates the
+// whole column in a handful of word operations. Patterns are therefore at
+// most 64 bytes.
+
+#define EDIT_PATTERN_MAX 64
+
+typedef struct {
+    // Bit i of match[c] is set when byte i of the pattern is c
+    uint64_t match[256];
+    size_t len;
+} EditPattern;
+
+// Prepares pattern (len <= EDIT_PATTERN_MAX bytes) for matching.
+void edit_pattern_init(EditPattern* pattern, const char* text, size_t len);
+// The fewest edits turning the pattern into some prefix of text (len bytes),
+// or max + 1 if that takes more than max.
+int edit_distance_prefix(const EditPattern* pattern, const char* text, size_t len, int max);
+
+#endif
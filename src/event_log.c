@@ -0,0 +1,222 @@
+#include "event_log.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Entries per thread; a power of two
+#define EVENT_LOG_RING_SIZE 4096
+#define EVENT_LOG_FLUSH_MS 100
+
+typedef struct {
+    const char* operation;
+    uint64_t start;
+    uint64_t duration;
+    uint64_t count;
+    uint64_t bytes;
+} EventLogEntry;
+
+// Single producer (the thread that owns it), single consumer (the flush
+// thread). head and tail count entries ever written and read, on separate
+// cache lines so the two sides do not contend.
+typedef struct EventLogRing {
+    EventLogEntry entries[EVENT_LOG_RING_SIZE];
+    _Alignas(64) atomic_uint_fast64_t head;
+    atomic_uint_fast64_t dropped;
+    _Alignas(64) atomic_uint_fast64_t tail;
+    // Cleared when the owning thread exits, so another thread can take the ring over
+    atomic_int owned;
+    int id;
+    struct EventLogRing* next;
+} EventLogRing;
+
+static atomic_int enabled;
+// Rings are only ever added to this list and stay allocated for later logs
+static _Atomic(EventLogRing*) rings;
+static atomic_int ring_count;
+static __thread EventLogRing* thread_ring;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+static FILE* log_file;
+static pthread_t flush_thread;
+static pthread_mutex_t flush_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flush_cond;
+static int stopping;
+// CLOCK_REALTIME minus CLOCK_MONOTONIC when the log was opened
+static int64_t realtime_offset;
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void release_ring(void* ring) {
+    atomic_store_explicit(&((EventLogRing*)ring)->owned, 0, memory_order_release);
+}
+
+static void create_ring_key(void) {
+    pthread_key_create(&ring_key, release_ring);
+}
+
+static EventLogRing* event_log_ring(void) {
+    if (thread_ring) {
+        return thread_ring;
+    }
+    pthread_once(&ring_key_once, create_ring_key);
+    for (EventLogRing* ring = atomic_load_explicit(&rings, memory_order_acquire); ring; ring = ring->next) {
+        int unowned = 0;
+        if (atomic_compare_exchange_strong_explicit(&ring->owned, &unowned, 1, memory_order_acquire,
+                                                    memory_order_relaxed)) {
+            thread_ring = ring;
+            break;
+        }
+    }
+    if (thread_ring == NULL) {
+        EventLogRing* ring = calloc(1, sizeof(EventLogRing));
+        atomic_init(&ring->owned, 1);
+        ring->id = atomic_fetch_add(&ring_count, 1) + 1;
+        ring->next = atomic_load_explicit(&rings, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(&rings, &ring->next, ring, memory_order_release,
+                                                      memory_order_relaxed)) {
+        }
+        thread_ring = ring;
+    }
+    pthread_setspecific(ring_key, thread_ring);
+    return thread_ring;
+}
+
+EventLogTime event_log_start(void) {
+    if (!atomic_load_explicit(&enabled, memory_order_relaxed)) {
+        return 0;
+    }
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+void event_log_end(const char* operation, EventLogTime start, uint64_t count, uint64_t bytes) {
+    if (start == 0) {
+        return;
+    }
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    EventLogRing* ring = event_log_ring();
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == EVENT_LOG_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    EventLogEntry* entry = &ring->entries[head & (EVENT_LOG_RING_SIZE - 1)];
+    entry->operation = operation;
+    entry->start = start;
+    entry->duration = now - start;
+    entry->count = count;
+    entry->bytes = bytes;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// --- Flushing ---
+
+static void write_event(int thread, const char* operation, uint64_t start, uint64_t duration, uint64_t count,
+                        uint64_t bytes) {
+    uint64_t wall = start + realtime_offset;
+    time_t seconds = wall / 1000000000;
+    struct tm local;
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime_r(&seconds, &local));
+    fprintf(log_file, "%s.%06lu thread=%d op=%s count=%lu bytes=%lu duration_us=%lu\n", stamp,
+            (unsigned long)(wall % 1000000000 / 1000), thread, operation, (unsigned long)count,
+            (unsigned long)bytes, (unsigned long)(duration / 1000));
+}
+
+static void drain_rings(void) {
+    for (EventLogRing* ring = atomic_load_explicit(&rings, memory_order_acquire); ring; ring = ring->next) {
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for (; tail != head; tail++) {
+            EventLogEntry* entry = &ring->entries[tail & (EVENT_LOG_RING_SIZE - 1)];
+            write_event(ring->id, entry->operation, entry->start, entry->duration, entry->count, entry->bytes);
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        uint64_t dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+        if (dropped > 0) {
+            write_event(ring->id, "dropped", clock_ns(CLOCK_MONOTONIC), 0, dropped, 0);
+        }
+    }
+    fflush(log_file);
+}
+
+static void* flush_main(void* data) {
+    (void)data;
+    pthread_mutex_lock(&flush_mutex);
+    while (!stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += EVENT_LOG_FLUSH_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&flush_cond, &flush_mutex, &deadline);
+        pthread_mutex_unlock(&flush_mutex);
+        drain_rings();
+        pthread_mutex_lock(&flush_mutex);
+    }
+    pthread_mutex_unlock(&flush_mutex);
+    drain_rings();
+    return NULL;
+}
+
+int event_log_open(const char* path) {
+    if (log_file) {
+        return 1;
+    }
+    log_file = fopen(path, "a");
+    if (log_file == NULL) {
+        return 0;
+    }
+    // Left over from a previous log, recorded while it was closing
+    for (EventLogRing* ring = atomic_load_explicit(&rings, memory_order_acquire); ring; ring = ring->next) {
+        atomic_store_explicit(&ring->tail, atomic_load_explicit(&ring->head, memory_order_acquire),
+                              memory_order_release);
+        atomic_store_explicit(&ring->dropped, 0, memory_order_relaxed);
+    }
+    realtime_offset = clock_ns(CLOCK_REALTIME) - clock_ns(CLOCK_MONOTONIC);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&flush_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    stopping = 0;
+    // The flush thread must not take signals a program handles on its own threads, e.g. through a signalfd
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+    int created = pthread_create(&flush_thread, NULL, flush_main, NULL) == 0;
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (!created) {
+        pthread_cond_destroy(&flush_cond);
+        fclose(log_file);
+        log_file = NULL;
+        return 0;
+    }
+    atomic_store(&enabled, 1);
+    return 1;
+}
+
+void event_log_close(void) {
+    if (log_file == NULL) {
+        return;
+    }
+    atomic_store(&enabled, 0);
+    pthread_mutex_lock(&flush_mutex);
+    stopping = 1;
+    pthread_cond_signal(&flush_cond);
+    pthread_mutex_unlock(&flush_mutex);
+    // The flush thread drains the rings once more on its way out
+    pthread_join(flush_thread, NULL);
+    pthread_cond_destroy(&flush_cond);
+    fclose(log_file);
+    log_file = NULL;
+}
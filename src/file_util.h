@@ -0,0 +1,14 @@
+#ifndef FILE_UTIL_H
+#define FILE_UTIL_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+// Writes the whole buffer, retrying short writes and EINTR. Returns 0 on error.
+int file_write_all(int fd, const void* data, size_t size);
+// Like file_write_all for a gather list. The iovec array is consumed.
+int file_writev_all(int fd, struct iovec* iov, int count);
+// Makes a rename or unlink in path's directory durable.
+int file_sync_parent_dir(const char* path);
+
+#endif
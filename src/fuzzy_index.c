@@ -0,0 +1,343 @@
+#include <stdlib.h>
+#include <string.h>
+#include "edit_distance.h"
+#include "fuzzy_index.h"
+
+#define FUZZY_INDEX_MIN_SLOTS 1024
+#define FUZZY_INDEX_BIGRAMS 65536
+// Query words this long may be one edit away, and from FUZZY_INDEX_TWO_EDITS two
+#define FUZZY_INDEX_ONE_EDIT 4
+#define FUZZY_INDEX_TWO_EDITS 8
+// Longer query words are cut to a pattern's length, and a prefix within
+// FUZZY_INDEX_MAX_DISTANCE edits of them is no longer than this; words are
+// stored only up to it, which changes no result
+#define FUZZY_INDEX_WORD_MAX (EDIT_PATTERN_MAX + FUZZY_INDEX_MAX_DISTANCE)
+// The score of a document missing a query word
+#define FUZZY_INDEX_NO_MATCH UINT8_MAX
+
+// Folded text is lowercase; bytes of multibyte characters count as letters
+static int is_word_byte(char c) {
+    unsigned char u = c;
+    return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || u >= 0x80;
+}
+
+// The first word at or after p, before end, cut to max bytes; NULL if there is none.
+// *next receives where to look for the one after.
+static const char* next_word(const char* p, const char* end, size_t max, size_t* len, const char** next) {
+    while (p < end && !is_word_byte(*p)) {
+        p++;
+    }
+    if (p == end) {
+        return NULL;
+    }
+    const char* word = p;
+    while (p < end && is_word_byte(*p)) {
+        p++;
+    }
+    *len = (size_t)(p - word) < max ? (size_t)(p - word) : max;
+    *next = p;
+    return word;
+}
+
+// The distinct bigrams of a word, ascending; returns how many. Its first byte b counts as bigram (0, b).
+static size_t word_bigrams(const char* word, size_t len, uint16_t* bigrams) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint16_t bigram = (i > 0 ? (unsigned char)word[i - 1] << 8 : 0) | (unsigned char)word[i];
+        size_t j = n;
+        while (j > 0 && bigrams[j - 1] > bigram) {
+            j--;
+        }
+        if (j > 0 && bigrams[j - 1] == bigram) {
+            continue;
+        }
+        memmove(bigrams + j + 1, bigrams + j, sizeof(uint16_t) * (n - j));
+        bigrams[j] = bigram;
+        n++;
+    }
+    return n;
+}
+
+// --- Postings ---
+
+// Adds id, keeping the list ascending and free of duplicates
+static void posting_add(FuzzyPosting* posting, uint32_t id) {
+    size_t low = 0, high = posting->count;
+    // Ids mostly arrive in order, as when the index is built
+    if (high > 0 && posting->ids[high - 1] < id) {
+        low = high;
+    }
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (posting->ids[mid] < id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low < posting->count && posting->ids[low] == id) {
+        return;
+    }
+    if (posting->count == posting->capacity) {
+        posting->capacity = posting->capacity ? posting->capacity * 2 : 4;
+        posting->ids = realloc(posting->ids, sizeof(uint32_t) * posting->capacity);
+    }
+    memmove(posting->ids + low + 1, posting->ids + low, sizeof(uint32_t) * (posting->count - low));
+    posting->ids[low] = id;
+    posting->count++;
+}
+
+static void posting_remove(FuzzyPosting* posting, uint32_t id) {
+    size_t low = 0, high = posting->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (posting->ids[mid] < id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low < posting->count && posting->ids[low] == id) {
+        posting->count--;
+        memmove(posting->ids + low, posting->ids + low + 1, sizeof(uint32_t) * (posting->count - low));
+    }
+}
+
+// --- Words ---
+
+static size_t word_slot_start(const char* word, size_t len, size_t capacity) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)word[i]) * 16777619u;
+    }
+    return hash & (capacity - 1);
+}
+
+// The slot holding the word, or the empty one where it would go
+static size_t word_slot(const FuzzyIndex* index, const char* word, size_t len) {
+    size_t mask = index->slot_capacity - 1;
+    for (size_t pos = word_slot_start(word, len, index->slot_capacity);; pos = (pos + 1) & mask) {
+        uint32_t slot = index->slots[pos];
+        if (slot == 0) {
+            return pos;
+        }
+        const char* other = contact_column_get(&index->words, slot - 1);
+        if (strncmp(other, word, len) == 0 && other[len] == '\0') {
+            return pos;
+        }
+    }
+}
+
+static void grow_slots(FuzzyIndex* index) {
+    free(index->slots);
+    index->slot_capacity *= 2;
+    index->slots = calloc(index->slot_capacity, sizeof(uint32_t));
+    for (uint32_t id = 0; id < index->words.count; id++) {
+        const char* word = contact_column_get(&index->words, id);
+        index->slots[word_slot(index, word, strlen(word))] = id + 1;
+    }
+}
+
+// The word's id, or UINT32_MAX if no document ever had it
+static uint32_t find_word(const FuzzyIndex* index, const char* word, size_t len) {
+    uint32_t slot = index->slots[word_slot(index, word, len)];
+    return slot > 0 ? slot - 1 : UINT32_MAX;
+}
+
+static uint32_t add_word(FuzzyIndex* index, const char* word, size_t len) {
+    size_t pos = word_slot(index, word, len);
+    if (index->slots[pos] > 0) {
+        return index->slots[pos] - 1;
+    }
+    uint32_t id = index->words.count;
+    char copy[FUZZY_INDEX_WORD_MAX + 1];
+    memcpy(copy, word, len);
+    copy[len] = '\0';
+    contact_column_set(&index->words, id, copy);
+    index->slots[pos] = id + 1;
+    if (id == index->documents_capacity) {
+        index->documents_capacity = index->documents_capacity ? index->documents_capacity * 2 : 1024;
+        index->documents = realloc(index->documents, sizeof(FuzzyPosting) * index->documents_capacity);
+    }
+    memset(&index->documents[id], 0, sizeof(FuzzyPosting));
+    uint16_t bigrams[FUZZY_INDEX_WORD_MAX];
+    size_t n = word_bigrams(word, len, bigrams);
+    for (size_t i = 0; i < n; i++) {
+        posting_add(&index->bigrams[bigrams[i]], id);
+    }
+    if ((size_t)(id + 1) * 2 > index->slot_capacity) {
+        grow_slots(index);
+    }
+    return id;
+}
+
+void fuzzy_index_init(FuzzyIndex* index) {
+    memset(index, 0, sizeof(FuzzyIndex));
+    contact_column_init(&index->words);
+    index->bigrams = calloc(FUZZY_INDEX_BIGRAMS, sizeof(FuzzyPosting));
+    index->slot_capacity = FUZZY_INDEX_MIN_SLOTS;
+    index->slots = calloc(index->slot_capacity, sizeof(uint32_t));
+}
+
+void fuzzy_index_free(FuzzyIndex* index) {
+    for (uint32_t id = 0; id < index->words.count; id++) {
+        free(index->documents[id].ids);
+    }
+    for (size_t i = 0; i < FUZZY_INDEX_BIGRAMS; i++) {
+        free(index->bigrams[i].ids);
+    }
+    contact_column_free(&index->words);
+    free(index->documents);
+    free(index->bigrams);
+    free(index->slots);
+    memset(index, 0, sizeof(FuzzyIndex));
+}
+
+void fuzzy_index_add(FuzzyIndex* index, const char* text, size_t len, uint32_t id) {
+    const char* end = text + len;
+    size_t word_len;
+    for (const char* word; (word = next_word(text, end, FUZZY_INDEX_WORD_MAX, &word_len, &text)) != NULL;) {
+        // Adding a word may move the document lists
+        uint32_t word_id = add_word(index, word, word_len);
+        posting_add(&index->documents[word_id], id);
+    }
+    if (id >= index->document_end) {
+        index->document_end = id + 1;
+    }
+}
+
+void fuzzy_index_remove(FuzzyIndex* index, const char* text, size_t len, uint32_t id) {
+    const char* end = text + len;
+    size_t word_len;
+    for (const char* word; (word = next_word(text, end, FUZZY_INDEX_WORD_MAX, &word_len, &text)) != NULL;) {
+        uint32_t word_id = find_word(index, word, word_len);
+        if (word_id != UINT32_MAX) {
+            posting_remove(&index->documents[word_id], id);
+        }
+    }
+}
+
+void fuzzy_index_move(FuzzyIndex* index, const char* text, size_t len, uint32_t from, uint32_t to) {
+    const char* end = text + len;
+    size_t word_len;
+    for (const char* word; (word = next_word(text, end, FUZZY_INDEX_WORD_MAX, &word_len, &text)) != NULL;) {
+        uint32_t word_id = find_word(index, word, word_len);
+        if (word_id != UINT32_MAX) {
+            posting_remove(&index->documents[word_id], from);
+            posting_add(&index->documents[word_id], to);
+        }
+    }
+    if (to >= index->document_end) {
+        index->document_end = to + 1;
+    }
+}
+
+// --- Queries ---
+
+// Lowers scores[id] to the edits from the query word to each document's
+// closest word. counts holds a zero per word, and is left that way.
+static void match_word(const FuzzyIndex* index, const char* word, size_t len, uint8_t* counts, uint32_t* candidates,
+                       uint8_t* scores) {
+    uint16_t bigrams[EDIT_PATTERN_MAX];
+    size_t n = word_bigrams(word, len, bigrams);
+    int max = len >= FUZZY_INDEX_TWO_EDITS ? 2 : len >= FUZZY_INDEX_ONE_EDIT ? 1 : 0;
+    // An edit changes at most three bigrams (swapping bytes i and i + 1
+    // changes those ending at i, i + 1 and i + 2), and a word is only found
+    // through one it shares
+    while (max > 0 && (int)n - 3 * max < 1) {
+        max--;
+    }
+    int needed = (int)n - 3 * max;
+
+    size_t found = 0;
+    for (size_t i = 0; i < n; i++) {
+        const FuzzyPosting* words = &index->bigrams[bigrams[i]];
+        for (uint32_t k = 0; k < words->count; k++) {
+            if (++counts[words->ids[k]] == needed) {
+                candidates[found++] = words->ids[k];
+            }
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        const FuzzyPosting* words = &index->bigrams[bigrams[i]];
+        for (uint32_t k = 0; k < words->count; k++) {
+            counts[words->ids[k]] = 0;
+        }
+    }
+
+    EditPattern pattern;
+    edit_pattern_init(&pattern, word, len);
+    for (size_t c = 0; c < found; c++) {
+        const FuzzyPosting* documents = &index->documents[candidates[c]];
+        if (documents->count == 0) {
+            continue;
+        }
+        const char* text = contact_column_get(&index->words, candidates[c]);
+        int distance = edit_distance_prefix(&pattern, text, strlen(text), max);
+        if (distance > max) {
+            continue;
+        }
+        for (uint32_t k = 0; k < documents->count; k++) {
+            if (scores[documents->ids[k]] > distance) {
+                scores[documents->ids[k]] = distance;
+            }
+        }
+    }
+}
+
+FuzzyMatch* fuzzy_index_query(const FuzzyIndex* index, const char* query, uint32_t* match_count) {
+    uint32_t n = index->document_end;
+    uint32_t word_count = index->words.count;
+    uint8_t* scores = malloc(n + 1);
+    uint8_t* word_scores = malloc(n + 1);
+    uint8_t* counts = calloc(word_count + 1, 1);
+    uint32_t* candidates = malloc(sizeof(uint32_t) * (word_count + 1));
+
+    // Each document's edits summed over the query words so far
+    const char* end = query + strlen(query);
+    size_t len;
+    int words = 0;
+    for (const char* word; words < FUZZY_INDEX_MAX_QUERY_WORDS &&
+                           (word = next_word(query, end, EDIT_PATTERN_MAX, &len, &query)) != NULL;
+         words++) {
+        uint8_t* target = words == 0 ? scores : word_scores;
+        memset(target, FUZZY_INDEX_NO_MATCH, n);
+        match_word(index, word, len, counts, candidates, target);
+        if (words > 0) {
+            for (uint32_t i = 0; i < n; i++) {
+                scores[i] = scores[i] == FUZZY_INDEX_NO_MATCH || word_scores[i] == FUZZY_INDEX_NO_MATCH
+                                ? FUZZY_INDEX_NO_MATCH
+                                : scores[i] + word_scores[i];
+            }
+        }
+    }
+    if (words == 0) {
+        memset(scores, FUZZY_INDEX_NO_MATCH, n);
+    }
+
+    // Counting sort by score, which keeps ids ascending within each
+    uint32_t starts[FUZZY_INDEX_NO_MATCH + 1] = {0};
+    for (uint32_t i = 0; i < n; i++) {
+        starts[scores[i]]++;
+    }
+    uint32_t total = 0;
+    for (int score = 0; score < FUZZY_INDEX_NO_MATCH; score++) {
+        uint32_t count = starts[score];
+        starts[score] = total;
+        total += count;
+    }
+    FuzzyMatch* matches = malloc(sizeof(FuzzyMatch) * (total + 1));
+    for (uint32_t i = 0; i < n; i++) {
+        if (scores[i] != FUZZY_INDEX_NO_MATCH) {
+            FuzzyMatch* match = &matches[starts[scores[i]]++];
+            match->id = i;
+            match->distance = scores[i];
+        }
+    }
+    free(scores);
+    free(word_scores);
+    free(counts);
+    free(candidates);
+    *match_count = total;
+    return matches;
+}
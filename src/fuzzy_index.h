@@ -0,0 +1,67 @@
+#ifndef FUZZY_INDEX_H
+#define FUZZY_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "contact_column.h"
+
+// Typo-tolerant search over the words of folded text (see text_fold.h):
+// runs of letters, split at digits, spaces and punctuation. Documents are
+// identified by number, as in SearchIndex.
+//
+// The index keeps each distinct word once, with the ascending ids of the
+// documents containing it, and maps every bigram of the words, plus each
+// word's first byte alone, to the words containing it. A query word finds the
+// words sharing enough of its bigrams to be within reach, and only those are
+// compared with edit_distance_prefix, so the cost follows the number of
+// similar words rather than the number of documents.
+
+// How many edits a query word may be from the start of a word
+#define FUZZY_INDEX_MAX_DISTANCE 2
+// Query words beyond this many are ignored
+#define FUZZY_INDEX_MAX_QUERY_WORDS 16
+
+typedef struct {
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t* ids;
+} FuzzyPosting;
+
+typedef struct {
+    // Each distinct word by word id. Words stay once no document has them.
+    ContactColumn words;
+    // Documents containing each word, by word id
+    FuzzyPosting* documents;
+    uint32_t documents_capacity;
+    // Words containing each bigram, by its two bytes; a word's first byte b counts as bigram (0, b)
+    FuzzyPosting* bigrams;
+    // Open addressing table of word id + 1, 0 for empty slots
+    uint32_t* slots;
+    size_t slot_capacity;
+    // One past the largest document id ever added
+    uint32_t document_end;
+} FuzzyIndex;
+
+typedef struct {
+    uint32_t id;
+    // Edits summed over the query's words
+    uint32_t distance;
+} FuzzyMatch;
+
+void fuzzy_index_init(FuzzyIndex* index);
+void fuzzy_index_free(FuzzyIndex* index);
+
+// Adds or removes the words of len bytes of folded text for a document; a
+// document may be given several texts.
+void fuzzy_index_add(FuzzyIndex* index, const char* text, size_t len, uint32_t id);
+void fuzzy_index_remove(FuzzyIndex* index, const char* text, size_t len, uint32_t id);
+// Renumbers a document for the words of text.
+void fuzzy_index_move(FuzzyIndex* index, const char* text, size_t len, uint32_t from, uint32_t to);
+
+// Returns the documents in which every word of the folded query is within a
+// few edits of the start of some word, fewest edits first, then by id, in a
+// malloc'ed array. Words of 4 to 7 bytes may be one edit away, longer ones
+// two; shorter words must start a word exactly. Only reads the index.
+FuzzyMatch* fuzzy_index_query(const FuzzyIndex* index, const char* query, uint32_t* match_count);
+
+#endif
@@ -1,30 +1,95 @@
 #include <adwaita.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "config.h"
 #include "database.h"
+#include "event_log.h"
 #include "contact_object.h"
+#include "contact_list_model.h"
 
 // A global pointer to the database instance
 static Database* db;
-// The data store for our list view
-static GListStore* store;
+// Monotonic time at the start of main(), for the time-to-first-frame report
+static gint64 startup_time;
+// The sorted, filtered contacts shown in the list view
+static ContactListModel* contact_model;
 // The selection model to track selected contact
 static GtkSingleSelection* selection;
-// The sort model for the list view
-static GtkSortListModel* sort_model;
+
+// --- Background Loading ---
+// Contacts per run handed from the loader thread to the main loop
+#define LOAD_BATCH_SIZE 5000
+
+typedef struct {
+    Contact** contacts;
+    int count;
+    double fraction;
+} LoadBatch;
+
+// Cancelled on quit; the loader stops at its next run
+static GCancellable* load_cancellable;
+// Runs posted by the loader thread, known once it is done, and runs added so far
+static int load_batches_posted;
+static int load_batches_applied;
+static gboolean load_thread_done;
+
+// --- Background Import and Export ---
+// Merging stops this long into an idle dispatch, leaving the rest of the frame
+// for the list to take in the new rows
+#define IMPORT_DISPATCH_BUDGET_US 4000
+// Parsed runs waiting for the main loop before the reader thread waits too
+#define IMPORT_MAX_QUEUED 4
+
+typedef struct {
+    GStringChunk* strings;
+    Contact* cards;
+    size_t count;
+    size_t merged;
+    double fraction;
+} ImportBatch;
+
+// The operation running in the background, cancelled by the header bar's cancel button
+static GCancellable* operation_cancellable;
+// Runs handed from the import reader thread; import_merge_scheduled is set while an idle source drains them
+static GMutex import_mutex;
+static GCond import_cond;
+static GQueue import_queue = G_QUEUE_INIT;
+static gboolean import_merge_scheduled;
+static gboolean import_thread_done;
+// The running import's duplicate index and counts, and the configured policy
+static DatabaseImport import_state;
+static DatabaseImportPolicy import_policy = DATABASE_IMPORT_MERGE;
+// Set once the window is gone, so finishing an operation leaves the widgets alone
+static gboolean quitting;
+// Set while the search index is built on a worker thread after loading
+static gboolean indexing;
+
+// Shown in place of the header bar title while loading, importing or exporting
+static GtkHeaderBar* header_bar;
+static GtkWidget* progress_box;
+static GtkWidget* progress_bar;
+static GtkWidget* progress_cancel_button;
+// Widgets that would modify the database, disabled while it is loading, importing or exporting
+static GtkWidget* edit_widgets[5];
+static int edit_widget_count;
+static GtkWidget* search_entry_widget;
 
 // Labels for displaying selected contact details
 static GtkWidget* detail_name_label;
 static GtkWidget* detail_phone_label;
 static GtkWidget* detail_email_label;
+// The fields past the basic ones, shown only when set
+static GtkWidget* detail_extra_labels[CONTACT_FIELD_COUNT];
 
 // --- Forward Declarations ---
 static void on_add_clicked(GtkButton* button, gpointer window);
 static void on_edit_clicked(GtkButton* button, gpointer window);
 static void on_del_clicked(GtkButton* button, gpointer window);
-static void on_search_changed(GtkSearchEntry* entry, GtkCustomFilter* filter);
-static gboolean filter_func(gpointer item, gpointer user_data);
+static void on_search_changed(GtkSearchEntry* entry, gpointer user_data);
 static void setup_list_item(GtkListItemFactory* factory, GtkListItem* list_item);
 static void bind_list_item(GtkListItemFactory* factory, GtkListItem* list_item);
-static void populate_store();
 static void show_contact_dialog(GtkWindow* parent, Contact* contact_to_edit);
 static void on_sort_selected(GtkDropDown* dropdown, GParamSpec* pspec);
 static void on_selection_changed(GtkSingleSelection* selection, GParamSpec* pspec);
@@ -35,22 +100,166 @@ static void on_import_clicked(GtkButton* button, gpointer window);
 static void on_export_clicked(GtkButton* button, gpointer window);
 static void on_about_clicked(GtkButton* button, gpointer window);
 static void on_clear_search_clicked(GtkButton* button, GtkSearchEntry* search_entry);
+static void on_cancel_operation_clicked(GtkButton* button, gpointer user_data);
 
 static void on_clear_search_clicked(GtkButton* button, GtkSearchEntry* search_entry) {
     gtk_editable_set_text(GTK_EDITABLE(search_entry), "");
 }
 
+// --- Startup Timing ---
+// Set CONTACT_MANAGER_TIMING to print how long the first frame took to appear.
+static void on_first_frame(GdkFrameClock* frame_clock, gpointer user_data) {
+    g_printerr("Time to first frame: %.1f ms\n", (g_get_monotonic_time() - startup_time) / 1000.0);
+    g_signal_handlers_disconnect_by_func(frame_clock, on_first_frame, user_data);
+}
+
+static void on_window_realize(GtkWidget* window, gpointer user_data) {
+    g_signal_connect(gtk_widget_get_frame_clock(window), "after-paint", G_CALLBACK(on_first_frame), NULL);
+}
+
+static void set_editing_enabled(gboolean enabled) {
+    for (int i = 0; i < edit_widget_count; i++) {
+        gtk_widget_set_sensitive(edit_widgets[i], enabled);
+    }
+}
+
+static void show_progress(const char* text, gboolean cancellable) {
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(progress_bar), text);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress_bar), 0);
+    gtk_widget_set_visible(progress_cancel_button, cancellable);
+    gtk_header_bar_set_title_widget(header_bar, progress_box);
+}
+
+static void hide_progress(void) {
+    gtk_header_bar_set_title_widget(header_bar, NULL);
+}
+
+// Runs on a worker thread while editing is disabled, so nothing changes the contacts under it
+static void build_search_index(GTask* task, gpointer source_object, gpointer task_data, GCancellable* cancellable) {
+    database_build_search_index(db);
+    g_task_return_boolean(task, TRUE);
+}
+
+static void on_search_index_built(GObject* source_object, GAsyncResult* result, gpointer user_data) {
+    indexing = FALSE;
+    if (quitting) {
+        return;
+    }
+    hide_progress();
+    set_editing_enabled(TRUE);
+    gtk_widget_set_sensitive(search_entry_widget, TRUE);
+}
+
+// Runs deferred saves and finishes background compactions while the UI is idle
+static gboolean on_database_poll(gpointer user_data) {
+    database_poll(db);
+    return G_SOURCE_CONTINUE;
+}
+
+// The file is read on a worker thread. Runs of contacts come back through idle
+// sources, so the list fills while the window stays responsive; the journal is
+// replayed once the last run is in.
+static void finish_loading(void) {
+    database_finish_load(db);
+    // Polling any earlier could save or compact a partly loaded database
+    g_timeout_add_seconds(1, on_database_poll, NULL);
+    if (g_getenv("CONTACT_MANAGER_TIMING")) {
+        g_printerr("Loaded %d contacts in %.1f ms\n", db->count, (g_get_monotonic_time() - startup_time) / 1000.0);
+    }
+    // Build the search index now, rather than on the first keystroke, and off
+    // the main loop; editing and searching wait for it
+    show_progress("Indexing contacts", FALSE);
+    indexing = TRUE;
+    GTask* task = g_task_new(NULL, NULL, on_search_index_built, NULL);
+    g_task_run_in_thread(task, build_search_index);
+    g_object_unref(task);
+}
+
+static gboolean on_load_batch(gpointer data) {
+    LoadBatch* batch = data;
+    if (!g_cancellable_is_cancelled(load_cancellable)) {
+        database_add_loaded(db, batch->contacts, batch->count);
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress_bar), batch->fraction);
+    }
+    g_free(batch->contacts);
+    g_free(batch);
+    load_batches_applied++;
+    if (load_thread_done && load_batches_applied == load_batches_posted) {
+        finish_loading();
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Runs on the loader thread; the contacts stay owned by the database's arena
+static int on_contacts_loaded(Contact** contacts, int count, double fraction, void* user_data) {
+    if (g_cancellable_is_cancelled(load_cancellable)) {
+        return 0;
+    }
+    LoadBatch* batch = g_new(LoadBatch, 1);
+    batch->contacts = g_memdup2(contacts, sizeof(Contact*) * count);
+    batch->count = count;
+    batch->fraction = fraction;
+    (*(int*)user_data)++;
+    g_idle_add(on_load_batch, batch);
+    return 1;
+}
+
+static void load_thread(GTask* task, gpointer source_object, gpointer task_data, GCancellable* cancellable) {
+    int posted = 0;
+    database_load(db, LOAD_BATCH_SIZE, on_contacts_loaded, &posted);
+    g_task_return_int(task, posted);
+}
+
+static void on_load_done(GObject* source_object, GAsyncResult* result, gpointer user_data) {
+    load_batches_posted = g_task_propagate_int(G_TASK(result), NULL);
+    load_thread_done = TRUE;
+    if (!g_cancellable_is_cancelled(load_cancellable) && load_batches_applied == load_batches_posted) {
+        finish_loading();
+    }
+}
+
+static void start_loading(void) {
+    load_cancellable = g_cancellable_new();
+    GTask* task = g_task_new(NULL, load_cancellable, on_load_done, NULL);
+    g_task_run_in_thread(task, load_thread);
+    g_object_unref(task);
+}
+
 // --- Main Application Activation ---
 static void on_app_activate(GApplication* app) {
+    // The database is loaded once, into one window
+    GtkWindow* existing = gtk_application_get_active_window(GTK_APPLICATION(app));
+    if (existing) {
+        gtk_window_present(existing);
+        return;
+    }
+
     // Create the main window
     GtkWidget* window = gtk_application_window_new(GTK_APPLICATION(app));
     gtk_window_set_title(GTK_WINDOW(window), "Contact Manager");
     gtk_window_set_default_size(GTK_WINDOW(window), 400, 500);
+    if (g_getenv("CONTACT_MANAGER_TIMING")) {
+        g_signal_connect(window, "realize", G_CALLBACK(on_window_realize), NULL);
+    }
 
     // Create a header bar
     GtkHeaderBar* header = GTK_HEADER_BAR(gtk_header_bar_new());
     gtk_window_set_titlebar(GTK_WINDOW(window), GTK_WIDGET(header));
 
+    // Progress of loading, importing or exporting, shown in place of the title
+    // The box is kept while it is not the title widget
+    header_bar = header;
+    progress_box = g_object_ref_sink(gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6));
+    progress_bar = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(progress_bar), TRUE);
+    gtk_widget_set_valign(progress_bar, GTK_ALIGN_CENTER);
+    gtk_box_append(GTK_BOX(progress_box), progress_bar);
+    progress_cancel_button = gtk_button_new_from_icon_name("process-stop-symbolic");
+    gtk_widget_set_tooltip_text(progress_cancel_button, "Cancel");
+    gtk_box_append(GTK_BOX(progress_box), progress_cancel_button);
+    g_signal_connect(progress_cancel_button, "clicked", G_CALLBACK(on_cancel_operation_clicked), NULL);
+    show_progress("Loading contacts", FALSE);
+
     // Add button
     GtkWidget* add_button = gtk_button_new_from_icon_name("list-add-symbolic");
     gtk_header_bar_pack_start(header, add_button);
@@ -99,11 +308,9 @@ static void on_app_activate(GApplication* app) {
     gtk_window_set_child(GTK_WINDOW(window), vbox);
 
     // --- Search and Filter Setup ---
-    GtkCustomFilter* filter = gtk_custom_filter_new(filter_func, NULL, NULL);
-    GtkFilterListModel* filter_model = gtk_filter_list_model_new(G_LIST_MODEL(store), GTK_FILTER(filter));
-    GtkSorter* sorter = GTK_SORTER(gtk_custom_sorter_new(contact_object_compare, NULL, NULL));
-    sort_model = gtk_sort_list_model_new(G_LIST_MODEL(filter_model), sorter);
-    selection = gtk_single_selection_new(G_LIST_MODEL(sort_model));
+    // The model follows the database's changes itself and creates rows only as they are shown
+    contact_model = contact_list_model_new(db);
+    selection = gtk_single_selection_new(g_object_ref(G_LIST_MODEL(contact_model)));
 
     // Search Entry and Clear Button
     GtkWidget* search_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
@@ -140,9 +347,16 @@ static void on_app_activate(GApplication* app) {
     gtk_widget_set_halign(detail_email_label, GTK_ALIGN_START);
     gtk_box_append(GTK_BOX(details_box), detail_email_label);
 
+    for (int f = CONTACT_BASIC_FIELDS; f < CONTACT_FIELD_COUNT; f++) {
+        detail_extra_labels[f] = gtk_label_new("");
+        gtk_widget_set_halign(detail_extra_labels[f], GTK_ALIGN_START);
+        gtk_widget_set_visible(detail_extra_labels[f], FALSE);
+        gtk_box_append(GTK_BOX(details_box), detail_extra_labels[f]);
+    }
+
     // Connect selection change signal
     g_signal_connect(selection, "notify::selected-item", G_CALLBACK(on_selection_changed), NULL);
-    g_signal_connect(search_entry, "search-changed", G_CALLBACK(on_search_changed), filter);
+    g_signal_connect(search_entry, "search-changed", G_CALLBACK(on_search_changed), NULL);
 
     // --- List View Setup ---
     GtkWidget* scrolled_window = gtk_scrolled_window_new();
@@ -156,37 +370,68 @@ static void on_app_activate(GApplication* app) {
     GtkWidget* list_view = gtk_list_view_new(GTK_SELECTION_MODEL(selection), factory);
     gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scrolled_window), list_view);
 
-    // Populate the store with initial data
-    populate_store();
+    edit_widgets[edit_widget_count++] = add_button;
+    edit_widgets[edit_widget_count++] = edit_button;
+    edit_widgets[edit_widget_count++] = del_button;
+    edit_widgets[edit_widget_count++] = import_button;
+    edit_widgets[edit_widget_count++] = export_button;
+    search_entry_widget = search_entry;
+    set_editing_enabled(FALSE);
+    gtk_widget_set_sensitive(search_entry, FALSE);
 
     gtk_widget_set_visible(window, TRUE);
+    start_loading();
 }
 
 // --- Main Function ---
 int main(int argc, char* argv[]) {
-    db = database_new("contact_manager_gtk.db");
-    store = g_list_store_new(CONTACT_TYPE_OBJECT);
+    startup_time = g_get_monotonic_time();
+    Config config;
+    config_load("contact_manager_gtk.conf", &config);
+    if (!event_log_open(config.logfile)) {
+        g_printerr("Cannot open log file %s\n", config.logfile);
+    }
+    db = database_new_unloaded(config.db_filename);
+    if (db == NULL) {
+        return 1;
+    }
+    database_set_save_window(db, config.save_window_ms);
+    if (!database_import_policy_parse(config.import_policy, &import_policy)) {
+        g_printerr("Unknown import_policy %s, using merge\n", config.import_policy);
+    }
 
     AdwApplication* app = adw_application_new("com.example.contactmanager", G_APPLICATION_DEFAULT_FLAGS);
     g_signal_connect(app, "activate", G_CALLBACK(on_app_activate), NULL);
     int status = g_application_run(G_APPLICATION(app), argc, argv);
 
-    g_object_unref(store);
+    // Quitting mid-import or export: stop it and let it wind down before closing
+    quitting = TRUE;
+    if (operation_cancellable) {
+        on_cancel_operation_clicked(NULL, NULL);
+        while (operation_cancellable) {
+            g_main_context_iteration(NULL, TRUE);
+        }
+    }
+
+    // Quitting mid-load: stop the loader and let it finish before closing; nothing is saved
+    if (load_cancellable) {
+        g_cancellable_cancel(load_cancellable);
+        while (!load_thread_done) {
+            g_main_context_iteration(NULL, TRUE);
+        }
+        g_clear_object(&load_cancellable);
+    }
+    while (indexing) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+    g_clear_object(&contact_model);
     database_close(db);
+    event_log_close();
     return status;
 }
 
 // --- UI Callbacks and Helpers ---
 
-static void populate_store() {
-    g_list_store_remove_all(store);
-    int count;
-    Contact** contacts = database_list_contacts(db, &count);
-    for (int i = 0; i < count; i++) {
-        g_list_store_append(store, contact_object_new(contacts[i]));
-    }
-}
-
 static void setup_list_item(GtkListItemFactory* factory, GtkListItem* list_item) {
     GtkWidget* box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
     gtk_widget_set_margin_start(box, 12);
@@ -249,9 +494,8 @@ static void on_delete_response_cb(GObject* source, GAsyncResult* res, gpointer u
     Contact* contact = user_data;
 
     if (response != NULL && strcmp(response, "delete") == 0) {
+        // The database journals the deletion itself; no full rewrite needed
         database_del_contact(db, contact->name);
-        database_save(db);
-        populate_store();
     }
     // Free the contact data that was strdup'd for the dialog
     free(contact->name);
@@ -291,9 +535,8 @@ static void on_del_clicked(GtkButton* button, gpointer window) {
 // --- Modern AdwMessageDialog for Add/Edit ---
 
 typedef struct {
-    GtkEntry* name_entry;
-    GtkEntry* phone_entry;
-    GtkEntry* email_entry;
+    // One per field, in schema order
+    GtkEntry* entries[CONTACT_FIELD_COUNT];
     Contact* original_contact;
 } DialogWidgets;
 
@@ -302,11 +545,12 @@ static void dialog_response_cb(GObject* source, GAsyncResult* res, gpointer user
     const char* response = adw_message_dialog_choose_finish(ADW_MESSAGE_DIALOG(source), res);
 
     if (response != NULL && strcmp(response, "save") == 0) {
-        const char* name = gtk_editable_get_text(GTK_EDITABLE(widgets->name_entry));
-        const char* phone = gtk_editable_get_text(GTK_EDITABLE(widgets->phone_entry));
-        const char* email = gtk_editable_get_text(GTK_EDITABLE(widgets->email_entry));
+        Contact fields;
+        for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+            fields.fields[f] = (char*)gtk_editable_get_text(GTK_EDITABLE(widgets->entries[f]));
+        }
 
-        if (strlen(name) == 0) {
+        if (strlen(fields.name) == 0) {
             AdwMessageDialog* error_dialog = ADW_MESSAGE_DIALOG(adw_message_dialog_new(GTK_WINDOW(gtk_widget_get_root(GTK_WIDGET(source))),
                                                                     "Error", 
                                                                     "Contact name cannot be empty."));
@@ -320,21 +564,11 @@ static void dialog_response_cb(GObject* source, GAsyncResult* res, gpointer user
         }
 
         if (widgets->original_contact) { // Editing existing contact
-            free(widgets->original_contact->name);
-            free(widgets->original_contact->phone);
-            free(widgets->original_contact->email);
-            widgets->original_contact->name = strdup(name);
-            widgets->original_contact->phone = strdup(phone);
-            widgets->original_contact->email = strdup(email);
+            // Goes through the database so the name index follows the rename
+            database_update_record(db, widgets->original_contact, &fields);
         } else { // Adding new contact
-            Contact* new_contact = malloc(sizeof(Contact));
-            new_contact->name = strdup(name);
-            new_contact->phone = strdup(phone);
-            new_contact->email = strdup(email);
-            database_add_contact(db, new_contact);
+            database_add_record(db, &fields);
         }
-        database_save(db);
-        populate_store();
     }
     g_slice_free(DialogWidgets, widgets);
 }
@@ -348,22 +582,16 @@ static void show_contact_dialog(GtkWindow* parent, Contact* contact_to_edit) {
 
     DialogWidgets* widgets = g_slice_new(DialogWidgets);
     widgets->original_contact = contact_to_edit;
-    widgets->name_entry = GTK_ENTRY(gtk_entry_new());
-    widgets->phone_entry = GTK_ENTRY(gtk_entry_new());
-    widgets->email_entry = GTK_ENTRY(gtk_entry_new());
-
-    if (contact_to_edit) {
-        gtk_editable_set_text(GTK_EDITABLE(widgets->name_entry), contact_to_edit->name);
-        gtk_editable_set_text(GTK_EDITABLE(widgets->phone_entry), contact_to_edit->phone);
-        gtk_editable_set_text(GTK_EDITABLE(widgets->email_entry), contact_to_edit->email);
-    }
-
-    gtk_grid_attach(GTK_GRID(content_grid), gtk_label_new("Name:"), 0, 0, 1, 1);
-    gtk_grid_attach(GTK_GRID(content_grid), GTK_WIDGET(widgets->name_entry), 1, 0, 1, 1);
-    gtk_grid_attach(GTK_GRID(content_grid), gtk_label_new("Phone:"), 0, 1, 1, 1); 
-    gtk_grid_attach(GTK_GRID(content_grid), GTK_WIDGET(widgets->phone_entry), 1, 1, 1, 1);
-    gtk_grid_attach(GTK_GRID(content_grid), gtk_label_new("Email:"), 0, 2, 1, 1);
-    gtk_grid_attach(GTK_GRID(content_grid), GTK_WIDGET(widgets->email_entry), 1, 2, 1, 1);
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        widgets->entries[f] = GTK_ENTRY(gtk_entry_new());
+        if (contact_to_edit) {
+            gtk_editable_set_text(GTK_EDITABLE(widgets->entries[f]), contact_to_edit->fields[f]);
+        }
+        char* label = g_strdup_printf("%s:", contact_fields[f].label);
+        gtk_grid_attach(GTK_GRID(content_grid), gtk_label_new(label), 0, f, 1, 1);
+        gtk_grid_attach(GTK_GRID(content_grid), GTK_WIDGET(widgets->entries[f]), 1, f, 1, 1);
+        g_free(label);
+    }
  
     AdwMessageDialog* dialog = ADW_MESSAGE_DIALOG(adw_message_dialog_new(GTK_WINDOW(parent), title, NULL));
     adw_message_dialog_set_extra_child(dialog, content_grid);
@@ -378,28 +606,13 @@ static void show_contact_dialog(GtkWindow* parent, Contact* contact_to_edit) {
 
 
 // --- Search and Filter Logic ---
-static gchar* search_text = NULL;
-
-static gboolean filter_func(gpointer item, gpointer user_data) {
-    ContactObject* contact_obj = (ContactObject*)item;
-    Contact* contact = contact_object_get_contact(contact_obj);
-
-    if (search_text == NULL || *search_text == '\0') {
-        return TRUE;
-    }
-    return (g_strrstr_len(contact->name, -1, search_text) != NULL);
-}
-
-static void on_search_changed(GtkSearchEntry* entry, GtkCustomFilter* filter) {
-    g_free(search_text);
-    search_text = g_strdup(gtk_editable_get_text(GTK_EDITABLE(entry)));
-    gtk_filter_changed(GTK_FILTER(filter), GTK_FILTER_CHANGE_DIFFERENT);
+static void on_search_changed(GtkSearchEntry* entry, gpointer user_data) {
+    contact_list_model_set_search(contact_model, gtk_editable_get_text(GTK_EDITABLE(entry)));
 }
 
 static void on_sort_selected(GtkDropDown* dropdown, GParamSpec* pspec) {
     guint selected = gtk_drop_down_get_selected(dropdown);
-    contact_object_set_sort_order((ContactSortOrder)selected);
-    gtk_sort_list_model_set_sorter(sort_model, GTK_SORTER(gtk_custom_sorter_new(contact_object_compare, NULL, NULL)));
+    contact_list_model_set_sort_order(contact_model, (ContactSortOrder)selected);
 }
 
 static void on_selection_changed(GtkSingleSelection* selection, GParamSpec* pspec) {
@@ -435,16 +648,213 @@ static void update_detail_view(Contact* contact) {
         gtk_label_set_text(GTK_LABEL(detail_email_label), "<b>Email:</b>");
         gtk_label_set_markup(GTK_LABEL(detail_email_label), "<b>Email:</b>");
     }
+    for (int f = CONTACT_BASIC_FIELDS; f < CONTACT_FIELD_COUNT; f++) {
+        int shown = contact && contact->fields[f][0];
+        if (shown) {
+            char* markup = g_markup_printf_escaped("<b>%s:</b> %s", contact_fields[f].label, contact->fields[f]);
+            gtk_label_set_markup(GTK_LABEL(detail_extra_labels[f]), markup);
+            g_free(markup);
+        }
+        gtk_widget_set_visible(detail_extra_labels[f], shown);
+    }
+}
+
+// Imports and exports run on a worker thread with the header bar showing
+// their progress and a cancel button. An import's cards are parsed off the
+// main loop and merged in idle dispatches that each stop after
+// IMPORT_DISPATCH_BUDGET_US; cancelling keeps what was merged already. An
+// export writes the database's contacts while editing is disabled, so they
+// cannot change or be freed under it; cancelling removes the file.
+static void finish_operation(void) {
+    g_clear_object(&operation_cancellable);
+    if (!quitting) {
+        hide_progress();
+        set_editing_enabled(TRUE);
+    }
+}
+
+static void on_cancel_operation_clicked(GtkButton* button, gpointer user_data) {
+    g_cancellable_cancel(operation_cancellable);
+    // Wake the import reader if it is waiting for the queue to drain
+    g_mutex_lock(&import_mutex);
+    g_cond_broadcast(&import_cond);
+    g_mutex_unlock(&import_mutex);
+}
+
+static void start_operation(const char* text, char* filepath, GTaskThreadFunc thread_func, GAsyncReadyCallback done) {
+    operation_cancellable = g_cancellable_new();
+    set_editing_enabled(FALSE);
+    show_progress(text, TRUE);
+    GTask* task = g_task_new(NULL, operation_cancellable, done, NULL);
+    g_task_set_task_data(task, filepath, g_free);
+    g_task_run_in_thread(task, thread_func);
+    g_object_unref(task);
+}
+
+static void finish_import(void) {
+    DatabaseImportStats stats = import_state.stats;
+    database_import_end(&import_state);
+    finish_operation();
+    if (quitting) {
+        return;
+    }
+    char* body = g_strdup_printf("%lu added, %lu duplicates skipped, %lu overwritten, %lu merged.", stats.added,
+                                 stats.skipped, stats.overwritten, stats.merged);
+    GtkWindow* window = gtk_application_get_active_window(GTK_APPLICATION(g_application_get_default()));
+    AdwMessageDialog* dialog = ADW_MESSAGE_DIALOG(adw_message_dialog_new(window, "Import finished", body));
+    adw_message_dialog_add_response(dialog, "close", "Close");
+    gtk_window_present(GTK_WINDOW(dialog));
+    g_free(body);
+}
+
+static void free_import_batch(ImportBatch* batch) {
+    g_string_chunk_free(batch->strings);
+    g_free(batch->cards);
+    g_free(batch);
+}
+
+static gboolean merge_import_batches(gpointer user_data) {
+    gint64 deadline = g_get_monotonic_time() + IMPORT_DISPATCH_BUDGET_US;
+    gboolean cancelled = g_cancellable_is_cancelled(operation_cancellable);
+    // The appends are reported together at the end of the batch
+    database_begin_batch(db);
+    for (;;) {
+        g_mutex_lock(&import_mutex);
+        ImportBatch* batch = g_queue_peek_head(&import_queue);
+        if (batch == NULL) {
+            import_merge_scheduled = FALSE;
+        }
+        g_mutex_unlock(&import_mutex);
+        if (batch == NULL) {
+            break;
+        }
+        // Checking the clock every few hundred cards keeps its cost out of the loop
+        while (!cancelled && batch->merged < batch->count && g_get_monotonic_time() < deadline) {
+            size_t run = MIN(256, batch->count - batch->merged);
+            database_import_cards(db, &import_state, batch->cards + batch->merged, run);
+            batch->merged += run;
+        }
+        if (!cancelled && batch->merged < batch->count) {
+            database_end_batch(db);
+            return G_SOURCE_CONTINUE;
+        }
+        if (!cancelled) {
+            gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress_bar), batch->fraction);
+        }
+        g_mutex_lock(&import_mutex);
+        g_queue_pop_head(&import_queue);
+        g_cond_broadcast(&import_cond);
+        g_mutex_unlock(&import_mutex);
+        free_import_batch(batch);
+    }
+    database_end_batch(db);
+    if (import_thread_done) {
+        finish_import();
+    }
+    return G_SOURCE_REMOVE;
+}
+
+typedef struct {
+    int fd;
+    off_t size;
+} ImportReader;
+
+// Runs on the import thread; the cards' strings are only valid during the call, so they are copied
+static int on_import_cards(const Contact* cards, size_t count, void* user_data) {
+    ImportReader* reader = user_data;
+    if (g_cancellable_is_cancelled(operation_cancellable)) {
+        return 0;
+    }
+    ImportBatch* batch = g_new0(ImportBatch, 1);
+    batch->strings = g_string_chunk_new(64 * 1024);
+    batch->cards = g_new(Contact, count);
+    for (size_t i = 0; i < count; i++) {
+        for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+            batch->cards[i].fields[f] = g_string_chunk_insert(batch->strings, cards[i].fields[f]);
+        }
+    }
+    batch->count = count;
+    // How far the reader has got, which runs a few chunks ahead of parsing
+    off_t offset = lseek(reader->fd, 0, SEEK_CUR);
+    batch->fraction = reader->size > 0 ? MIN(1.0, (double)offset / reader->size) : 1.0;
+
+    g_mutex_lock(&import_mutex);
+    g_queue_push_tail(&import_queue, batch);
+    if (!import_merge_scheduled) {
+        import_merge_scheduled = TRUE;
+        g_idle_add(merge_import_batches, NULL);
+    }
+    while (import_queue.length >= IMPORT_MAX_QUEUED && !g_cancellable_is_cancelled(operation_cancellable)) {
+        g_cond_wait(&import_cond, &import_mutex);
+    }
+    g_mutex_unlock(&import_mutex);
+    return 1;
+}
+
+static void import_thread(GTask* task, gpointer source_object, gpointer task_data, GCancellable* cancellable) {
+    // Editing is disabled, so the contacts hold still while they are indexed here
+    database_import_begin(db, &import_state, import_policy);
+    ImportReader reader;
+    reader.fd = open(task_data, O_RDONLY);
+    if (reader.fd < 0) {
+        perror("Error opening import file");
+        g_task_return_boolean(task, FALSE);
+        return;
+    }
+    struct stat st;
+    reader.size = fstat(reader.fd, &st) == 0 ? st.st_size : 0;
+    posix_fadvise(reader.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    int ok = vcard_read(reader.fd, 0, on_import_cards, &reader, NULL);
+    if (!ok && !g_cancellable_is_cancelled(cancellable)) {
+        perror("Error reading import file");
+    }
+    close(reader.fd);
+    g_task_return_boolean(task, ok);
+}
+
+static void on_import_done(GObject* source_object, GAsyncResult* result, gpointer user_data) {
+    g_task_propagate_boolean(G_TASK(result), NULL);
+    import_thread_done = TRUE;
+    // Otherwise the merge finishes once the queue is drained
+    g_mutex_lock(&import_mutex);
+    gboolean merging = import_merge_scheduled;
+    g_mutex_unlock(&import_mutex);
+    if (!merging) {
+        finish_import();
+    }
+}
+
+static gboolean on_export_progress_update(gpointer data) {
+    if (operation_cancellable && !quitting) {
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress_bar), GPOINTER_TO_UINT(data) / 1000.0);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Runs on the export thread after each run of contacts
+static int on_export_progress(double fraction, void* user_data) {
+    g_idle_add(on_export_progress_update, GUINT_TO_POINTER((guint)(fraction * 1000)));
+    return !g_cancellable_is_cancelled(operation_cancellable);
+}
+
+static void export_thread(GTask* task, gpointer source_object, gpointer task_data, GCancellable* cancellable) {
+    int ok = database_export_contacts(db->contacts, db->count, task_data, VCARD_VERSION_3, on_export_progress, NULL);
+    g_task_return_boolean(task, ok);
+}
+
+static void on_export_done(GObject* source_object, GAsyncResult* result, gpointer user_data) {
+    g_task_propagate_boolean(G_TASK(result), NULL);
+    finish_operation();
 }
 
 static void on_import_file_chosen(GObject *source_object, GAsyncResult *res, gpointer user_data) {
     GtkFileDialog *dialog = GTK_FILE_DIALOG(source_object);
     GFile *file = gtk_file_dialog_open_finish(dialog, res, NULL);
     if (file) {
-        char *filepath = g_file_get_path(file);
-        database_import(db, filepath);
-        populate_store();
-        g_free(filepath);
+        import_thread_done = FALSE;
+        // import_thread walks the field columns off the main loop, so they must exist first
+        database_build_columns(db);
+        start_operation("Importing contacts", g_file_get_path(file), import_thread, on_import_done);
         g_object_unref(file);
     }
     g_object_unref(dialog);
@@ -454,9 +864,7 @@ static void on_export_file_chosen(GObject *source_object, GAsyncResult *res, gpo
     GtkFileDialog *dialog = GTK_FILE_DIALOG(source_object);
     GFile *file = gtk_file_dialog_save_finish(dialog, res, NULL);
     if (file) {
-        char *filepath = g_file_get_path(file);
-        database_export(db, filepath);
-        g_free(filepath);
+        start_operation("Exporting contacts", g_file_get_path(file), export_thread, on_export_done);
         g_object_unref(file);
     }
     g_object_unref(dialog);
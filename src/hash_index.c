@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <string.h>
+#include "hash_index.h"
+
+#define HASH_INDEX_MIN_CAPACITY 16
+
+// Marks a slot whose entry was removed, so probe sequences running through it stay intact.
+static const char hash_index_tombstone[1];
+#define TOMBSTONE (hash_index_tombstone)
+
+unsigned int hash_index_hash(const char* key) {
+    // 32-bit FNV-1a
+    unsigned int hash = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)key; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int slot_matches(const HashIndexSlot* slot, const char* key, unsigned int hash) {
+    return slot->key != TOMBSTONE && slot->hash == hash && strcmp(slot->key, key) == 0;
+}
+
+static void hash_index_rehash(HashIndex* index, unsigned int capacity) {
+    HashIndexSlot* old_slots = index->slots;
+    unsigned int old_capacity = index->capacity;
+
+    index->slots = calloc(capacity, sizeof(HashIndexSlot));
+    index->capacity = capacity;
+    index->used = index->count;
+
+    for (unsigned int i = 0; i < old_capacity; i++) {
+        HashIndexSlot* slot = &old_slots[i];
+        if (slot->key == NULL || slot->key == TOMBSTONE) {
+            continue;
+        }
+        unsigned int pos = slot->hash & (capacity - 1);
+        while (index->slots[pos].key != NULL) {
+            pos = (pos + 1) & (capacity - 1);
+        }
+        index->slots[pos] = *slot;
+    }
+    free(old_slots);
+}
+
+// Keeps live entries plus tombstones at or below half the table, so every probe ends on an empty slot.
+static void hash_index_grow(HashIndex* index, unsigned int count) {
+    if ((index->used + 1) * 2 <= index->capacity && count * 2 <= index->capacity) {
+        return;
+    }
+    unsigned int capacity = HASH_INDEX_MIN_CAPACITY;
+    while (capacity < count * 4) {
+        capacity *= 2;
+    }
+    if (capacity < index->capacity && count * 2 <= index->capacity) {
+        // Mostly tombstones: clean up in place rather than shrinking
+        capacity = index->capacity;
+    }
+    hash_index_rehash(index, capacity);
+}
+
+void hash_index_init(HashIndex* index) {
+    index->slots = calloc(HASH_INDEX_MIN_CAPACITY, sizeof(HashIndexSlot));
+    index->capacity = HASH_INDEX_MIN_CAPACITY;
+    index->count = 0;
+    index->used = 0;
+}
+
+void hash_index_free(HashIndex* index) {
+    free(index->slots);
+    index->slots = NULL;
+    index->capacity = 0;
+    index->count = 0;
+    index->used = 0;
+}
+
+void hash_index_clear(HashIndex* index) {
+    memset(index->slots, 0, sizeof(HashIndexSlot) * index->capacity);
+    index->count = 0;
+    index->used = 0;
+}
+
+void hash_index_reserve(HashIndex* index, unsigned int count) {
+    hash_index_grow(index, count);
+}
+
+void hash_index_insert(HashIndex* index, const char* key, int value) {
+    hash_index_grow(index, index->count + 1);
+
+    unsigned int hash = hash_index_hash(key);
+    unsigned int mask = index->capacity - 1;
+    unsigned int pos = hash & mask;
+    while (index->slots[pos].key != NULL && index->slots[pos].key != TOMBSTONE) {
+        pos = (pos + 1) & mask;
+    }
+    if (index->slots[pos].key == NULL) {
+        index->used++;
+    }
+    index->slots[pos].key = key;
+    index->slots[pos].hash = hash;
+    index->slots[pos].value = value;
+    index->count++;
+}
+
+int hash_index_first(const HashIndex* index, const char* key, HashIndexIter* iter) {
+    iter->hash = hash_index_hash(key);
+    iter->pos = iter->hash & (index->capacity - 1);
+    return hash_index_next(index, key, iter);
+}
+
+int hash_index_next(const HashIndex* index, const char* key, HashIndexIter* iter) {
+    unsigned int mask = index->capacity - 1;
+    while (index->slots[iter->pos].key != NULL) {
+        const HashIndexSlot* slot = &index->slots[iter->pos];
+        iter->pos = (iter->pos + 1) & mask;
+        if (slot_matches(slot, key, iter->hash)) {
+            return slot->value;
+        }
+    }
+    return -1;
+}
+
+int hash_index_find(const HashIndex* index, const char* key) {
+    HashIndexIter iter;
+    return hash_index_first(index, key, &iter);
+}
+
+static HashIndexSlot* hash_index_find_slot(HashIndex* index, const char* key, int value) {
+    HashIndexIter iter;
+    for (int found = hash_index_first(index, key, &iter); found != -1; found = hash_index_next(index, key, &iter)) {
+        if (found == value) {
+            return &index->slots[(iter.pos - 1) & (index->capacity - 1)];
+        }
+    }
+    return NULL;
+}
+
+int hash_index_remove(HashIndex* index, const char* key, int value) {
+    HashIndexSlot* slot = hash_index_find_slot(index, key, value);
+    if (slot == NULL) {
+        return 0;
+    }
+    slot->key = TOMBSTONE;
+    index->count--;
+    return 1;
+}
+
+int hash_index_set_value(HashIndex* index, const char* key, int old_value, int new_value) {
+    HashIndexSlot* slot = hash_index_find_slot(index, key, old_value);
+    if (slot == NULL) {
+        return 0;
+    }
+    slot->value = new_value;
+    return 1;
+}
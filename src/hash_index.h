@@ -0,0 +1,41 @@
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+// Open-addressing hash index from a string key to an int value (e.g. a
+// position in Database::contacts). Keys are borrowed, not copied: the caller
+// must keep a key alive for as long as it is in the index. Duplicate keys are
+// allowed; lookups return the first entry found along the probe sequence.
+
+typedef struct {
+    const char* key;
+    unsigned int hash;
+    int value;
+} HashIndexSlot;
+
+typedef struct {
+    HashIndexSlot* slots;
+    unsigned int capacity;
+    unsigned int count;
+    unsigned int used;
+} HashIndex;
+
+typedef struct {
+    unsigned int hash;
+    unsigned int pos;
+} HashIndexIter;
+
+unsigned int hash_index_hash(const char* key);
+void hash_index_init(HashIndex* index);
+void hash_index_free(HashIndex* index);
+void hash_index_clear(HashIndex* index);
+void hash_index_reserve(HashIndex* index, unsigned int count);
+void hash_index_insert(HashIndex* index, const char* key, int value);
+int hash_index_find(const HashIndex* index, const char* key);
+int hash_index_remove(HashIndex* index, const char* key, int value);
+int hash_index_set_value(HashIndex* index, const char* key, int old_value, int new_value);
+
+// Walks every entry stored under key. Returns -1 once exhausted.
+int hash_index_first(const HashIndex* index, const char* key, HashIndexIter* iter);
+int hash_index_next(const HashIndex* index, const char* key, HashIndexIter* iter);
+
+#endif
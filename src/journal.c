@@ -0,0 +1,361 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "file_util.h"
+#include "journal.h"
+
+// Record layout: u32 payload length, u32 payload checksum, payload.
+// Payload: u8 op, then the op's fields. Strings are a u32 length followed
+// by the bytes and a NUL, so replay can use them in place.
+//
+// A set of fields is name, phone and email, as the first journals held. With
+// OP_FIELD_COUNT set in the op byte, each set instead starts with a u8 count
+// of the fields that follow in schema order. It is only set for contacts with
+// other fields, so other records stay readable by older versions.
+#define RECORD_HEADER_SIZE 8
+#define OP_FIELD_COUNT 0x80
+
+uint64_t journal_checksum(uint64_t hash, const char* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void journal_init(Journal* journal, const char* path) {
+    journal->path = strdup(path);
+    journal->fd = -1;
+    journal->size = 0;
+    journal->pending = NULL;
+    journal->pending_len = 0;
+    journal->pending_capacity = 0;
+    journal->batch_depth = 0;
+}
+
+void journal_free(Journal* journal) {
+    if (journal->fd >= 0) {
+        close(journal->fd);
+    }
+    free(journal->pending);
+    free(journal->path);
+    journal->fd = -1;
+    journal->path = NULL;
+    journal->pending = NULL;
+}
+
+static char* pending_reserve(Journal* journal, size_t size) {
+    if (journal->pending_len + size > journal->pending_capacity) {
+        size_t capacity = journal->pending_capacity ? journal->pending_capacity : 4096;
+        while (capacity < journal->pending_len + size) {
+            capacity *= 2;
+        }
+        journal->pending = realloc(journal->pending, capacity);
+        journal->pending_capacity = capacity;
+    }
+    char* p = journal->pending + journal->pending_len;
+    journal->pending_len += size;
+    return p;
+}
+
+static void put_u32(char* p, uint32_t value) {
+    memcpy(p, &value, sizeof(value));
+}
+
+static void put_u64(char* p, uint64_t value) {
+    memcpy(p, &value, sizeof(value));
+}
+
+static size_t string_size(const char* s) {
+    return sizeof(uint32_t) + strlen(s) + 1;
+}
+
+static char* put_string(char* p, const char* s) {
+    uint32_t len = strlen(s);
+    put_u32(p, len);
+    memcpy(p + sizeof(uint32_t), s, len + 1);
+    return p + sizeof(uint32_t) + len + 1;
+}
+
+static size_t fields_size(const Contact* fields, int counted) {
+    size_t size = counted ? 1 : 0;
+    for (int f = 0; f < (counted ? CONTACT_FIELD_COUNT : CONTACT_BASIC_FIELDS); f++) {
+        size += string_size(fields->fields[f]);
+    }
+    return size;
+}
+
+static char* put_fields(char* p, const Contact* fields, int counted) {
+    if (counted) {
+        *p++ = (char)CONTACT_FIELD_COUNT;
+    }
+    for (int f = 0; f < (counted ? CONTACT_FIELD_COUNT : CONTACT_BASIC_FIELDS); f++) {
+        p = put_string(p, fields->fields[f]);
+    }
+    return p;
+}
+
+// Writes out the pending batch and syncs it. A failed write is rolled back so the file never ends in a torn record.
+static int journal_flush(Journal* journal) {
+    if (journal->pending_len == 0) {
+        return 1;
+    }
+    if (journal->fd < 0) {
+        journal->fd = open(journal->path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (journal->fd < 0) {
+            return 0;
+        }
+    }
+    int ok = file_write_all(journal->fd, journal->pending, journal->pending_len) && fdatasync(journal->fd) == 0;
+    if (ok) {
+        journal->size += journal->pending_len;
+    } else if (ftruncate(journal->fd, journal->size) != 0) {
+        perror("Error rolling back journal");
+    }
+    journal->pending_len = 0;
+    return ok;
+}
+
+static char* record_begin(Journal* journal, int op, size_t payload_size) {
+    char* record = pending_reserve(journal, RECORD_HEADER_SIZE + 1 + payload_size);
+    put_u32(record, 1 + payload_size);
+    record[RECORD_HEADER_SIZE] = (char)op;
+    return record;
+}
+
+static int record_end(Journal* journal, char* record) {
+    uint32_t payload_size;
+    memcpy(&payload_size, record, sizeof(payload_size));
+    put_u32(record + 4, (uint32_t)journal_checksum(JOURNAL_CHECKSUM_INIT, record + RECORD_HEADER_SIZE, payload_size));
+    return journal->batch_depth > 0 ? 1 : journal_flush(journal);
+}
+
+int journal_append(Journal* journal, JournalOp op, const Contact* old_fields, const Contact* new_fields) {
+    int counted = (old_fields && contact_has_extra_fields(old_fields)) ||
+                  (new_fields && contact_has_extra_fields(new_fields));
+    size_t payload_size = 0;
+    if (old_fields) {
+        payload_size += fields_size(old_fields, counted);
+    }
+    if (new_fields) {
+        payload_size += fields_size(new_fields, counted);
+    }
+    char* record = record_begin(journal, counted ? op | OP_FIELD_COUNT : op, payload_size);
+    char* p = record + RECORD_HEADER_SIZE + 1;
+    if (old_fields) {
+        p = put_fields(p, old_fields, counted);
+    }
+    if (new_fields) {
+        put_fields(p, new_fields, counted);
+    }
+    return record_end(journal, record);
+}
+
+int journal_append_checkpoint(Journal* journal, uint64_t base_size, uint64_t base_checksum, uint64_t journal_offset) {
+    char* record = record_begin(journal, JOURNAL_OP_CHECKPOINT, 3 * sizeof(uint64_t));
+    char* p = record + RECORD_HEADER_SIZE + 1;
+    put_u64(p, base_size);
+    put_u64(p + 8, base_checksum);
+    put_u64(p + 16, journal_offset);
+    return record_end(journal, record);
+}
+
+void journal_begin(Journal* journal) {
+    journal->batch_depth++;
+}
+
+int journal_commit(Journal* journal) {
+    if (journal->batch_depth > 0 && --journal->batch_depth > 0) {
+        return 1;
+    }
+    return journal_flush(journal);
+}
+
+static int get_string(const char** p, const char* end, char** out) {
+    uint32_t len;
+    if (end - *p < (ptrdiff_t)sizeof(uint32_t)) {
+        return 0;
+    }
+    memcpy(&len, *p, sizeof(len));
+    *p += sizeof(uint32_t);
+    if ((uint64_t)(end - *p) < (uint64_t)len + 1 || (*p)[len] != '\0') {
+        return 0;
+    }
+    *out = (char*)*p;
+    *p += len + 1;
+    return 1;
+}
+
+// Fields the record does not hold are left empty, and ones past the schema are skipped.
+static int get_fields(const char** p, const char* end, Contact* fields, int counted) {
+    contact_clear(fields);
+    int count = CONTACT_BASIC_FIELDS;
+    if (counted) {
+        if (*p == end) {
+            return 0;
+        }
+        count = (unsigned char)*(*p)++;
+    }
+    for (int f = 0; f < count; f++) {
+        char* value;
+        if (!get_string(p, end, &value)) {
+            return 0;
+        }
+        if (f < CONTACT_FIELD_COUNT) {
+            fields->fields[f] = value;
+        }
+    }
+    return 1;
+}
+
+int journal_next(const char* data, uint64_t size, uint64_t* pos, JournalRecord* record) {
+    if (*pos > size || size - *pos < RECORD_HEADER_SIZE) {
+        return 0;
+    }
+    uint32_t payload_size, checksum;
+    memcpy(&payload_size, data + *pos, sizeof(payload_size));
+    memcpy(&checksum, data + *pos + 4, sizeof(checksum));
+    const char* payload = data + *pos + RECORD_HEADER_SIZE;
+    if (payload_size == 0 || payload_size > size - *pos - RECORD_HEADER_SIZE ||
+        checksum != (uint32_t)journal_checksum(JOURNAL_CHECKSUM_INIT, payload, payload_size)) {
+        return 0;
+    }
+
+    const char* p = payload + 1;
+    const char* end = payload + payload_size;
+    memset(record, 0, sizeof(JournalRecord));
+    unsigned char op = payload[0];
+    int counted = (op & OP_FIELD_COUNT) != 0;
+    record->op = (JournalOp)(op & ~OP_FIELD_COUNT);
+    record->offset = *pos;
+
+    int ok = 0;
+    switch (record->op) {
+        case JOURNAL_OP_ADD:
+            ok = get_fields(&p, end, &record->new_fields, counted);
+            break;
+        case JOURNAL_OP_UPDATE:
+            ok = get_fields(&p, end, &record->old_fields, counted) &&
+                 get_fields(&p, end, &record->new_fields, counted);
+            break;
+        case JOURNAL_OP_DELETE:
+            ok = get_fields(&p, end, &record->old_fields, counted);
+            break;
+        case JOURNAL_OP_CHECKPOINT:
+            ok = end - p == 3 * sizeof(uint64_t);
+            if (ok) {
+                memcpy(&record->base_size, p, 8);
+                memcpy(&record->base_checksum, p + 8, 8);
+                memcpy(&record->journal_offset, p + 16, 8);
+            }
+            break;
+    }
+    if (!ok) {
+        return 0;
+    }
+    *pos += RECORD_HEADER_SIZE + payload_size;
+    return 1;
+}
+
+char* journal_load(Journal* journal, uint64_t* valid_size) {
+    *valid_size = 0;
+    int fd = open(journal->path, O_RDWR);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    char* data = malloc(st.st_size);
+    uint64_t size = 0;
+    while (size < (uint64_t)st.st_size) {
+        ssize_t n = pread(fd, data + size, st.st_size - size, size);
+        if (n <= 0) {
+            break;
+        }
+        size += n;
+    }
+
+    uint64_t pos = 0;
+    JournalRecord record;
+    while (journal_next(data, size, &pos, &record)) {
+    }
+    if (pos < (uint64_t)st.st_size) {
+        fprintf(stderr, "%s: discarding %llu bytes of incomplete journal records\n", journal->path,
+                (unsigned long long)(st.st_size - pos));
+        if (ftruncate(fd, pos) != 0 || fsync(fd) != 0) {
+            perror("Error truncating journal");
+        }
+    }
+    close(fd);
+
+    journal->size = pos;
+    *valid_size = pos;
+    return data;
+}
+
+int journal_rewrite_from(Journal* journal, uint64_t offset) {
+    uint64_t size;
+    char* data = journal_load(journal, &size);
+
+    // Keep only the data records at or after offset
+    char* kept = malloc(size > offset ? size - offset : 1);
+    size_t kept_len = 0;
+    uint64_t pos = offset < size ? offset : size;
+    JournalRecord record;
+    uint64_t start = pos;
+    while (journal_next(data, size, &pos, &record)) {
+        if (record.op != JOURNAL_OP_CHECKPOINT) {
+            memcpy(kept + kept_len, data + start, pos - start);
+            kept_len += pos - start;
+        }
+        start = pos;
+    }
+    free(data);
+
+    if (kept_len == 0) {
+        free(kept);
+        journal_reset(journal);
+        return 1;
+    }
+
+    char* tmp_path = malloc(strlen(journal->path) + 5);
+    sprintf(tmp_path, "%s.tmp", journal->path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int ok = fd >= 0 && file_write_all(fd, kept, kept_len) && fsync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    ok = ok && rename(tmp_path, journal->path) == 0 && file_sync_parent_dir(journal->path);
+    if (!ok) {
+        unlink(tmp_path);
+    } else {
+        // The old descriptor still refers to the replaced file
+        if (journal->fd >= 0) {
+            close(journal->fd);
+            journal->fd = -1;
+        }
+        journal->size = kept_len;
+    }
+    free(tmp_path);
+    free(kept);
+    return ok;
+}
+
+void journal_reset(Journal* journal) {
+    if (journal->fd >= 0) {
+        close(journal->fd);
+        journal->fd = -1;
+    }
+    if (unlink(journal->path) == 0) {
+        file_sync_parent_dir(journal->path);
+    }
+    journal->size = 0;
+}
@@ -0,0 +1,73 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "contact_arena.h"
+
+// Append-only write-ahead log of contact mutations, stored next to the .db
+// file. Every record is length-prefixed and checksummed, so a record torn by
+// a crash is detected on replay and discarded along with anything after it.
+//
+// A CHECKPOINT record states that the base file with the given size and
+// checksum already contains every record before journal_offset. Replay
+// after a crash uses it to tell whether a compaction reached the base file.
+
+typedef enum {
+    JOURNAL_OP_ADD = 1,
+    JOURNAL_OP_UPDATE = 2,
+    JOURNAL_OP_DELETE = 3,
+    JOURNAL_OP_CHECKPOINT = 4
+} JournalOp;
+
+typedef struct {
+    JournalOp op;
+    uint64_t offset;
+    // ADD: new_fields. UPDATE: old_fields -> new_fields. DELETE: old_fields.
+    // The strings point into the buffer returned by journal_load; fields
+    // the record predates are "".
+    Contact old_fields;
+    Contact new_fields;
+    // CHECKPOINT only
+    uint64_t base_size;
+    uint64_t base_checksum;
+    uint64_t journal_offset;
+} JournalRecord;
+
+typedef struct {
+    char* path;
+    int fd;
+    uint64_t size;
+    // Records of the open batch, written and synced together on commit
+    char* pending;
+    size_t pending_len;
+    size_t pending_capacity;
+    int batch_depth;
+} Journal;
+
+// The file itself is only created by the first append.
+void journal_init(Journal* journal, const char* path);
+void journal_free(Journal* journal);
+
+int journal_append(Journal* journal, JournalOp op, const Contact* old_fields, const Contact* new_fields);
+int journal_append_checkpoint(Journal* journal, uint64_t base_size, uint64_t base_checksum, uint64_t journal_offset);
+
+// Batches nest; only the outermost commit writes and fsyncs.
+void journal_begin(Journal* journal);
+int journal_commit(Journal* journal);
+
+// Reads the journal into memory and returns its length up to the last intact
+// record in *valid_size. The file is truncated to that length.
+char* journal_load(Journal* journal, uint64_t* valid_size);
+int journal_next(const char* data, uint64_t size, uint64_t* pos, JournalRecord* record);
+
+// Drops every record before offset, plus all checkpoints, by atomically replacing the file.
+int journal_rewrite_from(Journal* journal, uint64_t offset);
+// Removes the file once the base holds everything.
+void journal_reset(Journal* journal);
+
+// 64-bit FNV-1a, usable incrementally: start from JOURNAL_CHECKSUM_INIT and feed the data in pieces.
+#define JOURNAL_CHECKSUM_INIT 14695981039346656037ull
+uint64_t journal_checksum(uint64_t hash, const char* data, size_t size);
+
+#endif
@@ -0,0 +1,113 @@
+#include <pthread.h>
+#include <unistd.h>
+#include "scan_pool.h"
+
+typedef struct ScanJob {
+    ScanPoolFunc func;
+    void* data;
+    uint32_t count;
+    uint32_t chunk_size;
+    // Start of the next unclaimed chunk, shared by every thread on the job
+    uint64_t next;
+    // Workers that may still join the job, and those on it now
+    int helpers;
+    int active;
+    struct ScanJob* next_job;
+} ScanJob;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_left = PTHREAD_COND_INITIALIZER;
+// Jobs still open to workers, oldest first
+static ScanJob* jobs;
+static int workers;
+
+static void run_chunks(ScanJob* job) {
+    for (;;) {
+        uint64_t begin = __atomic_fetch_add(&job->next, job->chunk_size, __ATOMIC_RELAXED);
+        if (begin >= job->count) {
+            return;
+        }
+        uint64_t end = begin + job->chunk_size;
+        job->func(begin, end < job->count ? end : job->count, job->data);
+    }
+}
+
+// Closes a job to workers, if it still is open; called with pool_lock held.
+static void unqueue(ScanJob* job) {
+    for (ScanJob** link = &jobs; *link; link = &(*link)->next_job) {
+        if (*link == job) {
+            *link = job->next_job;
+            return;
+        }
+    }
+}
+
+static void* worker_main(void* data) {
+    (void)data;
+    pthread_mutex_lock(&pool_lock);
+    for (;;) {
+        while (jobs == NULL) {
+            pthread_cond_wait(&job_queued, &pool_lock);
+        }
+        ScanJob* job = jobs;
+        if (--job->helpers == 0) {
+            unqueue(job);
+        }
+        job->active++;
+        pthread_mutex_unlock(&pool_lock);
+
+        run_chunks(job);
+
+        pthread_mutex_lock(&pool_lock);
+        if (--job->active == 0) {
+            pthread_cond_broadcast(&job_left);
+        }
+    }
+    return NULL;
+}
+
+void scan_pool_run(uint32_t count, uint32_t chunk_size, int threads, ScanPoolFunc func, void* data) {
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? cpus : 1;
+    }
+    // No more helpers than chunks the caller would leave to them
+    uint32_t chunks = count / chunk_size + (count % chunk_size != 0);
+    int helpers = threads - 1;
+    if ((uint32_t)helpers >= chunks) {
+        helpers = chunks > 0 ? chunks - 1 : 0;
+    }
+    ScanJob job = {func, data, count, chunk_size, 0, helpers, 0, NULL};
+
+    if (helpers > 0) {
+        pthread_mutex_lock(&pool_lock);
+        while (workers < helpers) {
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, worker_main, NULL) != 0) {
+                break;
+            }
+            pthread_detach(thread);
+            workers++;
+        }
+        ScanJob** link = &jobs;
+        while (*link) {
+            link = &(*link)->next_job;
+        }
+        *link = &job;
+        pthread_cond_broadcast(&job_queued);
+        pthread_mutex_unlock(&pool_lock);
+    }
+
+    run_chunks(&job);
+
+    if (helpers > 0) {
+        // Every chunk is claimed; wait for the workers still scanning theirs
+        pthread_mutex_lock(&pool_lock);
+        unqueue(&job);
+        while (job.active > 0) {
+            pthread_cond_wait(&job_left, &pool_lock);
+        }
+        pthread_mutex_unlock(&pool_lock);
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef SCAN_POOL_H
+#define SCAN_POOL_H
+
+#include <stdint.h>
+
+// Splits a scan over positions [0, count) into chunks run on a process-wide
+// pool of worker threads. The calling thread scans chunks too, and the others
+// take the next unclaimed chunk as they finish one, so a slow chunk holds up
+// only the thread scanning it. Workers are started on first use, as many as
+// the largest run has asked for, and then wait for the next run.
+
+// Scans the positions [begin, end)
+typedef void (*ScanPoolFunc)(uint32_t begin, uint32_t end, void* data);
+
+// Calls func for each chunk of chunk_size positions (the last may be shorter)
+// on up to threads threads, the caller's included, and returns once every
+// chunk is done; threads <= 0 uses one per online CPU. Chunks run in no
+// particular order, so func must only write what belongs to its own. Any
+// number of threads may run scans at once; they share the workers.
+void scan_pool_run(uint32_t count, uint32_t chunk_size, int threads, ScanPoolFunc func, void* data);
+
+#endif
@@ -0,0 +1,626 @@
+#include <stdlib.h>
+#include <string.h>
+#include "scan_pool.h"
+#include "search_index.h"
+#include "text_fold.h"
+#include "text_search.h"
+
+#define SEARCH_INDEX_MIN_CAPACITY 1024
+// What a phone number is written with besides its digits, after folding
+#define PHONE_PUNCTUATION " +-()./"
+// Shorter digit runs are left to the text match, which finds them in most numbers anyway
+#define PHONE_QUERY_MIN_DIGITS 3
+// Documents per chunk of a full scan; a multiple of 64, so that each chunk
+// sets its own words of the match bitmap
+#define SEARCH_INDEX_SCAN_CHUNK 16384
+
+// Keys are already folded, so a trigram is just three of their bytes
+static uint32_t trigram_at(const unsigned char* s) {
+    return (uint32_t)s[0] << 16 | (uint32_t)s[1] << 8 | s[2];
+}
+
+static size_t trigram_slot(uint32_t trigram, size_t capacity) {
+    return (trigram * 2654435761u) & (capacity - 1);
+}
+
+// --- Trigram sets ---
+
+typedef struct {
+    uint32_t* items;
+    size_t count;
+    size_t capacity;
+    uint32_t inline_items[128];
+} TrigramSet;
+
+static void trigram_set_init(TrigramSet* set) {
+    set->items = set->inline_items;
+    set->count = 0;
+    set->capacity = sizeof(set->inline_items) / sizeof(uint32_t);
+}
+
+static void trigram_set_free(TrigramSet* set) {
+    if (set->items != set->inline_items) {
+        free(set->items);
+    }
+}
+
+// Adds the trigrams of a folded key, leaving out those that span two fields.
+static void trigram_set_add_key(TrigramSet* set, const char* key) {
+    size_t len = strlen(key);
+    for (size_t i = 0; i + 3 <= len; i++) {
+        if (key[i] == SEARCH_INDEX_FIELD_SEPARATOR || key[i + 1] == SEARCH_INDEX_FIELD_SEPARATOR ||
+            key[i + 2] == SEARCH_INDEX_FIELD_SEPARATOR) {
+            continue;
+        }
+        if (set->count == set->capacity) {
+            set->capacity *= 2;
+            if (set->items == set->inline_items) {
+                set->items = memcpy(malloc(sizeof(uint32_t) * set->capacity), set->inline_items, sizeof(set->inline_items));
+            } else {
+                set->items = realloc(set->items, sizeof(uint32_t) * set->capacity);
+            }
+        }
+        set->items[set->count++] = trigram_at((const unsigned char*)key + i);
+    }
+}
+
+// Sorts and drops duplicates, so a document appears at most once per posting list.
+static void trigram_set_unique(TrigramSet* set) {
+    // Sets are a few dozen trigrams, where insertion sort beats qsort's indirect calls
+    for (size_t i = 1; i < set->count; i++) {
+        uint32_t item = set->items[i];
+        size_t j = i;
+        while (j > 0 && set->items[j - 1] > item) {
+            set->items[j] = set->items[j - 1];
+            j--;
+        }
+        set->items[j] = item;
+    }
+    size_t out = 0;
+    for (size_t i = 0; i < set->count; i++) {
+        if (out == 0 || set->items[out - 1] != set->items[i]) {
+            set->items[out++] = set->items[i];
+        }
+    }
+    set->count = out;
+}
+
+static void trigram_set_of_key(TrigramSet* set, const char* key) {
+    trigram_set_init(set);
+    trigram_set_add_key(set, key);
+    trigram_set_unique(set);
+}
+
+// Folding never lengthens text, so the key fits in the fields' total length plus a separator after each.
+static const char* fold_key(SearchIndex* index, const Contact* contact) {
+    size_t size = 0;
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        size += strlen(contact->fields[f]) + 1;
+    }
+    if (size > index->scratch_size) {
+        index->scratch_size = size * 2;
+        index->scratch = realloc(index->scratch, index->scratch_size);
+    }
+    char* p = index->scratch;
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        if (f > 0) {
+            *p++ = SEARCH_INDEX_FIELD_SEPARATOR;
+        }
+        p += text_fold(contact->fields[f], p);
+    }
+    *p = '\0';
+    return index->scratch;
+}
+
+// The fields of a key that fuzzy queries look at
+static const ContactField fuzzy_fields[] = {CONTACT_FIELD_NAME, CONTACT_FIELD_EMAIL};
+#define FUZZY_FIELD_COUNT (sizeof(fuzzy_fields) / sizeof(fuzzy_fields[0]))
+
+// Field f of a folded key, and its length
+static const char* key_field(const char* key, int f, size_t* len) {
+    for (int i = 0; i < f; i++) {
+        key = strchr(key, SEARCH_INDEX_FIELD_SEPARATOR) + 1;
+    }
+    const char* end = strchr(key, SEARCH_INDEX_FIELD_SEPARATOR);
+    *len = end ? (size_t)(end - key) : strlen(key);
+    return key;
+}
+
+// The digits of each of the contact's phone numbers, separated as the numbers are.
+static const char* phone_digits(SearchIndex* index, const Contact* contact) {
+    char* p = index->scratch;
+    for (const char* c = contact->phone; *c; c++) {
+        if ((*c >= '0' && *c <= '9') || *c == CONTACT_VALUE_SEPARATOR) {
+            *p++ = *c;
+        }
+    }
+    *p = '\0';
+    return index->scratch;
+}
+
+// --- Posting lists ---
+
+static size_t lower_bound(const uint32_t* ids, size_t count, uint32_t id) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ids[mid] < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void posting_insert(SearchPosting* posting, uint32_t id) {
+    if (posting->count == posting->capacity) {
+        posting->capacity = posting->capacity ? posting->capacity * 2 : 4;
+        posting->ids = realloc(posting->ids, sizeof(uint32_t) * posting->capacity);
+    }
+    // New contacts are appended with the highest id, so this is usually a push
+    size_t pos = posting->count;
+    if (pos > 0 && posting->ids[pos - 1] > id) {
+        pos = lower_bound(posting->ids, posting->count, id);
+        memmove(posting->ids + pos + 1, posting->ids + pos, sizeof(uint32_t) * (posting->count - pos));
+    }
+    posting->ids[pos] = id;
+    posting->count++;
+}
+
+static void posting_erase(SearchPosting* posting, uint32_t id) {
+    size_t pos = lower_bound(posting->ids, posting->count, id);
+    if (pos < posting->count && posting->ids[pos] == id) {
+        memmove(posting->ids + pos, posting->ids + pos + 1, sizeof(uint32_t) * (posting->count - pos - 1));
+        posting->count--;
+    }
+}
+
+static SearchPosting* search_index_find(const SearchIndex* index, uint32_t trigram) {
+    size_t pos = trigram_slot(trigram, index->capacity);
+    while (index->slots[pos].trigram != 0) {
+        if (index->slots[pos].trigram == trigram) {
+            return &index->slots[pos];
+        }
+        pos = (pos + 1) & (index->capacity - 1);
+    }
+    return NULL;
+}
+
+static void search_index_grow(SearchIndex* index) {
+    SearchPosting* old_slots = index->slots;
+    size_t old_capacity = index->capacity;
+    index->capacity *= 2;
+    index->slots = calloc(index->capacity, sizeof(SearchPosting));
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_slots[i].trigram != 0) {
+            size_t pos = trigram_slot(old_slots[i].trigram, index->capacity);
+            while (index->slots[pos].trigram != 0) {
+                pos = (pos + 1) & (index->capacity - 1);
+            }
+            index->slots[pos] = old_slots[i];
+        }
+    }
+    free(old_slots);
+}
+
+// Posting lists are never dropped once created, so the table has no tombstones.
+static SearchPosting* search_index_get(SearchIndex* index, uint32_t trigram) {
+    if ((index->used + 1) * 2 > index->capacity) {
+        search_index_grow(index);
+    }
+    size_t pos = trigram_slot(trigram, index->capacity);
+    while (index->slots[pos].trigram != 0) {
+        if (index->slots[pos].trigram == trigram) {
+            return &index->slots[pos];
+        }
+        pos = (pos + 1) & (index->capacity - 1);
+    }
+    index->slots[pos].trigram = trigram;
+    index->used++;
+    return &index->slots[pos];
+}
+
+void search_index_init(SearchIndex* index) {
+    memset(index, 0, sizeof(SearchIndex));
+    index->capacity = SEARCH_INDEX_MIN_CAPACITY;
+    index->slots = calloc(index->capacity, sizeof(SearchPosting));
+    contact_column_init(&index->keys);
+    contact_column_init(&index->digits);
+    fuzzy_index_init(&index->fuzzy);
+}
+
+static void search_index_forget_query(SearchIndex* index) {
+    free(index->last_query);
+    free(index->last_ids);
+    index->last_query = NULL;
+    index->last_ids = NULL;
+    index->last_count = 0;
+}
+
+void search_index_free(SearchIndex* index) {
+    for (size_t i = 0; i < index->capacity; i++) {
+        free(index->slots[i].ids);
+    }
+    contact_column_free(&index->keys);
+    contact_column_free(&index->digits);
+    fuzzy_index_free(&index->fuzzy);
+    search_index_forget_query(index);
+    free(index->slots);
+    free(index->scratch);
+    memset(index, 0, sizeof(SearchIndex));
+}
+
+void search_index_add(SearchIndex* index, const Contact* contact, uint32_t id) {
+    search_index_forget_query(index);
+    const char* key = fold_key(index, contact);
+    contact_column_set(&index->keys, id, key);
+
+    TrigramSet set;
+    trigram_set_of_key(&set, key);
+    for (size_t i = 0; i < set.count; i++) {
+        posting_insert(search_index_get(index, set.items[i]), id);
+    }
+    trigram_set_free(&set);
+    for (size_t f = 0; f < FUZZY_FIELD_COUNT; f++) {
+        size_t len;
+        const char* field = key_field(key, fuzzy_fields[f], &len);
+        fuzzy_index_add(&index->fuzzy, field, len, id);
+    }
+    // The phone field is part of the key, so the scratch is large enough
+    contact_column_set(&index->digits, id, phone_digits(index, contact));
+}
+
+void search_index_remove(SearchIndex* index, uint32_t id) {
+    const char* key = contact_column_get(&index->keys, id);
+    if (key == NULL) {
+        return;
+    }
+    search_index_forget_query(index);
+    TrigramSet set;
+    trigram_set_of_key(&set, key);
+    for (size_t i = 0; i < set.count; i++) {
+        SearchPosting* posting = search_index_find(index, set.items[i]);
+        if (posting) {
+            posting_erase(posting, id);
+        }
+    }
+    trigram_set_free(&set);
+    for (size_t f = 0; f < FUZZY_FIELD_COUNT; f++) {
+        size_t len;
+        const char* field = key_field(key, fuzzy_fields[f], &len);
+        fuzzy_index_remove(&index->fuzzy, field, len, id);
+    }
+    contact_column_clear(&index->keys, id);
+    contact_column_clear(&index->digits, id);
+}
+
+void search_index_move(SearchIndex* index, uint32_t from, uint32_t to) {
+    const char* key = contact_column_get(&index->keys, from);
+    if (key == NULL) {
+        return;
+    }
+    search_index_forget_query(index);
+    TrigramSet set;
+    trigram_set_of_key(&set, key);
+    for (size_t i = 0; i < set.count; i++) {
+        SearchPosting* posting = search_index_find(index, set.items[i]);
+        if (posting) {
+            posting_erase(posting, from);
+            posting_insert(posting, to);
+        }
+    }
+    trigram_set_free(&set);
+    for (size_t f = 0; f < FUZZY_FIELD_COUNT; f++) {
+        size_t len;
+        const char* field = key_field(key, fuzzy_fields[f], &len);
+        fuzzy_index_move(&index->fuzzy, field, len, from, to);
+    }
+    contact_column_move(&index->keys, from, to);
+    contact_column_move(&index->digits, from, to);
+}
+
+// --- Queries ---
+
+static int compare_posting_size(const void* a, const void* b) {
+    uint32_t x = (*(SearchPosting* const*)a)->count, y = (*(SearchPosting* const*)b)->count;
+    return (x > y) - (x < y);
+}
+
+// Keeps the ids that also appear in posting. ids is the shorter list, so each
+// lookup gallops forward through posting instead of walking it.
+static uint32_t intersect(uint32_t* ids, uint32_t count, const SearchPosting* posting) {
+    uint32_t out = 0;
+    size_t pos = 0;
+    for (uint32_t i = 0; i < count && pos < posting->count; i++) {
+        size_t step = 1;
+        size_t hi = pos;
+        while (hi < posting->count && posting->ids[hi] < ids[i]) {
+            pos = hi + 1;
+            hi += step;
+            step *= 2;
+        }
+        if (hi > posting->count) {
+            hi = posting->count;
+        }
+        pos += lower_bound(posting->ids + pos, hi - pos, ids[i]);
+        if (pos < posting->count && posting->ids[pos] == ids[i]) {
+            ids[out++] = ids[i];
+        }
+    }
+    return out;
+}
+
+// A folded query, and its digits when it looks like a phone number
+typedef struct {
+    char* text;
+    size_t len;
+    char* digits;
+    size_t digits_len;
+} SearchQuery;
+
+// The number of digits in a query made only of digits and phone punctuation,
+// enough of them to match on; 0 for any other query. digits (may be NULL)
+// receives them.
+static size_t query_phone_digits(const char* needle, char* digits) {
+    size_t n = 0;
+    for (const char* c = needle; *c; c++) {
+        if (*c >= '0' && *c <= '9') {
+            if (digits) {
+                digits[n] = *c;
+            }
+            n++;
+        } else if (strchr(PHONE_PUNCTUATION, *c) == NULL) {
+            return 0;
+        }
+    }
+    if (digits) {
+        digits[n] = '\0';
+    }
+    return n >= PHONE_QUERY_MIN_DIGITS ? n : 0;
+}
+
+static void query_init(SearchQuery* query, const char* text) {
+    size_t size = strlen(text) + 1;
+    query->text = malloc(size);
+    query->len = text_fold(text, query->text);
+    query->digits = malloc(size);
+    query->digits_len = query_phone_digits(query->text, query->digits);
+}
+
+static void query_free(SearchQuery* query) {
+    free(query->text);
+    free(query->digits);
+}
+
+static int column_contains(const ContactColumn* column, uint32_t id, const char* needle, size_t len) {
+    if (id >= column->count || column->offsets[id] == CONTACT_COLUMN_ABSENT) {
+        return 0;
+    }
+    return text_search_find(column->heap + column->offsets[id], column->heap + column->heap_size, needle, len) != NULL;
+}
+
+// A phone-number query also matches the digits of the phone numbers, so 555-1234 finds (555) 1234.
+static int key_matches(const SearchIndex* index, uint32_t id, const SearchQuery* query) {
+    return column_contains(&index->keys, id, query->text, query->len) ||
+           (query->digits_len > 0 && column_contains(&index->digits, id, query->digits, query->digits_len));
+}
+
+// Merges two ascending id lists into a new one without duplicates, freeing both.
+static uint32_t* merge_ids(uint32_t* a, uint32_t a_count, uint32_t* b, uint32_t b_count, uint32_t* match_count) {
+    uint32_t* ids = malloc(sizeof(uint32_t) * (a_count + b_count + 1));
+    uint32_t n = 0, i = 0, k = 0;
+    while (i < a_count || k < b_count) {
+        if (k == b_count || (i < a_count && a[i] < b[k])) {
+            ids[n++] = a[i++];
+        } else {
+            if (i < a_count && a[i] == b[k]) {
+                i++;
+            }
+            ids[n++] = b[k++];
+        }
+    }
+    free(a);
+    free(b);
+    *match_count = n;
+    return ids;
+}
+
+typedef struct {
+    const SearchIndex* index;
+    const SearchQuery* query;
+    // Whether the keys are scanned, or only the phone digits
+    int text;
+    uint64_t* bits;
+} SearchScan;
+
+static void set_bits(uint64_t* bits, const uint32_t* ids, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        bits[ids[i] / 64] |= (uint64_t)1 << (ids[i] % 64);
+    }
+}
+
+// Marks the chunk's matches in the keys and the digits alike, which merges them
+static void scan_chunk(uint32_t begin, uint32_t end, void* data) {
+    SearchScan* scan = data;
+    const SearchQuery* query = scan->query;
+    uint32_t ids[SEARCH_INDEX_SCAN_CHUNK];
+    if (scan->text) {
+        uint32_t n = contact_column_search_range(&scan->index->keys, begin, end, query->text, query->len, ids);
+        set_bits(scan->bits, ids, n);
+    }
+    if (query->digits_len > 0) {
+        uint32_t n =
+            contact_column_search_range(&scan->index->digits, begin, end, query->digits, query->digits_len, ids);
+        set_bits(scan->bits, ids, n);
+    }
+}
+
+// Checks every document, in chunks scanned in parallel, for the query's text
+// (if text is set) or phone digits.
+static uint32_t* query_scan(const SearchIndex* index, const SearchQuery* query, int text, uint32_t* match_count) {
+    uint32_t count = index->keys.count > index->digits.count ? index->keys.count : index->digits.count;
+    SearchScan scan = {index, query, text, calloc(count / 64 + 1, sizeof(uint64_t))};
+    scan_pool_run(count, SEARCH_INDEX_SCAN_CHUNK, index->scan_threads, scan_chunk, &scan);
+
+    uint32_t* ids = malloc(sizeof(uint32_t) * (count + 1));
+    uint32_t n = 0;
+    for (uint32_t w = 0; w <= count / 64; w++) {
+        for (uint64_t word = scan.bits[w]; word; word &= word - 1) {
+            ids[n++] = w * 64 + __builtin_ctzll(word);
+        }
+    }
+    free(scan.bits);
+    *match_count = n;
+    return ids;
+}
+
+// Matches of the query's text alone, through its trigrams.
+static uint32_t* query_trigrams(const SearchIndex* index, const SearchQuery* query, uint32_t* match_count) {
+    TrigramSet set;
+    trigram_set_of_key(&set, query->text);
+    SearchPosting** postings = malloc(sizeof(SearchPosting*) * (set.count > 0 ? set.count : 1));
+    int missing = 0;
+    for (size_t i = 0; i < set.count; i++) {
+        postings[i] = search_index_find(index, set.items[i]);
+        if (postings[i] == NULL || postings[i]->count == 0) {
+            missing = 1;
+        }
+    }
+
+    uint32_t* ids;
+    uint32_t n = 0;
+    if (missing || set.count == 0) {
+        ids = malloc(sizeof(uint32_t));
+    } else {
+        // Start from the rarest trigram so the candidate set only shrinks
+        qsort(postings, set.count, sizeof(SearchPosting*), compare_posting_size);
+        n = postings[0]->count;
+        ids = malloc(sizeof(uint32_t) * n);
+        memcpy(ids, postings[0]->ids, sizeof(uint32_t) * n);
+        for (size_t i = 1; i < set.count && n > 0; i++) {
+            n = intersect(ids, n, postings[i]);
+        }
+        // Trigrams may come from different fields or places, so confirm the substring
+        uint32_t out = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if (column_contains(&index->keys, ids[i], query->text, query->len)) {
+                ids[out++] = ids[i];
+            }
+        }
+        n = out;
+    }
+    free(postings);
+    trigram_set_free(&set);
+    *match_count = n;
+    return ids;
+}
+
+// Short queries have no trigrams, so they check every key.
+static uint32_t* query_index(const SearchIndex* index, const SearchQuery* query, uint32_t* match_count) {
+    if (query->len < 3) {
+        return query_scan(index, query, 1, match_count);
+    }
+    uint32_t* ids = query_trigrams(index, query, match_count);
+    if (query->digits_len > 0) {
+        uint32_t digit_count;
+        uint32_t* digit_ids = query_scan(index, query, 0, &digit_count);
+        ids = merge_ids(ids, *match_count, digit_ids, digit_count, match_count);
+    }
+    return ids;
+}
+
+// Size of the rarest posting list among the needle's trigrams, which bounds an index query's work.
+static uint32_t smallest_posting(const SearchIndex* index, const char* needle) {
+    TrigramSet set;
+    trigram_set_of_key(&set, needle);
+    uint32_t smallest = UINT32_MAX;
+    for (size_t i = 0; i < set.count; i++) {
+        SearchPosting* posting = search_index_find(index, set.items[i]);
+        uint32_t count = posting ? posting->count : 0;
+        if (count < smallest) {
+            smallest = count;
+        }
+    }
+    trigram_set_free(&set);
+    return smallest;
+}
+
+static SearchChange query_change(const char* last, const char* needle) {
+    if (last == NULL) {
+        return SEARCH_CHANGE_DIFFERENT;
+    }
+    if (strcmp(last, needle) == 0) {
+        return SEARCH_CHANGE_NONE;
+    }
+    // Between two phone-number queries, the digits of the one containing the
+    // other contain the other's digits too; otherwise the digit matches differ
+    if ((query_phone_digits(last, NULL) > 0) != (query_phone_digits(needle, NULL) > 0)) {
+        return SEARCH_CHANGE_DIFFERENT;
+    }
+    if (strstr(needle, last)) {
+        return SEARCH_CHANGE_MORE_STRICT;
+    }
+    return strstr(last, needle) ? SEARCH_CHANGE_LESS_STRICT : SEARCH_CHANGE_DIFFERENT;
+}
+
+uint32_t* search_index_query(SearchIndex* index, const char* text, uint32_t* match_count, SearchChange* change) {
+    SearchQuery query;
+    query_init(&query, text);
+    SearchChange kind = query_change(index->last_query, query.text);
+
+    // Narrowing re-checks the previous matches, unless the index has fewer
+    // candidates to offer; a phone-number query scans every contact's digits anyway
+    int narrow = kind == SEARCH_CHANGE_NONE ||
+                 (kind == SEARCH_CHANGE_MORE_STRICT && (query.len < 3 || query.digits_len > 0 ||
+                                                        index->last_count <= smallest_posting(index, query.text)));
+    uint32_t* ids;
+    uint32_t n;
+    if (narrow) {
+        ids = malloc(sizeof(uint32_t) * (index->last_count > 0 ? index->last_count : 1));
+        n = 0;
+        for (uint32_t i = 0; i < index->last_count; i++) {
+            if (kind == SEARCH_CHANGE_NONE || key_matches(index, index->last_ids[i], &query)) {
+                ids[n++] = index->last_ids[i];
+            }
+        }
+    } else {
+        ids = query_index(index, &query, &n);
+    }
+
+    search_index_forget_query(index);
+    index->last_query = query.text;
+    free(query.digits);
+    index->last_ids = malloc(sizeof(uint32_t) * (n > 0 ? n : 1));
+    memcpy(index->last_ids, ids, sizeof(uint32_t) * n);
+    index->last_count = n;
+    if (change) {
+        *change = kind;
+    }
+    *match_count = n;
+    return ids;
+}
+
+uint32_t* search_index_query_shared(const SearchIndex* index, const char* text, uint32_t* match_count) {
+    SearchQuery query;
+    query_init(&query, text);
+    uint32_t* ids = query_index(index, &query, match_count);
+    query_free(&query);
+    return ids;
+}
+
+int search_index_matches(const SearchIndex* index, uint32_t id, const char* text) {
+    SearchQuery query;
+    query_init(&query, text);
+    int matches = key_matches(index, id, &query);
+    query_free(&query);
+    return matches;
+}
+
+FuzzyMatch* search_index_query_fuzzy(const SearchIndex* index, const char* text, uint32_t* match_count) {
+    char* query = malloc(strlen(text) + 1);
+    text_fold(text, query);
+    FuzzyMatch* matches = fuzzy_index_query(&index->fuzzy, query, match_count);
+    free(query);
+    return matches;
+}
@@ -0,0 +1,98 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "contact_arena.h"
+#include "contact_column.h"
+#include "fuzzy_index.h"
+
+// Trigram inverted index over every field of each contact, for case- and
+// accent-insensitive substring search. Documents are identified by their
+// position in Database::contacts.
+//
+// Each document keeps a precomputed folded key (see text_fold.h): its folded
+// fields joined by SEARCH_INDEX_FIELD_SEPARATOR, stored in one column so a
+// scan reads them front to back from a single heap. Each trigram of the keys
+// maps to a posting list of ids kept in ascending order, so a query intersects
+// the lists of its trigrams and only checks the few survivors against their
+// keys.
+//
+// Keys are compared with the text_search.h kernel, straight from the column's
+// heap. A query made only of digits and phone punctuation, with at least
+// three digits, also matches the digits of each contact's phone numbers, kept
+// in a second column, so "555-1234" finds "(555) 1234".
+//
+// The result of the last query is kept. A query that only narrows it (the
+// old query is a substring of the new one) re-checks the previous matches
+// instead of consulting the index.
+//
+// The words of each document's name and email are also kept in a
+// FuzzyIndex, for typo-tolerant queries.
+
+#define SEARCH_INDEX_FIELD_SEPARATOR '\x1f'
+
+typedef enum {
+    SEARCH_CHANGE_NONE,
+    SEARCH_CHANGE_DIFFERENT,
+    // Every new match was a previous match
+    SEARCH_CHANGE_MORE_STRICT,
+    // Every previous match is still a match
+    SEARCH_CHANGE_LESS_STRICT
+} SearchChange;
+
+typedef struct {
+    // Three folded bytes; 0 marks an empty slot, since keys never contain NUL
+    uint32_t trigram;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t* ids;
+} SearchPosting;
+
+typedef struct {
+    SearchPosting* slots;
+    size_t capacity;
+    size_t used;
+    // Folded key of each document, absent for ids not in the index
+    ContactColumn keys;
+    // Digits of each document's phone numbers, separated by CONTACT_VALUE_SEPARATOR
+    ContactColumn digits;
+    FuzzyIndex fuzzy;
+    // Threads a full scan is split across, the caller's included (see
+    // scan_pool.h); 0 for one per online CPU
+    int scan_threads;
+    // Where search_index_add folds a contact's fields
+    char* scratch;
+    size_t scratch_size;
+    // Last query and its matches; cleared by any change to the documents
+    char* last_query;
+    uint32_t* last_ids;
+    uint32_t last_count;
+} SearchIndex;
+
+void search_index_init(SearchIndex* index);
+void search_index_free(SearchIndex* index);
+
+void search_index_add(SearchIndex* index, const Contact* contact, uint32_t id);
+void search_index_remove(SearchIndex* index, uint32_t id);
+// Renumbers a document, e.g. when the last contact fills a removed one's position.
+void search_index_move(SearchIndex* index, uint32_t from, uint32_t to);
+
+// Returns the ids of documents with query in any field (or, for a phone
+// number, in the digits of their phone numbers), ascending, in a
+// malloc'ed array. change (may be NULL) tells how the result relates to the
+// previous query's, when no document has changed since. Queries shorter than
+// a trigram that do not narrow the last one scan every key, and phone-number
+// queries every document's digits, in chunks spread over scan_threads threads.
+uint32_t* search_index_query(SearchIndex* index, const char* query, uint32_t* match_count, SearchChange* change);
+// Like search_index_query, but neither uses nor replaces the last result, so
+// any number of threads may query the index while nothing changes it.
+uint32_t* search_index_query_shared(const SearchIndex* index, const char* query, uint32_t* match_count);
+// Whether one document matches query, without touching the cached result.
+int search_index_matches(const SearchIndex* index, uint32_t id, const char* query);
+// The documents whose name and email have words within a few edits of each
+// word of query, best first (see fuzzy_index_query). Like
+// search_index_query_shared, it only reads the index.
+FuzzyMatch* search_index_query_fuzzy(const SearchIndex* index, const char* query, uint32_t* match_count);
+
+#endif
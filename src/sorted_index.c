@@ -0,0 +1,261 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sorted_index.h"
+
+// A build leaves room in each block, so the first inserts do not split them all
+#define SORTED_INDEX_BUILD_FILL (SORTED_INDEX_BLOCK * 3 / 4)
+// Runs this short are finished with an insertion sort
+#define SORTED_INDEX_SORT_MIN 16
+
+static void swap_keys(const char** keys, unsigned int a, unsigned int b) {
+    const char* key = keys[a];
+    keys[a] = keys[b];
+    keys[b] = key;
+}
+
+static unsigned char key_byte(const char* key, size_t depth) {
+    return (unsigned char)key[depth];
+}
+
+// Sorts keys that agree on their first depth bytes
+static void insertion_sort(const char** keys, unsigned int n, size_t depth) {
+    for (unsigned int i = 1; i < n; i++) {
+        const char* key = keys[i];
+        unsigned int j = i;
+        while (j > 0 && strcmp(keys[j - 1] + depth, key + depth) > 0) {
+            keys[j] = keys[j - 1];
+            j--;
+        }
+        keys[j] = key;
+    }
+}
+
+// Multikey quicksort (Bentley and Sedgewick): partitions keys that agree on
+// their first depth bytes three ways by the next byte, then moves on to the
+// following byte only within the middle part. Names share long prefixes, so
+// this compares far fewer bytes than qsort with strcmp.
+static void multikey_sort(const char** keys, unsigned int n, size_t depth) {
+    while (n > SORTED_INDEX_SORT_MIN) {
+        // Median of the first, middle and last bytes as the pivot
+        unsigned int a = 0, b = n / 2, c = n - 1;
+        unsigned char ca = key_byte(keys[a], depth), cb = key_byte(keys[b], depth), cc = key_byte(keys[c], depth);
+        unsigned int median = ca < cb ? (cb < cc ? b : ca < cc ? c : a) : (cb > cc ? b : ca < cc ? a : c);
+        swap_keys(keys, 0, median);
+        unsigned char pivot = key_byte(keys[0], depth);
+        // [0, lt) below the pivot, [lt, i) equal, [gt, n) above
+        unsigned int lt = 0, i = 1, gt = n;
+        while (i < gt) {
+            unsigned char byte = key_byte(keys[i], depth);
+            if (byte < pivot) {
+                swap_keys(keys, lt++, i++);
+            } else if (byte > pivot) {
+                swap_keys(keys, i, --gt);
+            } else {
+                i++;
+            }
+        }
+        multikey_sort(keys, lt, depth);
+        multikey_sort(keys + gt, n - gt, depth);
+        if (pivot == 0) {
+            // Equal keys, all ending here
+            return;
+        }
+        keys += lt;
+        n = gt - lt;
+        depth++;
+    }
+    insertion_sort(keys, n, depth);
+}
+
+// Index of the first key of a block not below key
+static unsigned int block_lower_bound(const SortedIndexBlock* block, const char* key) {
+    unsigned int low = 0, high = block->count;
+    while (low < high) {
+        unsigned int mid = low + (high - low) / 2;
+        if (strcmp(block->keys[mid], key) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Index of the first block whose last key is not below key, or block_count
+static unsigned int find_block(const SortedIndex* index, const char* key) {
+    unsigned int low = 0, high = index->block_count;
+    while (low < high) {
+        unsigned int mid = low + (high - low) / 2;
+        const SortedIndexBlock* block = &index->blocks[mid];
+        if (strcmp(block->keys[block->count - 1], key) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Opens an empty block at position b
+static SortedIndexBlock* insert_block(SortedIndex* index, unsigned int b) {
+    if (index->block_count == index->block_capacity) {
+        index->block_capacity = index->block_capacity ? index->block_capacity * 2 : 16;
+        index->blocks = realloc(index->blocks, sizeof(SortedIndexBlock) * index->block_capacity);
+    }
+    memmove(&index->blocks[b + 1], &index->blocks[b], sizeof(SortedIndexBlock) * (index->block_count - b));
+    index->block_count++;
+    SortedIndexBlock* block = &index->blocks[b];
+    block->keys = malloc(sizeof(const char*) * SORTED_INDEX_BLOCK);
+    block->count = 0;
+    return block;
+}
+
+static void remove_block(SortedIndex* index, unsigned int b) {
+    free(index->blocks[b].keys);
+    index->block_count--;
+    memmove(&index->blocks[b], &index->blocks[b + 1], sizeof(SortedIndexBlock) * (index->block_count - b));
+}
+
+void sorted_index_init(SortedIndex* index) {
+    index->blocks = NULL;
+    index->block_count = 0;
+    index->block_capacity = 0;
+    index->count = 0;
+}
+
+void sorted_index_free(SortedIndex* index) {
+    for (unsigned int b = 0; b < index->block_count; b++) {
+        free(index->blocks[b].keys);
+    }
+    free(index->blocks);
+    sorted_index_init(index);
+}
+
+void sorted_index_build(SortedIndex* index, const char** keys, unsigned int count) {
+    sorted_index_free(index);
+    multikey_sort(keys, count, 0);
+    for (unsigned int i = 0; i < count; i += SORTED_INDEX_BUILD_FILL) {
+        SortedIndexBlock* block = insert_block(index, index->block_count);
+        block->count = count - i < SORTED_INDEX_BUILD_FILL ? count - i : SORTED_INDEX_BUILD_FILL;
+        memcpy(block->keys, keys + i, sizeof(const char*) * block->count);
+    }
+    index->count = count;
+}
+
+void sorted_index_insert(SortedIndex* index, const char* key) {
+    if (index->block_count == 0) {
+        insert_block(index, 0);
+    }
+    // Past every last key, the key goes at the end of the last block
+    unsigned int b = find_block(index, key);
+    if (b == index->block_count) {
+        b--;
+    }
+    if (index->blocks[b].count == SORTED_INDEX_BLOCK) {
+        // Split the full block in half, then take whichever half the key belongs in
+        SortedIndexBlock* upper = insert_block(index, b + 1);
+        SortedIndexBlock* lower = &index->blocks[b];
+        upper->count = SORTED_INDEX_BLOCK / 2;
+        lower->count = SORTED_INDEX_BLOCK - upper->count;
+        memcpy(upper->keys, lower->keys + lower->count, sizeof(const char*) * upper->count);
+        if (strcmp(lower->keys[lower->count - 1], key) < 0) {
+            b++;
+        }
+    }
+    SortedIndexBlock* block = &index->blocks[b];
+    unsigned int pos = block_lower_bound(block, key);
+    memmove(&block->keys[pos + 1], &block->keys[pos], sizeof(const char*) * (block->count - pos));
+    block->keys[pos] = key;
+    block->count++;
+    index->count++;
+}
+
+int sorted_index_remove(SortedIndex* index, const char* key) {
+    SortedIndexIter iter;
+    sorted_index_seek(index, key, &iter);
+    // Equal keys may run on over several blocks
+    while (iter.block < index->block_count) {
+        SortedIndexBlock* block = &index->blocks[iter.block];
+        if (iter.pos == block->count) {
+            iter.block++;
+            iter.pos = 0;
+            continue;
+        }
+        const char* found = block->keys[iter.pos];
+        if (found == key) {
+            block->count--;
+            memmove(&block->keys[iter.pos], &block->keys[iter.pos + 1], sizeof(const char*) * (block->count - iter.pos));
+            if (block->count == 0) {
+                remove_block(index, iter.block);
+            }
+            index->count--;
+            return 1;
+        }
+        if (strcmp(found, key) != 0) {
+            return 0;
+        }
+        iter.pos++;
+    }
+    return 0;
+}
+
+void sorted_index_seek(const SortedIndex* index, const char* key, SortedIndexIter* iter) {
+    iter->block = find_block(index, key);
+    iter->pos = iter->block < index->block_count ? block_lower_bound(&index->blocks[iter->block], key) : 0;
+}
+
+const char* sorted_index_next(const SortedIndex* index, SortedIndexIter* iter) {
+    while (iter->block < index->block_count && iter->pos == index->blocks[iter->block].count) {
+        iter->block++;
+        iter->pos = 0;
+    }
+    if (iter->block == index->block_count) {
+        return NULL;
+    }
+    return index->blocks[iter->block].keys[iter->pos++];
+}
+
+const char* sorted_index_prev(const SortedIndex* index, SortedIndexIter* iter) {
+    while (iter->pos == 0) {
+        if (iter->block == 0) {
+            return NULL;
+        }
+        iter->block--;
+        iter->pos = index->blocks[iter->block].count;
+    }
+    return index->blocks[iter->block].keys[--iter->pos];
+}
+
+unsigned int sorted_index_count_prefix(const SortedIndex* index, const char* prefix, unsigned int limit,
+                                       SortedIndexIter* iter) {
+    sorted_index_seek(index, prefix, iter);
+    SortedIndexIter probe = *iter;
+    size_t len = strlen(prefix);
+    unsigned int count = 0;
+    const char* key;
+    while (count < limit && (key = sorted_index_next(index, &probe)) && strncmp(key, prefix, len) == 0) {
+        count++;
+    }
+    return count;
+}
+
+const char* sorted_index_last_prefix(const SortedIndex* index, const char* prefix) {
+    // The keys starting with prefix end before the first key not below its
+    // successor: prefix with its last byte raised by one, once any 0xff bytes
+    // at its end are dropped. Without a successor, they run to the end.
+    size_t len = strlen(prefix);
+    char* successor = malloc(len + 1);
+    memcpy(successor, prefix, len + 1);
+    while (len > 0 && (unsigned char)successor[len - 1] == 0xff) {
+        len--;
+    }
+    SortedIndexIter iter = {index->block_count, 0};
+    if (len > 0) {
+        successor[len - 1]++;
+        successor[len] = '\0';
+        sorted_index_seek(index, successor, &iter);
+    }
+    free(successor);
+    const char* key = sorted_index_prev(index, &iter);
+    return key && strncmp(key, prefix, strlen(prefix)) == 0 ? key : NULL;
+}
@@ -0,0 +1,54 @@
+#ifndef SORTED_INDEX_H
+#define SORTED_INDEX_H
+
+// String keys in strcmp order, for prefix lookups such as completing a name.
+// Keys are borrowed, as in HashIndex, and duplicates are allowed.
+//
+// The keys are kept in a list of sorted blocks of at most SORTED_INDEX_BLOCK
+// keys each, found by binary search on their last keys. Inserting or removing
+// a key shifts part of one block, and a full block splits in two, so changes
+// cost the same however many keys there are, unlike one big sorted array.
+
+#define SORTED_INDEX_BLOCK 512
+
+typedef struct {
+    const char** keys;
+    unsigned int count;
+} SortedIndexBlock;
+
+typedef struct {
+    // Never empty, in key order
+    SortedIndexBlock* blocks;
+    unsigned int block_count;
+    unsigned int block_capacity;
+    unsigned int count;
+} SortedIndex;
+
+// A position between two keys
+typedef struct {
+    unsigned int block;
+    unsigned int pos;
+} SortedIndexIter;
+
+void sorted_index_init(SortedIndex* index);
+void sorted_index_free(SortedIndex* index);
+// Replaces the contents with count keys, sorting them; keys is left reordered.
+void sorted_index_build(SortedIndex* index, const char** keys, unsigned int count);
+void sorted_index_insert(SortedIndex* index, const char* key);
+// Removes this very key, compared by address among equal ones. Returns 0 if it is not there.
+int sorted_index_remove(SortedIndex* index, const char* key);
+
+// Places iter before the first key not below key.
+void sorted_index_seek(const SortedIndex* index, const char* key, SortedIndexIter* iter);
+// The key after or before iter, moving iter past it; NULL at either end.
+const char* sorted_index_next(const SortedIndex* index, SortedIndexIter* iter);
+const char* sorted_index_prev(const SortedIndex* index, SortedIndexIter* iter);
+
+// Places iter before the first key starting with prefix and counts those
+// keys, stopping at limit.
+unsigned int sorted_index_count_prefix(const SortedIndex* index, const char* prefix, unsigned int limit,
+                                       SortedIndexIter* iter);
+// The last key starting with prefix, or NULL if there is none.
+const char* sorted_index_last_prefix(const SortedIndex* index, const char* prefix);
+
+#endif
@@ -0,0 +1,66 @@
+#include <string.h>
+#include "text_fold.h"
+
+// Folded form of U+00C0..U+017F; NULL keeps the character as it is
+static const char* const latin_fold[0x180 - 0xC0] = {
+    // U+00C0
+    "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",
+    "d", "n", "o", "o", "o", "o", "o", NULL, "o", "u", "u", "u", "u", "y", "th", "ss",
+    "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",
+    "d", "n", "o", "o", "o", "o", "o", NULL, "o", "u", "u", "u", "u", "y", "th", "y",
+    // U+0100
+    "a", "a", "a", "a", "a", "a", "c", "c", "c", "c", "c", "c", "c", "c", "d", "d",
+    "d", "d", "e", "e", "e", "e", "e", "e", "e", "e", "e", "e", "g", "g", "g", "g",
+    "g", "g", "g", "g", "h", "h", "h", "h", "i", "i", "i", "i", "i", "i", "i", "i",
+    "i", "i", "ij", "ij", "j", "j", "k", "k", "k", "l", "l", "l", "l", "l", "l", "l",
+    "l", "l", "l", "n", "n", "n", "n", "n", "n", "n", "n", "n", "o", "o", "o", "o",
+    "o", "o", "oe", "oe", "r", "r", "r", "r", "r", "r", "s", "s", "s", "s", "s", "s",
+    "s", "s", "t", "t", "t", "t", "t", "t", "u", "u", "u", "u", "u", "u", "u", "u",
+    "u", "u", "u", "u", "w", "w", "y", "y", "y", "z", "z", "z", "z", "z", "z", "s",
+};
+
+static char* put_code_point(char* out, unsigned int cp) {
+    out[0] = (char)(0xC0 | (cp >> 6));
+    out[1] = (char)(0x80 | (cp & 0x3F));
+    return out + 2;
+}
+
+size_t text_fold(const char* text, char* out) {
+    const unsigned char* p = (const unsigned char*)text;
+    char* start = out;
+    while (*p) {
+        unsigned char c = *p;
+        if (c < 0x80) {
+            *out++ = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+            p++;
+            continue;
+        }
+        // Only two-byte sequences have foldings here; longer ones are copied below
+        if (c < 0xC2 || c > 0xDF || (p[1] & 0xC0) != 0x80) {
+            *out++ = *p++;
+            continue;
+        }
+        unsigned int cp = (c & 0x1F) << 6 | (p[1] & 0x3F);
+        p += 2;
+        if (cp >= 0x300 && cp <= 0x36F) {
+            // Combining diacritical mark
+            continue;
+        }
+        if (cp >= 0xC0 && cp < 0x180 && latin_fold[cp - 0xC0]) {
+            const char* folded = latin_fold[cp - 0xC0];
+            size_t len = strlen(folded);
+            memcpy(out, folded, len);
+            out += len;
+        } else if ((cp >= 0x391 && cp <= 0x3A9) || (cp >= 0x410 && cp <= 0x42F)) {
+            // Greek and basic Cyrillic capitals
+            out = put_code_point(out, cp + 0x20);
+        } else if (cp >= 0x400 && cp <= 0x40F) {
+            // Cyrillic capitals with diacritics or from other alphabets (Ё, Є, Ї, ...)
+            out = put_code_point(out, cp + 0x50);
+        } else {
+            out = put_code_point(out, cp);
+        }
+    }
+    *out = '\0';
+    return out - start;
+}
@@ -0,0 +1,16 @@
+#ifndef TEXT_FOLD_H
+#define TEXT_FOLD_H
+
+#include <stddef.h>
+
+// Folds UTF-8 text for case- and accent-insensitive matching. Letters are
+// lowercased (ASCII, Latin-1, Latin Extended-A, Greek, Cyrillic), Latin
+// letters lose their diacritics (É -> e, ß -> ss), and combining marks are
+// dropped, so precomposed and decomposed spellings fold to the same bytes.
+// Anything else, including invalid UTF-8, is copied through.
+//
+// The result is never longer than the input. Writes a NUL-terminated string
+// to out and returns its length.
+size_t text_fold(const char* text, char* out);
+
+#endif
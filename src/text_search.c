@@ -0,0 +1,297 @@
+#include <string.h>
+#include "text_search.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define TEXT_SEARCH_X86 1
+#endif
+
+typedef struct {
+    const char* (*find)(const char* text, const char* limit, const char* needle, size_t len);
+    size_t (*find_each)(const char* text, const char* limit, const char* needle, size_t len, const char** hits,
+                        size_t max, const char** resume);
+} TextSearchFuncs;
+
+// The start of the string after the one p points into
+static const char* next_string(const char* p) {
+    return p + strlen(p) + 1;
+}
+
+static const char* find_scalar(const char* text, const char* limit, const char* needle, size_t len) {
+    (void)limit;
+    if (len == 0) {
+        return text;
+    }
+    for (const char* p = text; *p; p++) {
+        // strncmp stops at the end of the text
+        if (*p == needle[0] && strncmp(p + 1, needle + 1, len - 1) == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// The scalar implementation, and the vector ones' last bytes before limit
+static size_t find_each_scalar(const char* text, const char* limit, const char* needle, size_t len,
+                               const char** hits, size_t max, const char** resume) {
+    const char* p = text;
+    size_t n = 0;
+    while (n < max && limit - p >= (ptrdiff_t)len) {
+        p = memchr(p, needle[0], limit - p - (len - 1));
+        if (p == NULL) {
+            break;
+        }
+        if (memcmp(p + 1, needle + 1, len - 1) == 0) {
+            hits[n++] = p;
+            p = next_string(p + len);
+        } else {
+            p++;
+        }
+    }
+    *resume = n < max ? limit : p;
+    return n;
+}
+
+#ifdef TEXT_SEARCH_X86
+
+// Bytes between the first and the last, which the vector loops check with memcmp
+static size_t middle_size(size_t len) {
+    return len > 2 ? len - 2 : 0;
+}
+
+// candidates has a bit for each position whose first and last bytes match, and
+// nul one for each NUL; positions from the first NUL on belong to the next
+// string. A candidate that overlaps the NUL fails the memcmp, since the needle
+// has none. Returns the position of the first match, or -1.
+static inline int check_candidates(const char* p, unsigned candidates, unsigned nul, const char* needle, size_t len) {
+    if (nul) {
+        candidates &= (nul & -nul) - 1;
+    }
+    size_t middle = middle_size(len);
+    while (candidates) {
+        int i = __builtin_ctz(candidates);
+        if (middle == 0 || memcmp(p + i + 1, needle + 1, middle) == 0) {
+            return i;
+        }
+        candidates &= candidates - 1;
+    }
+    return -1;
+}
+
+static const char* find_sse2(const char* text, const char* limit, const char* needle, size_t len) {
+    if (len == 0) {
+        return text;
+    }
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[len - 1]);
+    const __m128i zero = _mm_setzero_si128();
+    const char* p = text;
+    while (limit - p >= (ptrdiff_t)(len - 1 + 16)) {
+        __m128i a = _mm_loadu_si128((const __m128i*)p);
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + len - 1));
+        unsigned nul = _mm_movemask_epi8(_mm_cmpeq_epi8(a, zero));
+        unsigned candidates = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        // Most blocks have neither
+        if (candidates | nul) {
+            int i = check_candidates(p, candidates, nul, needle, len);
+            if (i >= 0) {
+                return p + i;
+            }
+            if (nul) {
+                return NULL;
+            }
+        }
+        p += 16;
+    }
+    return find_scalar(p, limit, needle, len);
+}
+
+// The positions after the first NUL in nul
+static unsigned after_first_nul(unsigned nul) {
+    unsigned first = nul & -nul;
+    return ~(first | (first - 1));
+}
+
+// Looks across the NULs. After a hit, the rest of its string is passed over
+// with the same loads: skip is set until the block holding its NUL.
+static size_t find_each_sse2(const char* text, const char* limit, const char* needle, size_t len,
+                             const char** hits, size_t max, const char** resume) {
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[len - 1]);
+    const __m128i zero = _mm_setzero_si128();
+    const char* p = text;
+    size_t n = 0;
+    int skip = 0;
+    while (n < max && limit - p >= (ptrdiff_t)(len - 1 + 16)) {
+        __m128i a = _mm_loadu_si128((const __m128i*)p);
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + len - 1));
+        unsigned candidates = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        if (skip) {
+            unsigned nul = _mm_movemask_epi8(_mm_cmpeq_epi8(a, zero));
+            if (nul == 0) {
+                p += 16;
+                continue;
+            }
+            candidates &= after_first_nul(nul);
+            skip = 0;
+        }
+        if (candidates) {
+            int i = check_candidates(p, candidates, 0, needle, len);
+            if (i >= 0) {
+                hits[n++] = p + i;
+                p += i + len;
+                skip = 1;
+                continue;
+            }
+        }
+        p += 16;
+    }
+    if (skip) {
+        p = next_string(p);
+    }
+    if (n == max) {
+        *resume = p;
+        return n;
+    }
+    return n + find_each_scalar(p, limit, needle, len, hits + n, max - n, resume);
+}
+
+__attribute__((target("avx2")))
+static const char* find_avx2(const char* text, const char* limit, const char* needle, size_t len) {
+    if (len == 0) {
+        return text;
+    }
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[len - 1]);
+    const __m256i zero = _mm256_setzero_si256();
+    const char* p = text;
+    while (limit - p >= (ptrdiff_t)(len - 1 + 32)) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)p);
+        __m256i b = _mm256_loadu_si256((const __m256i*)(p + len - 1));
+        unsigned nul = _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, zero));
+        unsigned candidates =
+            _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        if (candidates | nul) {
+            int i = check_candidates(p, candidates, nul, needle, len);
+            if (i >= 0) {
+                return p + i;
+            }
+            if (nul) {
+                return NULL;
+            }
+        }
+        p += 32;
+    }
+    // Short strings and the end of the buffer still get 16 bytes at a time
+    return find_sse2(p, limit, needle, len);
+}
+
+__attribute__((target("avx2")))
+static size_t find_each_avx2(const char* text, const char* limit, const char* needle, size_t len,
+                             const char** hits, size_t max, const char** resume) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[len - 1]);
+    const __m256i zero = _mm256_setzero_si256();
+    const char* p = text;
+    size_t n = 0;
+    int skip = 0;
+    while (n < max && limit - p >= (ptrdiff_t)(len - 1 + 32)) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)p);
+        __m256i b = _mm256_loadu_si256((const __m256i*)(p + len - 1));
+        unsigned candidates =
+            _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        if (skip) {
+            unsigned nul = _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, zero));
+            if (nul == 0) {
+                p += 32;
+                continue;
+            }
+            candidates &= after_first_nul(nul);
+            skip = 0;
+        }
+        if (candidates) {
+            int i = check_candidates(p, candidates, 0, needle, len);
+            if (i >= 0) {
+                hits[n++] = p + i;
+                p += i + len;
+                skip = 1;
+                continue;
+            }
+        }
+        p += 32;
+    }
+    if (skip) {
+        p = next_string(p);
+    }
+    if (n == max) {
+        *resume = p;
+        return n;
+    }
+    return n + find_each_sse2(p, limit, needle, len, hits + n, max - n, resume);
+}
+
+#endif
+
+static const TextSearchFuncs impls[] = {
+    [TEXT_SEARCH_SCALAR] = {find_scalar, find_each_scalar},
+#ifdef TEXT_SEARCH_X86
+    [TEXT_SEARCH_SSE2] = {find_sse2, find_each_sse2},
+    [TEXT_SEARCH_AVX2] = {find_avx2, find_each_avx2},
+#endif
+};
+
+// NULL until the first search picks the best implementation
+static const TextSearchFuncs* current;
+
+static int impl_supported(TextSearchImpl impl) {
+    switch (impl) {
+    case TEXT_SEARCH_SCALAR:
+        return 1;
+#ifdef TEXT_SEARCH_X86
+    case TEXT_SEARCH_SSE2:
+        return 1;
+    case TEXT_SEARCH_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return 0;
+    }
+}
+
+int text_search_set_impl(TextSearchImpl impl) {
+    if (!impl_supported(impl)) {
+        return 0;
+    }
+    // Searches on other threads see either implementation, and both give the same results
+    __atomic_store_n(&current, &impls[impl], __ATOMIC_RELAXED);
+    return 1;
+}
+
+static const TextSearchFuncs* funcs(void) {
+    const TextSearchFuncs* funcs = __atomic_load_n(&current, __ATOMIC_RELAXED);
+    if (funcs == NULL) {
+        if (!text_search_set_impl(TEXT_SEARCH_AVX2) && !text_search_set_impl(TEXT_SEARCH_SSE2)) {
+            text_search_set_impl(TEXT_SEARCH_SCALAR);
+        }
+        funcs = __atomic_load_n(&current, __ATOMIC_RELAXED);
+    }
+    return funcs;
+}
+
+const char* text_search_find(const char* text, const char* limit, const char* needle, size_t len) {
+    return funcs()->find(text, limit, needle, len);
+}
+
+size_t text_search_find_each(const char* text, const char* limit, const char* needle, size_t len,
+                             const char** hits, size_t max, const char** resume) {
+    return funcs()->find_each(text, limit, needle, len, hits, max, resume);
+}
+
+TextSearchImpl text_search_get_impl(void) {
+    return (TextSearchImpl)(funcs() - impls);
+}
+
+const char* text_search_impl_name(TextSearchImpl impl) {
+    static const char* names[] = {"scalar", "sse2", "avx2"};
+    return names[impl];
+}
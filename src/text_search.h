@@ -0,0 +1,42 @@
+#ifndef TEXT_SEARCH_H
+#define TEXT_SEARCH_H
+
+#include <stddef.h>
+
+// Substring search over NUL-terminated strings packed into one buffer, such
+// as the folded keys of the search index (see text_fold.h; both the keys and
+// the needle are folded first, which makes the match case-insensitive).
+//
+// The vector implementations compare the needle's first and last bytes with
+// 16 or 32 text positions at once and only check the bytes in between where
+// both match. They read past the end of the text string, up to limit, and
+// fall back to the scalar loop for the last bytes before it. The best
+// implementation the CPU supports is chosen on first use.
+//
+// text_search_find_each scans a whole heap of strings in one run instead: it
+// looks for the needle across the NULs and, after each hit, skips to the next
+// string, so runs of strings without one pass at the speed of the vector loop.
+
+typedef enum {
+    TEXT_SEARCH_SCALAR,
+    TEXT_SEARCH_SSE2,
+    TEXT_SEARCH_AVX2
+} TextSearchImpl;
+
+// Returns the first occurrence of needle (len bytes, no NUL) in the
+// NUL-terminated text, or NULL. The bytes from text to limit must be readable.
+// An empty needle matches at text.
+const char* text_search_find(const char* text, const char* limit, const char* needle, size_t len);
+// Finds the first occurrence of needle (len > 0 bytes, no NUL) in each of the
+// NUL-terminated strings packed from text to limit, the last of which ends
+// there. Writes up to max of them to hits, in order, and returns how many;
+// resume is set to where to continue, which is limit once the scan is done.
+size_t text_search_find_each(const char* text, const char* limit, const char* needle, size_t len,
+                             const char** hits, size_t max, const char** resume);
+
+TextSearchImpl text_search_get_impl(void);
+// Switches implementation, e.g. to compare them; returns 0 if the CPU lacks it.
+int text_search_set_impl(TextSearchImpl impl);
+const char* text_search_impl_name(TextSearchImpl impl);
+
+#endif
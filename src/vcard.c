@@ -0,0 +1,890 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include "file_util.h"
+#include "vcard.h"
+
+typedef struct {
+    // Owned by the chunk; the parsed strings point into it
+    char* data;
+    size_t size;
+    Contact* cards;
+    size_t count;
+    size_t capacity;
+    int parsed;
+} VCardChunk;
+
+// Chunks move reader -> parsers -> merge. Sequence numbers below next_read
+// have been read, below next_parse handed to a parser, and below next_merge
+// delivered and freed. Chunk n lives in slots[n % max_in_flight].
+typedef struct {
+    int fd;
+    int max_in_flight;
+    VCardChunk** slots;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint64_t next_read;
+    uint64_t next_parse;
+    uint64_t next_merge;
+    int eof;
+    int stop;
+    int error;
+    // Only touched by the reader until it has been joined
+    uint64_t bytes;
+} VCardPipeline;
+
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} ReadBuffer;
+
+// --- Reader ---
+
+// Returns the offset of the last line starting with BEGIN:VCARD, or 0 if no line but the first does.
+static size_t last_card_start(const char* data, size_t size) {
+    for (size_t i = size; i > 0; i--) {
+        if (data[i - 1] == '\n' && size - i >= 11 && strncasecmp(data + i, "BEGIN:VCARD", 11) == 0) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+static int read_fill(VCardPipeline* pipeline, ReadBuffer* buffer) {
+    while (buffer->size < buffer->capacity) {
+        ssize_t n = read(pipeline->fd, buffer->data + buffer->size, buffer->capacity - buffer->size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        buffer->size += n;
+        pipeline->bytes += n;
+    }
+    return 1;
+}
+
+// Moves the complete cards in the buffer into chunk and keeps the card that
+// may continue in the next read. Returns 1 if more input may follow, 0 at the
+// end of the input and -1 on a read error.
+static int read_chunk(VCardPipeline* pipeline, ReadBuffer* buffer, VCardChunk* chunk) {
+    for (;;) {
+        int status = read_fill(pipeline, buffer);
+        if (status <= 0) {
+            chunk->data = buffer->data;
+            chunk->size = buffer->size;
+            buffer->data = NULL;
+            return status;
+        }
+        size_t split = last_card_start(buffer->data, buffer->size);
+        if (split > 0) {
+            size_t rest = buffer->size - split;
+            size_t capacity = rest * 2 > VCARD_CHUNK_SIZE ? rest * 2 : VCARD_CHUNK_SIZE;
+            char* next = malloc(capacity + 1);
+            memcpy(next, buffer->data + split, rest);
+            chunk->data = buffer->data;
+            chunk->size = split;
+            buffer->data = next;
+            buffer->size = rest;
+            buffer->capacity = capacity;
+            return 1;
+        }
+        // A single card bigger than the buffer
+        buffer->capacity *= 2;
+        buffer->data = realloc(buffer->data, buffer->capacity + 1);
+    }
+}
+
+static void* reader_main(void* data) {
+    VCardPipeline* pipeline = data;
+    ReadBuffer buffer = {malloc(VCARD_CHUNK_SIZE + 1), 0, VCARD_CHUNK_SIZE};
+    int status = 1;
+
+    while (status > 0) {
+        pthread_mutex_lock(&pipeline->lock);
+        while (!pipeline->stop && pipeline->next_read - pipeline->next_merge >= (uint64_t)pipeline->max_in_flight) {
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+        }
+        int stop = pipeline->stop;
+        pthread_mutex_unlock(&pipeline->lock);
+        if (stop) {
+            break;
+        }
+
+        VCardChunk* chunk = calloc(1, sizeof(VCardChunk));
+        status = read_chunk(pipeline, &buffer, chunk);
+
+        pthread_mutex_lock(&pipeline->lock);
+        if (chunk->size > 0) {
+            pipeline->slots[pipeline->next_read % pipeline->max_in_flight] = chunk;
+            pipeline->next_read++;
+        } else {
+            free(chunk->data);
+            free(chunk);
+        }
+        pipeline->error = status < 0;
+        pthread_cond_broadcast(&pipeline->changed);
+        pthread_mutex_unlock(&pipeline->lock);
+    }
+    free(buffer.data);
+
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->eof = 1;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+// --- Parser ---
+
+// Lines are unfolded and decoded in place: output never outgrows the input it
+// was read from, so everything written before out is a kept value and
+// everything from pos on is still unread.
+typedef struct {
+    char* pos;
+    char* end;
+    char* out;
+} LineReader;
+
+typedef struct {
+    char* name;
+    char* value;
+    int quoted_printable;
+    int preferred;
+} Property;
+
+// Values kept per field; further ones are dropped
+#define CARD_MAX_VALUES 8
+
+typedef struct {
+    int depth;
+    // Where the card's first kept value went
+    char* kept;
+    char* name;
+    char* structured_name;
+    // Values of the other fields in keeping order, preferred ones first. Only
+    // fields with CONTACT_FIELD_MULTIPLE keep more than one.
+    char* values[CONTACT_FIELD_COUNT][CARD_MAX_VALUES];
+    int value_count[CONTACT_FIELD_COUNT];
+    int preferred_count[CONTACT_FIELD_COUNT];
+    int multiple;
+} CardState;
+
+// The property each field other than the name is read from and written as
+static const char* const card_properties[CONTACT_FIELD_COUNT] = {
+    [CONTACT_FIELD_PHONE] = "TEL",
+    [CONTACT_FIELD_EMAIL] = "EMAIL",
+    [CONTACT_FIELD_ORGANIZATION] = "ORG",
+    [CONTACT_FIELD_ADDRESS] = "ADR",
+    [CONTACT_FIELD_NOTES] = "NOTE",
+};
+
+// Returns the next physical line without its line break.
+static char* physical_line(LineReader* reader, size_t* len) {
+    char* line = reader->pos;
+    char* newline = memchr(line, '\n', reader->end - line);
+    char* line_end = newline ? newline : reader->end;
+    reader->pos = newline ? newline + 1 : reader->end;
+    if (line_end > line && line_end[-1] == '\r') {
+        line_end--;
+    }
+    *len = line_end - line;
+    return line;
+}
+
+// Assembles the next line at out, joined with its RFC 6350 continuation lines (those starting with a space or tab).
+static char* logical_line(LineReader* reader, size_t* len) {
+    if (reader->pos >= reader->end) {
+        return NULL;
+    }
+    size_t n;
+    char* line = physical_line(reader, &n);
+    memmove(reader->out, line, n);
+    *len = n;
+    while (reader->pos < reader->end && (*reader->pos == ' ' || *reader->pos == '\t')) {
+        line = physical_line(reader, &n);
+        // Drop the leading space or tab that marks the continuation. The line
+        // starts with it, so n is never 0; the check only keeps GCC's
+        // -Warray-bounds from flagging the n - 1 copy.
+        if (n > 0) {
+            memmove(reader->out + *len, line + 1, n - 1);
+            *len += n - 1;
+        }
+    }
+    reader->out[*len] = '\0';
+    return reader->out;
+}
+
+// vCard 2.1 quoted-printable values continue on the next line after a trailing '='.
+static void quoted_printable_continue(LineReader* reader, char* line, size_t* len) {
+    while (*len > 0 && line[*len - 1] == '=' && reader->pos < reader->end) {
+        size_t n;
+        char* next = physical_line(reader, &n);
+        (*len)--;
+        memmove(line + *len, next, n);
+        *len += n;
+    }
+    line[*len] = '\0';
+}
+
+static int contains_word(const char* s, size_t len, const char* word) {
+    size_t word_len = strlen(word);
+    for (size_t i = 0; i + word_len <= len; i++) {
+        if (strncasecmp(s + i, word, word_len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void parse_parameter(const char* param, size_t len, Property* prop) {
+    if (contains_word(param, len, "QUOTED-PRINTABLE")) {
+        prop->quoted_printable = 1;
+    } else if ((len > 5 && strncasecmp(param, "TYPE=", 5) == 0 && contains_word(param, len, "PREF")) ||
+               (len > 5 && strncasecmp(param, "PREF=", 5) == 0) || (len == 4 && strncasecmp(param, "PREF", 4) == 0)) {
+        prop->preferred = 1;
+    }
+}
+
+// Splits "group.NAME;param=value;...:value" in place.
+static int parse_property(char* line, Property* prop) {
+    memset(prop, 0, sizeof(Property));
+    char* p = line;
+    while (*p && *p != ';' && *p != ':') {
+        p++;
+    }
+    char* name_end = p;
+    while (*p == ';') {
+        char* param = ++p;
+        int quoted = 0;
+        while (*p && (quoted || (*p != ';' && *p != ':'))) {
+            if (*p == '"') {
+                quoted = !quoted;
+            }
+            p++;
+        }
+        parse_parameter(param, p - param, prop);
+    }
+    if (*p != ':') {
+        return 0;
+    }
+    prop->value = p + 1;
+    *name_end = '\0';
+    char* dot = strrchr(line, '.');
+    prop->name = dot ? dot + 1 : line;
+    return 1;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+static void decode_quoted_printable(char* s) {
+    char* out = s;
+    for (char* p = s; *p; p++) {
+        int hi, lo;
+        if (*p == '=' && (hi = hex_value(p[1])) >= 0 && (lo = hex_value(p[2])) >= 0) {
+            *out++ = (char)(hi * 16 + lo);
+            p += 2;
+        } else {
+            *out++ = *p;
+        }
+    }
+    *out = '\0';
+}
+
+// Undoes TEXT escaping. Contact fields are single-line, so an escaped newline becomes a space.
+static size_t unescape_text(char* s, size_t len) {
+    size_t out = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == '\\' && i + 1 < len) {
+            char c = s[++i];
+            s[out++] = (c == 'n' || c == 'N') ? ' ' : c;
+        } else {
+            s[out++] = s[i];
+        }
+    }
+    s[out] = '\0';
+    return out;
+}
+
+// Moves a decoded value to the kept area in front of the reader.
+static char* keep_value(LineReader* reader, const char* value, size_t len) {
+    char* kept = memmove(reader->out, value, len);
+    kept[len] = '\0';
+    reader->out += len + 1;
+    return kept;
+}
+
+// Builds "Given Family" from N:Family;Given;Additional;Prefix;Suffix.
+static char* keep_structured_name(LineReader* reader, char* value) {
+    char* components[2] = {NULL, NULL};
+    size_t lengths[2] = {0, 0};
+    char* start = value;
+    for (int i = 0; i < 2; i++) {
+        char* p = start;
+        while (*p && *p != ';') {
+            p += (*p == '\\' && p[1]) ? 2 : 1;
+        }
+        components[i] = start;
+        lengths[i] = p - start;
+        start = *p ? p + 1 : p;
+    }
+    size_t family_len = unescape_text(components[0], lengths[0]);
+    size_t given_len = unescape_text(components[1], lengths[1]);
+
+    if (given_len + family_len == 0) {
+        return NULL;
+    }
+    // Writing the given name first would overwrite the family name, which precedes it in the line
+    char* family = strndup(components[0], family_len);
+    char* out = reader->out;
+    size_t len = 0;
+    memmove(out, components[1], given_len);
+    len += given_len;
+    if (given_len > 0 && family_len > 0) {
+        out[len++] = ' ';
+    }
+    memcpy(out + len, family, family_len);
+    len += family_len;
+    out[len] = '\0';
+    free(family);
+    reader->out += len + 1;
+    return out;
+}
+
+// Returns the end of the structured value component starting at p.
+static char* component_end(char* p) {
+    while (*p && *p != ';') {
+        p += (*p == '\\' && p[1]) ? 2 : 1;
+    }
+    return p;
+}
+
+// Keeps the non-empty components of a structured value such as ADR, joined
+// by ", ". The joined value may outgrow the line when most components are
+// set, and then falls back to a bare ",".
+static char* keep_components(LineReader* reader, char* value) {
+    size_t value_len = strlen(value);
+    // The kept area may reach up to the line's terminating NUL
+    size_t room = value + value_len + 1 - reader->out;
+    char* joined = malloc(value_len * 2 + 1);
+    size_t len = 0;
+    for (size_t separator_len = 2; separator_len > 0; separator_len--) {
+        len = 0;
+        for (char* p = value; *p;) {
+            char* end = component_end(p);
+            size_t at = len > 0 ? len + separator_len : 0;
+            size_t n = unescape_text(memcpy(joined + at, p, end - p), end - p);
+            if (n > 0) {
+                memcpy(joined + len, ", ", at - len);
+                len = at + n;
+            }
+            p = *end ? end + 1 : end;
+        }
+        if (len + 1 <= room) {
+            break;
+        }
+    }
+    char* kept = keep_value(reader, joined, len);
+    free(joined);
+    return kept;
+}
+
+static void chunk_add(VCardChunk* chunk, const CardState* card) {
+    if (chunk->count == chunk->capacity) {
+        chunk->capacity = chunk->capacity ? chunk->capacity * 2 : 1024;
+        chunk->cards = realloc(chunk->cards, sizeof(Contact) * chunk->capacity);
+    }
+    Contact* contact = &chunk->cards[chunk->count++];
+    contact->name = card->name ? card->name : card->structured_name;
+    for (int f = CONTACT_FIELD_NAME + 1; f < CONTACT_FIELD_COUNT; f++) {
+        contact->fields[f] = card->value_count[f] > 0 ? card->values[f][0] : "";
+    }
+}
+
+// Lays the card's values out again from where it started, with the several
+// values of a field joined into one. Joining turns each NUL between them into
+// a separator, so the card takes no more room than before.
+static void card_join_values(CardState* card, char* end, char** scratch, size_t* scratch_size) {
+    size_t size = end - card->kept;
+    if (size > *scratch_size) {
+        *scratch_size = size * 2;
+        *scratch = realloc(*scratch, *scratch_size);
+    }
+    memcpy(*scratch, card->kept, size);
+    char* out = card->kept;
+    char** names[2] = {&card->name, &card->structured_name};
+    for (int i = 0; i < 2; i++) {
+        if (*names[i]) {
+            size_t len = strlen(*scratch + (*names[i] - card->kept)) + 1;
+            *names[i] = memcpy(out, *scratch + (*names[i] - card->kept), len);
+            out += len;
+        }
+    }
+    for (int f = 0; f < CONTACT_FIELD_COUNT; f++) {
+        if (card->value_count[f] == 0) {
+            continue;
+        }
+        char* start = out;
+        for (int i = 0; i < card->value_count[f]; i++) {
+            if (i > 0) {
+                out[-1] = CONTACT_VALUE_SEPARATOR;
+            }
+            size_t len = strlen(*scratch + (card->values[f][i] - card->kept)) + 1;
+            memcpy(out, *scratch + (card->values[f][i] - card->kept), len);
+            out += len;
+        }
+        card->values[f][0] = start;
+        card->value_count[f] = 1;
+    }
+}
+
+static int card_field(const char* property) {
+    for (int f = CONTACT_FIELD_NAME + 1; f < CONTACT_FIELD_COUNT; f++) {
+        if (strcasecmp(property, card_properties[f]) == 0) {
+            return f;
+        }
+    }
+    return -1;
+}
+
+// Whether a value of field is kept: up to CARD_MAX_VALUES of a field with
+// several, else a preferred one over an earlier one that is not.
+static int card_wants(const CardState* card, int field, int preferred) {
+    int count = card->value_count[field];
+    if (contact_fields[field].flags & CONTACT_FIELD_MULTIPLE) {
+        return count < CARD_MAX_VALUES;
+    }
+    return count == 0 || (preferred && card->preferred_count[field] == 0);
+}
+
+static void card_add_value(CardState* card, int field, char* value, int preferred) {
+    if (!(contact_fields[field].flags & CONTACT_FIELD_MULTIPLE)) {
+        card->values[field][0] = value;
+        card->value_count[field] = 1;
+        card->preferred_count[field] = preferred;
+        return;
+    }
+    // One value must not read as two once they are joined
+    for (char* p = value; (p = strchr(p, CONTACT_VALUE_SEPARATOR)) != NULL;) {
+        *p = ' ';
+    }
+    int at = preferred ? card->preferred_count[field]++ : card->value_count[field];
+    memmove(&card->values[field][at + 1], &card->values[field][at],
+            sizeof(char*) * (card->value_count[field] - at));
+    card->values[field][at] = value;
+    card->multiple |= ++card->value_count[field] > 1;
+}
+
+static void parse_property_line(LineReader* reader, char* line, size_t len, CardState* card) {
+    Property prop;
+    if (!parse_property(line, &prop)) {
+        return;
+    }
+    int is_name = strcasecmp(prop.name, "FN") == 0;
+    int is_structured_name = strcasecmp(prop.name, "N") == 0;
+    int field = is_name || is_structured_name ? CONTACT_FIELD_NAME : card_field(prop.name);
+    if (field < 0) {
+        if (prop.quoted_printable) {
+            quoted_printable_continue(reader, line, &len);
+        }
+        return;
+    }
+    if (prop.quoted_printable) {
+        // Consumes the continuation lines even if the value is not kept
+        quoted_printable_continue(reader, line, &len);
+    }
+    if ((is_structured_name && card->name) || (field != CONTACT_FIELD_NAME && !card_wants(card, field, prop.preferred))) {
+        return;
+    }
+    if (prop.quoted_printable) {
+        decode_quoted_printable(prop.value);
+    }
+    if (is_structured_name) {
+        card->structured_name = keep_structured_name(reader, prop.value);
+        return;
+    }
+    if (field == CONTACT_FIELD_ADDRESS) {
+        char* kept = keep_components(reader, prop.value);
+        if (kept[0]) {
+            card_add_value(card, field, kept, prop.preferred);
+        }
+        return;
+    }
+
+    char* value = prop.value;
+    // Only the organization's name, not its units
+    size_t value_len = field == CONTACT_FIELD_ORGANIZATION ? (size_t)(component_end(value) - value) : strlen(value);
+    value_len = unescape_text(value, value_len);
+    if (field == CONTACT_FIELD_PHONE && value_len >= 4 && strncasecmp(value, "tel:", 4) == 0) {
+        value += 4;
+        value_len -= 4;
+    }
+    char* kept = keep_value(reader, value, value_len);
+    if (is_name) {
+        card->name = value_len > 0 ? kept : NULL;
+    } else if (value_len > 0) {
+        card_add_value(card, field, kept, prop.preferred);
+    }
+}
+
+static void parse_chunk(VCardChunk* chunk) {
+    LineReader reader = {chunk->data, chunk->data + chunk->size, chunk->data};
+    CardState card;
+    memset(&card, 0, sizeof(card));
+    char* scratch = NULL;
+    size_t scratch_size = 0;
+
+    char* line;
+    size_t len;
+    while ((line = logical_line(&reader, &len)) != NULL) {
+        if (strcasecmp(line, "BEGIN:VCARD") == 0) {
+            // Cards nested in an AGENT property are skipped along with their contents
+            if (card.depth++ == 0) {
+                memset(&card, 0, sizeof(card));
+                card.depth = 1;
+                card.kept = reader.out;
+            }
+        } else if (strcasecmp(line, "END:VCARD") == 0) {
+            if (card.depth > 0 && --card.depth == 0 && (card.name || card.structured_name)) {
+                if (card.multiple) {
+                    card_join_values(&card, reader.out, &scratch, &scratch_size);
+                }
+                chunk_add(chunk, &card);
+            }
+        } else if (card.depth == 1) {
+            parse_property_line(&reader, line, len, &card);
+        }
+    }
+    free(scratch);
+}
+
+static void* parser_main(void* data) {
+    VCardPipeline* pipeline = data;
+    pthread_mutex_lock(&pipeline->lock);
+    for (;;) {
+        while (!pipeline->stop && !pipeline->eof && pipeline->next_parse == pipeline->next_read) {
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+        }
+        if (pipeline->stop || pipeline->next_parse == pipeline->next_read) {
+            break;
+        }
+        VCardChunk* chunk = pipeline->slots[pipeline->next_parse++ % pipeline->max_in_flight];
+        pthread_mutex_unlock(&pipeline->lock);
+
+        parse_chunk(chunk);
+
+        pthread_mutex_lock(&pipeline->lock);
+        chunk->parsed = 1;
+        pthread_cond_broadcast(&pipeline->changed);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+// --- Merge ---
+
+static void chunk_free(VCardChunk* chunk) {
+    free(chunk->data);
+    free(chunk->cards);
+    free(chunk);
+}
+
+static double monotonic_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int vcard_read(int fd, int threads, VCardBatchFunc func, void* user_data, VCardReadStats* stats) {
+    double start = monotonic_seconds();
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? cpus : 1;
+    }
+
+    VCardPipeline pipeline;
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.fd = fd;
+    pipeline.max_in_flight = threads * VCARD_CHUNKS_PER_THREAD;
+    pipeline.slots = calloc(pipeline.max_in_flight, sizeof(VCardChunk*));
+    pthread_mutex_init(&pipeline.lock, NULL);
+    pthread_cond_init(&pipeline.changed, NULL);
+
+    pthread_t reader;
+    pthread_t* parsers = malloc(sizeof(pthread_t) * threads);
+    pthread_create(&reader, NULL, reader_main, &pipeline);
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&parsers[i], NULL, parser_main, &pipeline);
+    }
+
+    // Chunks are delivered in input order, so cards arrive in file order
+    uint64_t cards = 0;
+    pthread_mutex_lock(&pipeline.lock);
+    for (;;) {
+        VCardChunk* chunk = NULL;
+        while (!(pipeline.eof && pipeline.next_merge == pipeline.next_read) &&
+               !(pipeline.next_merge < pipeline.next_read &&
+                 (chunk = pipeline.slots[pipeline.next_merge % pipeline.max_in_flight])->parsed)) {
+            pthread_cond_wait(&pipeline.changed, &pipeline.lock);
+        }
+        if (pipeline.next_merge == pipeline.next_read) {
+            break;
+        }
+        pthread_mutex_unlock(&pipeline.lock);
+
+        int more = func(chunk->cards, chunk->count, user_data);
+        cards += chunk->count;
+        chunk_free(chunk);
+
+        pthread_mutex_lock(&pipeline.lock);
+        pipeline.slots[pipeline.next_merge++ % pipeline.max_in_flight] = NULL;
+        if (!more) {
+            pipeline.stop = 1;
+        }
+        pthread_cond_broadcast(&pipeline.changed);
+        if (!more) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pipeline.lock);
+
+    pthread_join(reader, NULL);
+    for (int i = 0; i < threads; i++) {
+        pthread_join(parsers[i], NULL);
+    }
+    // Chunks left behind by a stopped read
+    for (uint64_t n = pipeline.next_merge; n < pipeline.next_read; n++) {
+        chunk_free(pipeline.slots[n % pipeline.max_in_flight]);
+    }
+
+    if (stats) {
+        stats->bytes = pipeline.bytes;
+        stats->cards = cards;
+        stats->seconds = monotonic_seconds() - start;
+    }
+    free(parsers);
+    free(pipeline.slots);
+    pthread_mutex_destroy(&pipeline.lock);
+    pthread_cond_destroy(&pipeline.changed);
+    return !pipeline.error;
+}
+
+// --- Writer ---
+
+#define VCARD_LINE_LIMIT 75
+
+typedef struct {
+    int fd;
+    char* segments[VCARD_WRITE_SEGMENTS];
+    struct iovec iov[VCARD_WRITE_SEGMENTS];
+    int segment;
+    char* pos;
+    char* limit;
+    // Octets on the current output line, for folding
+    int line_len;
+    int error;
+} VCardWriter;
+
+static void writer_start_segment(VCardWriter* writer, int segment) {
+    writer->segment = segment;
+    writer->pos = writer->segments[segment];
+    writer->limit = writer->pos + VCARD_WRITE_SEGMENT_SIZE;
+}
+
+static void writer_flush(VCardWriter* writer) {
+    int count = writer->segment + 1;
+    for (int i = 0; i < count; i++) {
+        writer->iov[i].iov_base = writer->segments[i];
+    }
+    writer->iov[writer->segment].iov_len = writer->pos - writer->segments[writer->segment];
+    if (!writer->error && !file_writev_all(writer->fd, writer->iov, count)) {
+        writer->error = 1;
+    }
+    writer_start_segment(writer, 0);
+}
+
+// Makes room for n contiguous bytes, moving to the next segment or writing them all out.
+static void writer_reserve(VCardWriter* writer, size_t n) {
+    if ((size_t)(writer->limit - writer->pos) >= n) {
+        return;
+    }
+    if (writer->segment + 1 == VCARD_WRITE_SEGMENTS) {
+        writer_flush(writer);
+        return;
+    }
+    writer->iov[writer->segment].iov_len = writer->pos - writer->segments[writer->segment];
+    writer_start_segment(writer, writer->segment + 1);
+}
+
+static void writer_line_end(VCardWriter* writer) {
+    writer_reserve(writer, 2);
+    *writer->pos++ = '\r';
+    *writer->pos++ = '\n';
+    writer->line_len = 0;
+}
+
+static int needs_escape(unsigned char c) {
+    return c == '\\' || c == ',' || c == ';' || c == '\n';
+}
+
+// Length of the unit starting at s that must stay on one line: an escape or a whole UTF-8 sequence.
+static int unit_length(const unsigned char* s, int escape) {
+    if (escape && needs_escape(*s)) {
+        return 2;
+    }
+    int len = *s >= 0xF0 ? 4 : *s >= 0xE0 ? 3 : *s >= 0xC0 ? 2 : 1;
+    for (int i = 1; i < len; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            return i;
+        }
+    }
+    return len;
+}
+
+// Writes len value bytes, escaping TEXT specials if asked and folding lines
+// at 75 octets without splitting an escape or a UTF-8 sequence. Runs of plain
+// bytes are copied in one go.
+static void writer_put_len(VCardWriter* writer, const char* value, size_t len, int escape) {
+    const unsigned char* s = (const unsigned char*)value;
+    const unsigned char* end = s + len;
+    while (s < end) {
+        size_t room = VCARD_LINE_LIMIT - writer->line_len;
+        if ((size_t)(writer->limit - writer->pos) < room) {
+            room = writer->limit - writer->pos;
+        }
+        if ((size_t)(end - s) < room) {
+            room = end - s;
+        }
+        size_t span = 0;
+        while (span < room && !(escape && needs_escape(s[span]))) {
+            span++;
+        }
+        if (span == room) {
+            while (span > 0 && (s[span] & 0xC0) == 0x80) {
+                span--;
+            }
+        }
+        if (span > 0) {
+            memcpy(writer->pos, s, span);
+            writer->pos += span;
+            writer->line_len += span;
+            s += span;
+            continue;
+        }
+
+        int len = unit_length(s, escape);
+        if (writer->line_len + len > VCARD_LINE_LIMIT) {
+            writer_line_end(writer);
+            writer_reserve(writer, 1);
+            *writer->pos++ = ' ';
+            writer->line_len = 1;
+        }
+        writer_reserve(writer, len);
+        if (len == 2 && escape && needs_escape(*s)) {
+            *writer->pos++ = '\\';
+            *writer->pos++ = *s == '\n' ? 'n' : *s;
+            s++;
+        } else {
+            memcpy(writer->pos, s, len);
+            writer->pos += len;
+            s += len;
+        }
+        writer->line_len += len;
+    }
+}
+
+static void writer_put(VCardWriter* writer, const char* value, int escape) {
+    writer_put_len(writer, value, strlen(value), escape);
+}
+
+static void writer_property(VCardWriter* writer, const char* name, const char* value) {
+    writer_put(writer, name, 0);
+    writer_put(writer, value, 1);
+    writer_line_end(writer);
+}
+
+// Writes one property per value of a field that may hold several.
+static void writer_values(VCardWriter* writer, const char* name, const char* values) {
+    while (*values) {
+        const char* end = strchr(values, CONTACT_VALUE_SEPARATOR);
+        size_t len = end ? (size_t)(end - values) : strlen(values);
+        if (len > 0) {
+            writer_put(writer, name, 0);
+            writer_put_len(writer, values, len, 1);
+            writer_line_end(writer);
+        }
+        values += end ? len + 1 : len;
+    }
+}
+
+int vcard_write(int fd, Contact** contacts, int count, VCardVersion version) {
+    VCardWriter writer;
+    memset(&writer, 0, sizeof(writer));
+    writer.fd = fd;
+    for (int i = 0; i < VCARD_WRITE_SEGMENTS; i++) {
+        writer.segments[i] = malloc(VCARD_WRITE_SEGMENT_SIZE);
+    }
+    writer_start_segment(&writer, 0);
+
+    const char* version_line = version == VCARD_VERSION_4 ? "VERSION:4.0" : "VERSION:3.0";
+    // 4.0 defaults TEL to a URI value
+    const char* tel = version == VCARD_VERSION_4 ? "TEL;VALUE=text:" : "TEL:";
+    for (int i = 0; i < count && !writer.error; i++) {
+        Contact* contact = contacts[i];
+        writer_put(&writer, "BEGIN:VCARD", 0);
+        writer_line_end(&writer);
+        writer_put(&writer, version_line, 0);
+        writer_line_end(&writer);
+        writer_property(&writer, "FN:", contact->name);
+        // N is required by 3.0; only the full name is known, so it goes in the family name component
+        if (version == VCARD_VERSION_3) {
+            writer_put(&writer, "N:", 0);
+            writer_put(&writer, contact->name, 1);
+            writer_put(&writer, ";;;;", 0);
+            writer_line_end(&writer);
+        }
+        writer_values(&writer, tel, contact->phone);
+        writer_values(&writer, "EMAIL:", contact->email);
+        if (contact->organization[0]) {
+            writer_property(&writer, "ORG:", contact->organization);
+        }
+        // The address is kept as one line, so it all goes in the street component
+        if (contact->address[0]) {
+            writer_put(&writer, "ADR:;;", 0);
+            writer_put(&writer, contact->address, 1);
+            writer_put(&writer, ";;;;", 0);
+            writer_line_end(&writer);
+        }
+        if (contact->notes[0]) {
+            writer_property(&writer, "NOTE:", contact->notes);
+        }
+        writer_put(&writer, "END:VCARD", 0);
+        writer_line_end(&writer);
+    }
+    writer_flush(&writer);
+
+    for (int i = 0; i < VCARD_WRITE_SEGMENTS; i++) {
+        free(writer.segments[i]);
+    }
+    return !writer.error;
+}
@@ -0,0 +1,51 @@
+#ifndef VCARD_H
+#define VCARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "contact_arena.h"
+
+// Streaming vCard 2.1/3.0/4.0 reader.
+//
+// A reader thread reads the input in chunks that end on a BEGIN:VCARD line,
+// a pool of parser threads turns each chunk into contacts in place (unfolding
+// lines, decoding parameters, quoted-printable and escapes), and the calling
+// thread receives the parsed chunks in input order. At most
+// VCARD_CHUNKS_PER_THREAD chunks per parser are in memory at any time, so
+// memory use does not depend on the size of the input.
+
+#define VCARD_CHUNK_SIZE (4 * 1024 * 1024)
+#define VCARD_CHUNKS_PER_THREAD 2
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t cards;
+    double seconds;
+} VCardReadStats;
+
+// Receives the cards parsed from one chunk. The strings are only valid during
+// the call. Returning 0 stops the read.
+typedef int (*VCardBatchFunc)(const Contact* cards, size_t count, void* user_data);
+
+// Cards without a name (FN, or N as a fallback) are skipped. The other fields
+// come from TEL, EMAIL, ORG (its first component), ADR (its components joined
+// by ", ") and NOTE; a card's TEL and EMAIL values are each joined into one
+// field, preferred ones first. threads <= 0 uses one parser per online CPU.
+// Returns 0 on a read error; stats may be NULL.
+int vcard_read(int fd, int threads, VCardBatchFunc func, void* user_data, VCardReadStats* stats);
+
+typedef enum {
+    VCARD_VERSION_3,
+    VCARD_VERSION_4
+} VCardVersion;
+
+#define VCARD_WRITE_SEGMENT_SIZE (256 * 1024)
+#define VCARD_WRITE_SEGMENTS 8
+
+// Serializes contacts straight into VCARD_WRITE_SEGMENTS output buffers, one
+// TEL or EMAIL property per value and the address as ADR's street component,
+// escaping and folding lines at 75 octets on the way, and hands full buffers
+// to a single writev. Returns 0 on a write error.
+int vcard_write(int fd, Contact** contacts, int count, VCardVersion version);
+
+#endif